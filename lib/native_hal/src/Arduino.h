@@ -0,0 +1,224 @@
+#pragma once
+
+// Host build of the Arduino-ESP32 core subset the firmware uses. Time only
+// moves through the virtual clock in sim.h: delay() advances it and fires
+// whatever timers fall due on the way.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sim.h"
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define digitalPinToInterrupt(pin) (pin)
+
+#define PROGMEM
+#define PGM_P const char*
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+// The ISR runs when sim::setInput() changes the level as mode asks
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void detachInterrupt(uint8_t pin);
+
+uint32_t esp_random();
+bool psramFound();
+void* ps_malloc(size_t size);
+
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1,
+                const char* server2 = nullptr, const char* server3 = nullptr);
+
+// Takes memory through malloc(), so String shows in sim::heapStats() as
+// the core's String does on the device
+template <typename T>
+struct HeapAllocator {
+    typedef T value_type;
+    HeapAllocator() {}
+    template <typename U>
+    HeapAllocator(const HeapAllocator<U>&) {}
+    T* allocate(size_t count) {
+        T* block = (T*)malloc(count * sizeof(T));
+        if (!block) {
+            fprintf(stderr, "[sim] out of heap for a String of %zu bytes\n", count * sizeof(T));
+            abort();
+        }
+        return block;
+    }
+    void deallocate(T* block, size_t) { free(block); }
+    template <typename U>
+    bool operator==(const HeapAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const HeapAllocator<U>&) const { return false; }
+};
+
+class String {
+private:
+    typedef std::basic_string<char, std::char_traits<char>, HeapAllocator<char> > Text;
+    Text text;
+
+    String(const Text& value) : text(value) {}
+
+public:
+    String(const char* value = "") : text(value ? value : "") {}
+    String(const std::string& value) : text(value.c_str(), value.size()) {}
+    explicit String(char value) : text(1, value) {}
+    explicit String(int value) : text(std::to_string(value).c_str()) {}
+    explicit String(unsigned int value) : text(std::to_string(value).c_str()) {}
+    explicit String(long value) : text(std::to_string(value).c_str()) {}
+    explicit String(unsigned long value) : text(std::to_string(value).c_str()) {}
+    explicit String(double value, unsigned int decimals = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        text = buffer;
+    }
+
+    const char* c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.size(); }
+    bool isEmpty() const { return text.empty(); }
+    long toInt() const { return atol(text.c_str()); }
+    float toFloat() const { return atof(text.c_str()); }
+    char operator[](unsigned int index) const { return index < text.size() ? text[index] : 0; }
+
+    int indexOf(const char* needle) const {
+        size_t found = text.find(needle);
+        return found == std::string::npos ? -1 : (int)found;
+    }
+    String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const {
+        if (from >= text.size()) return String();
+        return String(text.substr(from, min((size_t)to, text.size()) - from));
+    }
+    void trim() {
+        size_t first = text.find_first_not_of(" \t\r\n");
+        size_t last = text.find_last_not_of(" \t\r\n");
+        text = first == std::string::npos ? "" : text.substr(first, last - first + 1);
+    }
+    void toUpperCase() {
+        for (size_t i = 0; i < text.size(); i++) text[i] = toupper(text[i]);
+    }
+
+    bool operator==(const String& other) const { return text == other.text; }
+    bool operator==(const char* other) const { return text == (other ? other : ""); }
+    bool operator!=(const String& other) const { return text != other.text; }
+    bool operator!=(const char* other) const { return !(*this == other); }
+    String& operator+=(const String& other) { text += other.text; return *this; }
+    String& operator+=(const char* other) { text += other; return *this; }
+    String operator+(const String& other) const { return String(text + other.text); }
+    String operator+(const char* other) const { return String(text + other); }
+    friend String operator+(const char* left, const String& right) { return String(left + right.text); }
+};
+
+class IPAddress {
+private:
+    uint8_t octets[4];
+
+public:
+    IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : octets{a, b, c, d} {}
+    // As on the device: the first octet in the lowest byte
+    IPAddress(uint32_t address) { memcpy(octets, &address, sizeof(octets)); }
+    operator uint32_t() const {
+        uint32_t address;
+        memcpy(&address, octets, sizeof(address));
+        return address;
+    }
+    bool fromString(const String& text) { return fromString(text.c_str()); }
+    bool fromString(const char* text) {
+        unsigned a, b, c, d;
+        char extra;
+        if (sscanf(text, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    String toString() const {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", octets[0], octets[1], octets[2], octets[3]);
+        return String(buffer);
+    }
+};
+
+// Serial goes to stdout
+class Print {
+public:
+    void begin(unsigned long baud) {}
+    void flush() { fflush(stdout); }
+    size_t print(const char* text) {
+        if (!sim::serialEnabled()) return 0;
+        return fputs(text, stdout) >= 0 ? strlen(text) : 0;
+    }
+    size_t print(const String& text) { return print(text.c_str()); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(const IPAddress& address) { return print(address.toString()); }
+    size_t println() { return print("\n"); }
+    template <typename T> size_t println(const T& value) { return print(value) + println(); }
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        if (!sim::serialEnabled()) return 0;
+        va_list args;
+        va_start(args, format);
+        int written = vprintf(format, args);
+        va_end(args);
+        return written < 0 ? 0 : written;
+    }
+};
+
+extern Print Serial;
+
+class EspClass {
+public:
+    // A restart ends the simulation; RAM state cannot be reset in-process
+    void restart();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+    // Host time at getCpuFreqMHz(): the virtual clock stands still while
+    // code runs, so this measures the code on the host
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 240; }
+};
+
+extern EspClass ESP;
+
+// Hardware timers run on the virtual clock at 1 tick per divider/80 us
+typedef struct hw_timer_s hw_timer_t;
+hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp);
+void timerAttachInterrupt(hw_timer_t* timer, void (*isr)(void), bool edge);
+void timerAlarmWrite(hw_timer_t* timer, uint64_t alarmValue, bool autoreload);
+void timerAlarmEnable(hw_timer_t* timer);
+void timerAlarmDisable(hw_timer_t* timer);
+void timerWrite(hw_timer_t* timer, uint64_t value);
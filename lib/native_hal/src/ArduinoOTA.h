@@ -0,0 +1,13 @@
+#pragma once
+
+#include <Arduino.h>
+
+class ArduinoOTAClass {
+public:
+    ArduinoOTAClass& setHostname(const char* hostname) { return *this; }
+    ArduinoOTAClass& setPassword(const char* password) { return *this; }
+    void begin() {}
+    void handle() {}
+};
+
+extern ArduinoOTAClass ArduinoOTA;
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <Arduino.h>
+
+class MDNSResponder {
+public:
+    bool begin(const char* hostname) { return true; }
+    void end() {}
+    bool addService(const char* service, const char* protocol, uint16_t port) { return true; }
+    bool addServiceTxt(const char* service, const char* protocol, const char* key, const char* value) { return true; }
+};
+
+extern MDNSResponder MDNS;
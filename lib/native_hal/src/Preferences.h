@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+// NVS stand-in: values live in memory for the lifetime of the process, one
+// map per namespace, stored as raw bytes like the real blob API
+class Preferences {
+private:
+    typedef std::map<std::string, std::string> Namespace;
+    Namespace* entries = nullptr;
+
+    size_t put(const char* key, const void* value, size_t length) {
+        if (!entries) return 0;
+        (*entries)[key] = std::string((const char*)value, length);
+        return length;
+    }
+    template <typename T> T get(const char* key, T defaultValue) {
+        T value = defaultValue;
+        getBytes(key, &value, sizeof(value));
+        return value;
+    }
+
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end() { entries = nullptr; }
+    bool clear() {
+        if (entries) entries->clear();
+        return entries != nullptr;
+    }
+
+    bool isKey(const char* key) { return entries && entries->count(key); }
+    bool remove(const char* key) { return entries && entries->erase(key); }
+
+    size_t getBytesLength(const char* key) { return isKey(key) ? (*entries)[key].size() : 0; }
+    size_t getBytes(const char* key, void* buffer, size_t length) {
+        size_t stored = getBytesLength(key);
+        if (stored == 0 || stored > length) return 0;
+        memcpy(buffer, (*entries)[key].data(), stored);
+        return stored;
+    }
+    size_t putBytes(const char* key, const void* value, size_t length) { return put(key, value, length); }
+
+    uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUChar(const char* key, uint8_t value) { return put(key, &value, sizeof(value)); }
+    int32_t getInt(const char* key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putInt(const char* key, int32_t value) { return put(key, &value, sizeof(value)); }
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putUInt(const char* key, uint32_t value) { return put(key, &value, sizeof(value)); }
+    float getFloat(const char* key, float defaultValue = NAN) { return get(key, defaultValue); }
+    size_t putFloat(const char* key, float value) { return put(key, &value, sizeof(value)); }
+
+    String getString(const char* key, String defaultValue = String()) {
+        return isKey(key) ? String((*entries)[key]) : defaultValue;
+    }
+    size_t putString(const char* key, const char* value) { return put(key, value, strlen(value)); }
+    size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+};
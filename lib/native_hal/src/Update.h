@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+
+// Accepts an image into memory; nothing is flashed
+class UpdateClass {
+private:
+    bool running = false;
+    bool failed = false;
+    size_t written = 0;
+
+public:
+    bool begin(size_t size = UPDATE_SIZE_UNKNOWN) {
+        running = true;
+        failed = false;
+        written = 0;
+        return true;
+    }
+    size_t write(uint8_t* data, size_t length) {
+        if (!running) {
+            failed = true;
+            return 0;
+        }
+        written += length;
+        return length;
+    }
+    bool end(bool evenIfRemaining = false) {
+        failed = failed || !running || written == 0;
+        running = false;
+        return !failed;
+    }
+    void abort() {
+        running = false;
+        failed = true;
+    }
+    bool isRunning() { return running; }
+    bool hasError() { return failed; }
+    size_t progress() { return written; }
+    void printError(Print& out) { out.println(failed ? "Update failed" : "No error"); }
+};
+
+extern UpdateClass Update;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define SIM_WIFI_CHANNEL 6
+#define SIM_WIFI_SCAN_MS 2500  // join after a full scan
+#define SIM_WIFI_DIRECT_MS 400 // join with a known BSSID and channel
+#define SIM_WIFI_DHCP_MS 700
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+// Any non-empty SSID joins a simulated network, taking the virtual time a
+// scan, association and DHCP would, unless sim::setWiFiAvailable(false).
+// A begin() naming a BSSID and channel other than the network's never
+// connects, like a stale cache on the device.
+class WiFiClass {
+private:
+    wifi_mode_t wifiMode = WIFI_OFF;
+    String ssid;
+    bool joining = false;
+    bool staticAddress = false;
+    uint64_t joinedAtUs = 0;
+    uint8_t bssid[6] = {0x24, 0x0A, 0xC4, 0x12, 0x34, 0x56};
+
+    bool connected() {
+        return joining && sim::wifiAvailable() && sim::nowUs() >= joinedAtUs;
+    }
+
+public:
+    void persistent(bool persist) {}
+    void setHostname(const char* name) {}
+    bool setAutoReconnect(bool reconnect) { return true; }
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress()) {
+        staticAddress = (uint32_t)local != 0;
+        return true;
+    }
+    void begin(const char* network, const char* password, int32_t channel = 0, const uint8_t* target = nullptr) {
+        if (wifiMode == WIFI_OFF) wifiMode = WIFI_STA;
+        ssid = network;
+        bool direct = channel != 0 && target != nullptr;
+        joining = !ssid.isEmpty() &&
+                  (!direct || (channel == SIM_WIFI_CHANNEL && memcmp(target, bssid, sizeof(bssid)) == 0));
+        uint64_t delayMs = (direct ? SIM_WIFI_DIRECT_MS : SIM_WIFI_SCAN_MS) + (staticAddress ? 0 : SIM_WIFI_DHCP_MS);
+        joinedAtUs = joining ? sim::nowUs() + delayMs * 1000 : UINT64_MAX;
+    }
+    wl_status_t status() { return connected() ? WL_CONNECTED : WL_DISCONNECTED; }
+    bool isConnected() { return connected(); }
+    String SSID() { return connected() ? ssid : String(); }
+    int8_t RSSI() { return connected() ? -60 : 0; }
+    int32_t channel() { return connected() ? SIM_WIFI_CHANNEL : 0; }
+    uint8_t* BSSID() { return connected() ? bssid : nullptr; }
+    IPAddress localIP() { return connected() ? IPAddress(192, 168, 1, 50) : IPAddress(); }
+
+    bool softAP(const char* network, const char* password = nullptr) {
+        wifiMode = (wifi_mode_t)(wifiMode | WIFI_AP);
+        return true;
+    }
+    bool softAPsetHostname(const char* name) { return true; }
+    bool softAPdisconnect(bool wifiOff = false) {
+        wifiMode = (wifi_mode_t)(wifiMode & ~WIFI_AP);
+        return true;
+    }
+    uint8_t softAPgetStationNum() { return 0; }
+    IPAddress softAPIP() { return IPAddress(192, 168, 4, 1); }
+
+    wifi_mode_t getMode() { return wifiMode; }
+    bool mode(wifi_mode_t newMode) {
+        wifiMode = newMode;
+        if (!(newMode & WIFI_STA)) joining = false;
+        return true;
+    }
+    bool disconnect(bool wifiOff = false, bool eraseAp = false) {
+        joining = false;
+        if (wifiOff) wifiMode = WIFI_OFF;
+        return true;
+    }
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    SNTP_SYNC_STATUS_RESET,
+    SNTP_SYNC_STATUS_COMPLETED,
+    SNTP_SYNC_STATUS_IN_PROGRESS
+} sntp_sync_status_t;
+
+// Applies a time from an SNTP reply; weak, so firmware can take it over as
+// on the device. The sim's --ntp step calls it.
+void sntp_sync_time(struct timeval* tv);
+void sntp_set_sync_status(sntp_sync_status_t status);
+sntp_sync_status_t sntp_get_sync_status(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+// A task runs in a thread of its own, but only one of them or the main
+// thread at a time: it gets its turn when sim::advance() reaches the time
+// it waits for, and hands the turn back whenever it blocks (vTaskDelay(),
+// delay(), a semaphore, a notification, lwip_select()). Runs stay
+// deterministic. Cores are ignored, and stacks are not measured: the high
+// water mark is the whole stack.
+typedef struct SimTask* TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task); // bytes, as on ESP-IDF
+inline BaseType_t xPortGetCoreID() { return 1; } // where Arduino's loop() runs
+
+// Notifications as a counting semaphore per task; the FromISR variant may
+// also be called from timer callbacks
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+#define portYIELD_FROM_ISR(...)
@@ -0,0 +1,1004 @@
+// Simulated implementations behind the native HAL headers
+
+#include <Arduino.h>
+#include <ArduinoOTA.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <esp_partition.h>
+#include <esp_sntp.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <lwip/sockets.h>
+#include <soc/gpio_struct.h>
+#include <sys/time.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define SIM_PIN_COUNT 64
+#define SIM_DEFAULT_EPOCH 1718000000 // 2024-06-10 06:13 UTC
+#define SIM_HISTORY_PARTITION_SIZE 0x40000
+#define SIM_HEAP_BYTES (256 * 1024)  // free heap of the feeder after WiFi is up
+#define SIM_HEAP_BLOCK_OVERHEAD 8    // the device allocator's header per block
+#define SIM_HEAP_ALIGN 4
+
+Print Serial;
+EspClass ESP;
+WiFiClass WiFi;
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
+UpdateClass Update;
+gpio_dev_t GPIO;
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    bool armed;
+    uint64_t dueUs;
+    uint64_t periodUs;
+};
+
+struct hw_timer_s {
+    uint16_t divider;
+    void (*isr)(void);
+    uint64_t zeroUs; // virtual time at which the counter read 0
+    uint64_t alarm;
+    bool autoreload;
+    bool enabled;
+};
+
+static uint64_t clockUs = 0;
+static int64_t epochOffsetUs = (int64_t)SIM_DEFAULT_EPOCH * 1000000;
+static std::vector<esp_timer*> timers;
+static hw_timer_s hwTimers[4];
+static uint8_t outputs[SIM_PIN_COUNT];
+static uint8_t inputs[SIM_PIN_COUNT];
+static uint8_t modes[SIM_PIN_COUNT];
+static void (*pinIsrs[SIM_PIN_COUNT])(void);
+static uint8_t pinIsrModes[SIM_PIN_COUNT];
+static uint32_t writes = 0;
+static uint32_t randomState = 0x2545F491;
+static esp_sleep_wakeup_cause_t wakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+static uint64_t sleepTimerUs = 0;
+static bool serialOutput = true;
+static bool wifiInRange = true;
+static sntp_sync_status_t sntpStatus = SNTP_SYNC_STATUS_RESET;
+static const esp_partition_t historyPartition = {ESP_PARTITION_TYPE_DATA, 0x40, 0x670000, SIM_HISTORY_PARTITION_SIZE, "history"};
+static uint8_t* historyFlash = nullptr; // erased on first use
+
+struct SimTask {
+    TaskFunction_t function;
+    void* arg;
+    const char* name;
+    UBaseType_t priority;
+    uint32_t stackDepth;
+    uint64_t wakeUs;      // UINT64_MAX: until something wakes it
+    bool ioWait;
+    bool notifyWait;
+    uint32_t notifications;
+    SimSemaphore* blockedOn;
+};
+
+struct SimSemaphore {
+    bool held;
+};
+
+// One thread at a time has the turn: the main thread when running is
+// null. Never destroyed, as task threads still wait on them at exit().
+static std::mutex& turnLock = *new std::mutex;
+static std::condition_variable& turnChanged = *new std::condition_variable;
+static SimTask* running = nullptr;
+static thread_local SimTask* currentTask = nullptr;
+static std::vector<SimTask*> tasks;
+
+// A listening socket or one end of a connection; the index is both the
+// firmware's socket number and the client's connection number
+struct SimSocket {
+    bool open;          // firmware side
+    bool peerOpen;      // client side; always for listeners
+    bool listening;
+    bool accepted;
+    int flags;          // fcntl() F_SETFL
+    uint16_t port;
+    int backlog;
+    std::vector<int> pending; // connections not yet accepted
+    std::string toFirmware;
+    std::string toClient;
+    size_t window;
+};
+
+static std::vector<SimSocket> sockets;
+
+static void setOutput(uint8_t pin, int level) {
+    if (pin >= SIM_PIN_COUNT) return;
+    outputs[pin] = level ? HIGH : LOW;
+    writes++;
+}
+
+static uint64_t hwTimerDue(const hw_timer_s& timer) {
+    return timer.zeroUs + timer.alarm * timer.divider / 80;
+}
+
+// Earliest task wake; on a tie the higher priority, then the older task
+static SimTask* nextTask() {
+    SimTask* next = nullptr;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        SimTask* task = tasks[i];
+        if (task->wakeUs == UINT64_MAX) continue;
+        if (!next || task->wakeUs < next->wakeUs || (task->wakeUs == next->wakeUs && task->priority > next->priority)) {
+            next = task;
+        }
+    }
+    return next;
+}
+
+// From the main thread: lets a task run until it blocks again
+static void runTask(SimTask* task) {
+    std::unique_lock<std::mutex> guard(turnLock);
+    running = task;
+    turnChanged.notify_all();
+    turnChanged.wait(guard, [] { return running == nullptr; });
+}
+
+// From a task: hands the turn back to the main thread until wakeUs
+static void yieldTask(uint64_t wakeUs, bool ioWait, SimSemaphore* blockedOn = nullptr, bool notifyWait = false) {
+    SimTask* self = currentTask;
+    std::unique_lock<std::mutex> guard(turnLock);
+    self->wakeUs = max(wakeUs, clockUs + 1); // never again at this instant
+    self->ioWait = ioWait;
+    self->notifyWait = notifyWait;
+    self->blockedOn = blockedOn;
+    running = nullptr;
+    turnChanged.notify_all();
+    turnChanged.wait(guard, [self] { return running == self; });
+    self->ioWait = false;
+    self->notifyWait = false;
+    self->blockedOn = nullptr;
+}
+
+// Socket numbers are reused once both ends have closed, as lwIP does, so
+// they stay below FD_SETSIZE however many connections come and go
+static int newSocket(const SimSocket& socket) {
+    for (size_t i = 0; i < sockets.size(); i++) {
+        if (!sockets[i].open && !sockets[i].peerOpen) {
+            sockets[i] = socket;
+            return i;
+        }
+    }
+    sockets.push_back(socket);
+    return sockets.size() - 1;
+}
+
+static SimSocket* findSocket(int socket) {
+    if (socket < 0 || socket >= (int)sockets.size() || !sockets[socket].open) {
+        errno = EBADF;
+        return nullptr;
+    }
+    return &sockets[socket];
+}
+
+static bool socketReadable(const SimSocket& s) {
+    if (s.listening) return !s.pending.empty();
+    return !s.toFirmware.empty() || !s.peerOpen;
+}
+
+static bool socketWritable(const SimSocket& s) {
+    return !s.listening && (s.toClient.size() < s.window || !s.peerOpen);
+}
+
+// Blocks a blocking call until ready() or the deadline; false if the
+// caller should fail with EAGAIN instead
+static bool waitUntil(const SimSocket* s, int flags, bool (*ready)(const SimSocket&)) {
+    if ((flags & MSG_DONTWAIT) || (s->flags & O_NONBLOCK)) return false;
+    int socket = s - sockets.data();
+    while (!ready(sockets[socket])) {
+        if (currentTask) sim::waitForIo(UINT64_MAX);
+        else sim::advance(1000);
+    }
+    return true;
+}
+
+static void taskThread(SimTask* task) {
+    currentTask = task;
+    {
+        std::unique_lock<std::mutex> guard(turnLock);
+        turnChanged.wait(guard, [task] { return running == task; });
+    }
+    task->function(task->arg);
+    // A FreeRTOS task must not return; treat it as deleting itself
+    std::unique_lock<std::mutex> guard(turnLock);
+    task->wakeUs = UINT64_MAX;
+    running = nullptr;
+    turnChanged.notify_all();
+}
+
+namespace sim {
+
+uint64_t nowUs() {
+    return clockUs;
+}
+
+void setEpoch(time_t epoch) {
+    epochOffsetUs = (int64_t)epoch * 1000000 - (int64_t)clockUs;
+}
+
+uint64_t nextTimerUs() {
+    uint64_t next = UINT64_MAX;
+    for (size_t i = 0; i < timers.size(); i++) {
+        if (timers[i]->armed) next = min(next, timers[i]->dueUs);
+    }
+    for (int i = 0; i < 4; i++) {
+        if (hwTimers[i].enabled && hwTimers[i].isr) next = min(next, hwTimerDue(hwTimers[i]));
+    }
+    return next == UINT64_MAX ? next : (next > clockUs ? next - clockUs : 0);
+}
+
+void advance(uint64_t us) {
+    uint64_t target = clockUs + us;
+    for (;;) {
+        // Timers first when both are due at the same time
+        uint64_t wait = nextTimerUs();
+        uint64_t timerDue = wait == UINT64_MAX ? UINT64_MAX : clockUs + wait;
+        SimTask* task = nextTask();
+        if (task && task->wakeUs <= target && task->wakeUs < timerDue) {
+            clockUs = max(clockUs, task->wakeUs);
+            runTask(task);
+            continue;
+        }
+        if (timerDue > target) break;
+        clockUs = timerDue;
+
+        // Fire one timer at a time; a callback may re-arm or stop others
+        for (int i = 0; i < 4; i++) {
+            hw_timer_s& timer = hwTimers[i];
+            if (!timer.enabled || !timer.isr || hwTimerDue(timer) > clockUs) continue;
+            if (timer.autoreload) timer.zeroUs = clockUs;
+            else timer.enabled = false;
+            timer.isr();
+            goto fired;
+        }
+        for (size_t i = 0; i < timers.size(); i++) {
+            esp_timer* timer = timers[i];
+            if (!timer->armed || timer->dueUs > clockUs) continue;
+            if (timer->periodUs) timer->dueUs += timer->periodUs;
+            else timer->armed = false;
+            timer->callback(timer->arg);
+            break;
+        }
+    fired:;
+    }
+    clockUs = target;
+}
+
+void setInput(uint8_t pin, int level) {
+    if (pin >= SIM_PIN_COUNT) return;
+    level = level ? HIGH : LOW;
+    bool rising = inputs[pin] == LOW && level == HIGH;
+    bool falling = inputs[pin] == HIGH && level == LOW;
+    inputs[pin] = level;
+    if (pinIsrs[pin] && ((rising && (pinIsrModes[pin] & RISING)) || (falling && (pinIsrModes[pin] & FALLING)))) {
+        pinIsrs[pin]();
+    }
+}
+
+int outputLevel(uint8_t pin) {
+    return pin < SIM_PIN_COUNT ? outputs[pin] : LOW;
+}
+
+uint32_t pinWrites() {
+    return writes;
+}
+
+void setWiFiAvailable(bool available) {
+    wifiInRange = available;
+}
+
+bool wifiAvailable() {
+    return wifiInRange;
+}
+
+void waitForIo(uint64_t us) {
+    yieldTask(us == UINT64_MAX ? UINT64_MAX : clockUs + us, true);
+}
+
+bool inTask() {
+    return currentTask != nullptr;
+}
+
+void notifyIo() {
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (tasks[i]->ioWait) tasks[i]->wakeUs = clockUs;
+    }
+}
+
+int connect(uint16_t port) {
+    for (size_t i = 0; i < sockets.size(); i++) {
+        SimSocket& listener = sockets[i];
+        if (!listener.open || !listener.listening || listener.port != port) continue;
+        if ((int)listener.pending.size() >= listener.backlog) return -1;
+        int connection = newSocket({true, true, false, false, 0, port, 0, std::vector<int>(), std::string(), std::string(), SIZE_MAX});
+        sockets[i].pending.push_back(connection);
+        notifyIo();
+        return connection;
+    }
+    return -1;
+}
+
+void clientWrite(int connection, const std::string& data) {
+    if (!clientConnected(connection)) return;
+    sockets[connection].toFirmware += data;
+    notifyIo();
+}
+
+std::string clientRead(int connection) {
+    std::string received;
+    if (connection < 0 || connection >= (int)sockets.size()) return received;
+    received.swap(sockets[connection].toClient);
+    notifyIo(); // the firmware may write again
+    return received;
+}
+
+bool clientConnected(int connection) {
+    return connection >= 0 && connection < (int)sockets.size() && !sockets[connection].listening &&
+           sockets[connection].open && sockets[connection].peerOpen;
+}
+
+int connectionCount() {
+    return sockets.size();
+}
+
+void setReceiveWindow(int connection, size_t bytes) {
+    if (connection >= 0 && connection < (int)sockets.size()) sockets[connection].window = bytes;
+}
+
+void hangUp(int connection) {
+    for (size_t i = 0; i < sockets.size(); i++) {
+        if (!sockets[i].listening && (connection < 0 || (int)i == connection)) sockets[i].peerOpen = false;
+    }
+    notifyIo();
+}
+
+void setSerialEnabled(bool enabled) {
+    serialOutput = enabled;
+}
+
+bool serialEnabled() {
+    return serialOutput;
+}
+
+}
+
+// Wall clock: linked in place of the C library's with -Wl,--wrap
+extern "C" time_t __wrap_time(time_t* out) {
+    time_t now = (time_t)((epochOffsetUs + (int64_t)clockUs) / 1000000);
+    if (out) *out = now;
+    return now;
+}
+
+extern "C" int __wrap_gettimeofday(struct timeval* tv, void* tz) {
+    int64_t now = epochOffsetUs + (int64_t)clockUs;
+    tv->tv_sec = now / 1000000;
+    tv->tv_usec = now % 1000000;
+    return 0;
+}
+
+extern "C" int __wrap_settimeofday(const struct timeval* tv, const void* tz) {
+    epochOffsetUs = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - (int64_t)clockUs;
+    return 0;
+}
+
+// Heap: the firmware's malloc() family is linked to these with -Wl,--wrap.
+// The bytes come from the host, but each block also gets a place in a
+// model of the device's heap, first fit with the allocator's overhead, so
+// free space and the largest free block move as they would on the device
+// and a request that does not fit there fails as it would.
+struct SimHeap {
+    std::map<size_t, size_t> blocks;           // offset -> size, overhead included
+    std::unordered_map<void*, size_t> offsets; // host pointer -> offset
+    size_t used = 0;
+    size_t peakUsed = 0;
+    uint64_t allocations = 0;
+};
+
+// Also used before main(), by constructors of globals, so made on first use
+static std::mutex& heapLock() {
+    static std::mutex* lock = new std::mutex;
+    return *lock;
+}
+
+static SimHeap& heapModel() {
+    static SimHeap* model = new SimHeap;
+    return *model;
+}
+
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __real_realloc(void* block, size_t size);
+extern "C" void __real_free(void* block);
+
+// Offset of the first gap that fits size, or SIM_HEAP_BYTES if none does
+static size_t heapFit(size_t size) {
+    SimHeap& heap = heapModel();
+    size_t at = 0;
+    for (auto& block : heap.blocks) {
+        if (block.first - at >= size) return at;
+        at = block.first + block.second;
+    }
+    return SIM_HEAP_BYTES - at >= size ? at : SIM_HEAP_BYTES;
+}
+
+static size_t heapBlockSize(size_t size) {
+    return (size + SIM_HEAP_BLOCK_OVERHEAD + SIM_HEAP_ALIGN - 1) / SIM_HEAP_ALIGN * SIM_HEAP_ALIGN;
+}
+
+// Places a block for host memory the caller then allocates; false if the
+// device heap has no room
+static bool heapPlace(size_t size, size_t& offset) {
+    SimHeap& heap = heapModel();
+    size = heapBlockSize(size);
+    offset = heapFit(size);
+    if (offset == SIM_HEAP_BYTES) return false;
+    heap.blocks[offset] = size;
+    heap.used += size;
+    heap.peakUsed = max(heap.peakUsed, heap.used);
+    heap.allocations++;
+    return true;
+}
+
+static void heapRelease(void* block) {
+    SimHeap& heap = heapModel();
+    auto found = heap.offsets.find(block);
+    if (found == heap.offsets.end()) return; // from the C library itself
+    auto placed = heap.blocks.find(found->second);
+    heap.used -= placed->second;
+    heap.blocks.erase(placed);
+    heap.offsets.erase(found);
+}
+
+extern "C" void* __wrap_malloc(size_t size) {
+    SimHeap& heap = heapModel();
+    std::lock_guard<std::mutex> hold(heapLock());
+    size_t offset;
+    if (!heapPlace(size, offset)) return nullptr;
+    void* block = __real_malloc(size ? size : 1);
+    heap.offsets[block] = offset;
+    return block;
+}
+
+extern "C" void* __wrap_calloc(size_t count, size_t size) {
+    void* block = __wrap_malloc(count * size);
+    if (block) memset(block, 0, count * size);
+    return block;
+}
+
+extern "C" void __wrap_free(void* block) {
+    if (!block) return;
+    {
+        std::lock_guard<std::mutex> hold(heapLock());
+        heapRelease(block);
+    }
+    __real_free(block);
+}
+
+// Moves the block in the model like the device's realloc(): in place if
+// the space after it is free, else to a new place
+extern "C" void* __wrap_realloc(void* block, size_t size) {
+    SimHeap& heap = heapModel();
+    if (!block) return __wrap_malloc(size);
+    std::lock_guard<std::mutex> hold(heapLock());
+    auto found = heap.offsets.find(block);
+    if (found == heap.offsets.end()) return __real_realloc(block, size);
+    size_t offset = found->second;
+    size_t oldSize = heap.blocks[offset];
+    heap.used -= oldSize;
+    heap.blocks.erase(offset);
+    size_t grown = heapBlockSize(size);
+    auto next = heap.blocks.lower_bound(offset);
+    size_t room = (next == heap.blocks.end() ? SIM_HEAP_BYTES : next->first) - offset;
+    if (grown > room) {
+        size_t moved;
+        if (!heapPlace(size, moved)) {
+            heap.blocks[offset] = oldSize; // the old block stays valid
+            heap.used += oldSize;
+            return nullptr;
+        }
+        offset = moved;
+    } else {
+        heap.blocks[offset] = grown;
+        heap.used += grown;
+        heap.peakUsed = max(heap.peakUsed, heap.used);
+    }
+    void* resized = __real_realloc(block, size ? size : 1);
+    heap.offsets.erase(block);
+    heap.offsets[resized] = offset;
+    return resized;
+}
+
+namespace sim {
+
+HeapStats heapStats() {
+    SimHeap& heap = heapModel();
+    std::lock_guard<std::mutex> hold(heapLock());
+    HeapStats stats;
+    size_t at = 0;
+    size_t largest = 0;
+    for (auto& block : heap.blocks) {
+        largest = max(largest, block.first - at);
+        at = block.first + block.second;
+    }
+    largest = max(largest, (size_t)SIM_HEAP_BYTES - at);
+    stats.freeBytes = SIM_HEAP_BYTES - heap.used;
+    stats.minFreeBytes = SIM_HEAP_BYTES - heap.peakUsed;
+    stats.largestFreeBlock = largest > SIM_HEAP_BLOCK_OVERHEAD ? largest - SIM_HEAP_BLOCK_OVERHEAD : 0;
+    stats.blocks = heap.blocks.size();
+    stats.allocations = heap.allocations;
+    return stats;
+}
+
+}
+
+extern "C" __attribute__((weak)) void sntp_sync_time(struct timeval* tv) {
+    settimeofday(tv, nullptr);
+    sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+}
+
+extern "C" void sntp_set_sync_status(sntp_sync_status_t status) {
+    sntpStatus = status;
+}
+
+extern "C" sntp_sync_status_t sntp_get_sync_status() {
+    return sntpStatus;
+}
+
+extern "C" int lwip_socket(int domain, int type, int protocol) {
+    return newSocket({true, true, false, false, 0, 0, 0, std::vector<int>(), std::string(), std::string(), SIZE_MAX});
+}
+
+extern "C" int lwip_bind(int socket, const struct sockaddr* address, socklen_t length) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    uint16_t port = ntohs(((const struct sockaddr_in*)address)->sin_port);
+    for (size_t i = 0; i < sockets.size(); i++) {
+        if (sockets[i].open && sockets[i].listening && sockets[i].port == port) {
+            errno = EADDRINUSE;
+            return -1;
+        }
+    }
+    s->port = port;
+    return 0;
+}
+
+extern "C" int lwip_listen(int socket, int backlog) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    s->listening = true;
+    s->backlog = max(backlog, 1);
+    return 0;
+}
+
+extern "C" int lwip_accept(int socket, struct sockaddr* address, socklen_t* length) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    if (!s->listening) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (s->pending.empty() && !waitUntil(s, 0, socketReadable)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    s = &sockets[socket];
+    int connection = s->pending.front();
+    s->pending.erase(s->pending.begin());
+    sockets[connection].accepted = true;
+    return connection;
+}
+
+extern "C" ssize_t lwip_recv(int socket, void* data, size_t size, int flags) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    if (!socketReadable(*s) && !waitUntil(s, flags, socketReadable)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    s = &sockets[socket];
+    size_t length = min(size, s->toFirmware.size());
+    memcpy(data, s->toFirmware.data(), length);
+    if (!(flags & MSG_PEEK)) s->toFirmware.erase(0, length);
+    return length; // 0 once the peer closed and everything was read
+}
+
+extern "C" ssize_t lwip_send(int socket, const void* data, size_t size, int flags) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    if (!socketWritable(*s) && !waitUntil(s, flags, socketWritable)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    s = &sockets[socket];
+    if (!s->peerOpen) {
+        errno = EPIPE;
+        return -1;
+    }
+    size_t length = min(size, s->window - s->toClient.size());
+    s->toClient.append((const char*)data, length);
+    return length;
+}
+
+extern "C" int lwip_close(int socket) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    s->open = false;
+    s->toFirmware.clear();
+    // Connections a listener never accepted are refused
+    for (size_t i = 0; i < s->pending.size(); i++) sockets[s->pending[i]].open = false;
+    s->pending.clear();
+    return 0;
+}
+
+extern "C" int lwip_select(int count, fd_set* readable, fd_set* writable, fd_set* failed, struct timeval* timeout) {
+    uint64_t deadline = timeout ? clockUs + (uint64_t)timeout->tv_sec * 1000000 + timeout->tv_usec : UINT64_MAX;
+    fd_set wantRead, wantWrite;
+    FD_ZERO(&wantRead);
+    FD_ZERO(&wantWrite);
+    if (readable) wantRead = *readable;
+    if (writable) wantWrite = *writable;
+    if (failed) FD_ZERO(failed);
+
+    for (;;) {
+        int ready = 0;
+        if (readable) FD_ZERO(readable);
+        if (writable) FD_ZERO(writable);
+        for (int socket = 0; socket < count; socket++) {
+            bool wantsRead = FD_ISSET(socket, &wantRead);
+            bool wantsWrite = FD_ISSET(socket, &wantWrite);
+            if (!wantsRead && !wantsWrite) continue;
+            SimSocket* s = findSocket(socket);
+            if (!s) return -1;
+            if (wantsRead && socketReadable(*s)) {
+                FD_SET(socket, readable);
+                ready++;
+            }
+            if (wantsWrite && socketWritable(*s)) {
+                FD_SET(socket, writable);
+                ready++;
+            }
+        }
+        if (ready > 0 || clockUs >= deadline) return ready;
+        if (currentTask) sim::waitForIo(deadline == UINT64_MAX ? UINT64_MAX : deadline - clockUs);
+        else sim::advance(deadline == UINT64_MAX ? 1000 : deadline - clockUs);
+    }
+}
+
+extern "C" int lwip_fcntl(int socket, int command, int value) {
+    SimSocket* s = findSocket(socket);
+    if (!s) return -1;
+    if (command == F_GETFL) return s->flags;
+    if (command == F_SETFL) {
+        s->flags = value;
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+extern "C" int lwip_setsockopt(int socket, int level, int option, const void* value, socklen_t length) {
+    return findSocket(socket) ? 0 : -1;
+}
+
+unsigned long millis() {
+    return (unsigned long)(clockUs / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)clockUs;
+}
+
+void delay(unsigned long ms) {
+    if (currentTask) yieldTask(clockUs + (uint64_t)ms * 1000, false);
+    else sim::advance((uint64_t)ms * 1000);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    SimTask* task = new SimTask{function, arg, name, priority, stackDepth, clockUs, false, false, 0, nullptr};
+    tasks.push_back(task);
+    std::thread(taskThread, task).detach();
+    if (handle) *handle = task;
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks * portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return currentTask;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (!task) task = currentTask;
+    return task ? task->stackDepth : 8192; // the main thread stands in for Arduino's loopTask
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+    SimTask* self = currentTask;
+    if (!self) return 0;
+    if (self->notifications == 0 && ticks > 0) {
+        yieldTask(ticks == portMAX_DELAY ? UINT64_MAX : clockUs + (uint64_t)ticks * portTICK_PERIOD_MS * 1000,
+                  false, nullptr, true);
+    }
+    uint32_t taken = self->notifications;
+    if (taken > 0) self->notifications = clearOnExit ? 0 : taken - 1;
+    return taken;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notifications++;
+    if (task->notifyWait) task->wakeUs = min(task->wakeUs, clockUs);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+    xTaskNotifyGive(task);
+    if (higherPriorityTaskWoken) *higherPriorityTaskWoken = pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new SimSemaphore{false};
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    uint64_t deadline = ticks == portMAX_DELAY ? UINT64_MAX : clockUs + (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+    while (semaphore->held) {
+        if (clockUs >= deadline) return pdFALSE;
+        if (currentTask) yieldTask(deadline, false, semaphore);
+        else sim::advance(1000); // the holder is a task; let it run
+    }
+    semaphore->held = true;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    if (!semaphore->held) return pdFALSE;
+    semaphore->held = false;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        if (tasks[i]->blockedOn == semaphore) tasks[i]->wakeUs = min(tasks[i]->wakeUs, clockUs);
+    }
+    return pdTRUE;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin >= SIM_PIN_COUNT) return;
+    modes[pin] = mode;
+    if (mode == INPUT_PULLUP) inputs[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+    setOutput(pin, level);
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+    if (pin >= SIM_PIN_COUNT) return;
+    pinIsrs[pin] = isr;
+    pinIsrModes[pin] = mode;
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (pin < SIM_PIN_COUNT) pinIsrs[pin] = nullptr;
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin >= SIM_PIN_COUNT) return LOW;
+    return modes[pin] == OUTPUT ? outputs[pin] : inputs[pin];
+}
+
+GpioSetRegister& GpioSetRegister::operator=(uint32_t mask) {
+    for (uint8_t pin = 0; pin < 32; pin++) {
+        if (mask & (1UL << pin)) setOutput(pin, HIGH);
+    }
+    return *this;
+}
+
+GpioClearRegister& GpioClearRegister::operator=(uint32_t mask) {
+    for (uint8_t pin = 0; pin < 32; pin++) {
+        if (mask & (1UL << pin)) setOutput(pin, LOW);
+    }
+    return *this;
+}
+
+// Deterministic, so runs are repeatable
+uint32_t esp_random() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+bool psramFound() {
+    return false;
+}
+
+void* ps_malloc(size_t size) {
+    return malloc(size);
+}
+
+bool getLocalTime(struct tm* info, uint32_t ms) {
+    time_t now = time(nullptr);
+    if (now < 1451606400) return false; // not synced: before 2016 like the core checks
+    localtime_r(&now, info);
+    return true;
+}
+
+void configTime(long gmtOffsetSec, int daylightOffsetSec, const char* server1, const char* server2, const char* server3) {
+    // The virtual clock counts as synced from the start
+}
+
+void EspClass::restart() {
+    printf("[sim] ESP.restart() at %llu us, ending simulation\n", (unsigned long long)clockUs);
+    fflush(stdout);
+    exit(0);
+}
+
+uint32_t EspClass::getFreeHeap() {
+    return sim::heapStats().freeBytes;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    return sim::heapStats().minFreeBytes;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+    return sim::heapStats().largestFreeBlock;
+}
+
+uint32_t EspClass::getCycleCount() {
+    auto host = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint32_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(host).count() * getCpuFreqMHz() / 1000);
+}
+
+hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp) {
+    if (num >= 4) return nullptr;
+    hwTimers[num] = {divider, nullptr, clockUs, 0, false, false};
+    return &hwTimers[num];
+}
+
+void timerAttachInterrupt(hw_timer_t* timer, void (*isr)(void), bool edge) {
+    timer->isr = isr;
+}
+
+void timerAlarmWrite(hw_timer_t* timer, uint64_t alarmValue, bool autoreload) {
+    timer->alarm = alarmValue;
+    timer->autoreload = autoreload;
+}
+
+void timerAlarmEnable(hw_timer_t* timer) {
+    timer->enabled = true;
+}
+
+void timerAlarmDisable(hw_timer_t* timer) {
+    timer->enabled = false;
+}
+
+void timerWrite(hw_timer_t* timer, uint64_t value) {
+    timer->zeroUs = clockUs - value * timer->divider / 80;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    esp_timer* timer = new esp_timer{args->callback, args->arg, args->name, false, 0, 0};
+    timers.push_back(timer);
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+    if (timer->armed) return ESP_ERR_INVALID_STATE;
+    timer->armed = true;
+    timer->dueUs = clockUs + timeoutUs;
+    timer->periodUs = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+    if (timer->armed) return ESP_ERR_INVALID_STATE;
+    timer->armed = true;
+    timer->dueUs = clockUs + periodUs;
+    timer->periodUs = periodUs;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed) return ESP_ERR_INVALID_STATE;
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    for (size_t i = 0; i < timers.size(); i++) {
+        if (timers[i] == timer) timers.erase(timers.begin() + i);
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() {
+    return (int64_t)clockUs;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t type) { return ESP_OK; }
+esp_err_t gpio_wakeup_disable(gpio_num_t pin) { return ESP_OK; }
+esp_err_t gpio_hold_en(gpio_num_t pin) { return ESP_OK; }
+esp_err_t gpio_hold_dis(gpio_num_t pin) { return ESP_OK; }
+void gpio_deep_sleep_hold_en() {}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+    return wakeCause;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+    sleepTimerUs = timeUs;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t pin, int level) { return ESP_OK; }
+esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
+
+esp_err_t esp_light_sleep_start() {
+    sim::advance(sleepTimerUs);
+    wakeCause = ESP_SLEEP_WAKEUP_TIMER;
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label) {
+    if (type != historyPartition.type || subtype != historyPartition.subtype) return nullptr;
+    if (label && strcmp(label, historyPartition.label) != 0) return nullptr;
+    if (!historyFlash) {
+        historyFlash = new uint8_t[historyPartition.size];
+        memset(historyFlash, 0xFF, historyPartition.size);
+    }
+    return &historyPartition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (partition != &historyPartition || offset + size > partition->size) return ESP_ERR_INVALID_ARG;
+    memcpy(dst, historyFlash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    if (partition != &historyPartition || offset + size > partition->size) return ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; i < size; i++) {
+        historyFlash[offset + i] &= ((const uint8_t*)src)[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (partition != &historyPartition || offset % 4096 || size % 4096 || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(historyFlash + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+void esp_deep_sleep_start() {
+    printf("[sim] deep sleep for %llu us at %llu us, ending simulation\n",
+           (unsigned long long)sleepTimerUs, (unsigned long long)clockUs);
+    fflush(stdout);
+    exit(0);
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    static std::map<std::string, Namespace> namespaces;
+    entries = &namespaces[name];
+    return true;
+}
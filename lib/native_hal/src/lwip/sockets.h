@@ -0,0 +1,32 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// lwIP's socket API on the simulated network (see sim::connect()). Socket
+// numbers are the connection numbers the simulated clients use. Calls that
+// would block hand the turn to other tasks on the virtual clock, or fail
+// with EAGAIN on a non-blocking socket or with MSG_DONTWAIT.
+int lwip_socket(int domain, int type, int protocol);
+int lwip_bind(int socket, const struct sockaddr* address, socklen_t length);
+int lwip_listen(int socket, int backlog);
+int lwip_accept(int socket, struct sockaddr* address, socklen_t* length);
+ssize_t lwip_recv(int socket, void* data, size_t size, int flags);
+ssize_t lwip_send(int socket, const void* data, size_t size, int flags);
+int lwip_close(int socket);
+int lwip_select(int count, fd_set* readable, fd_set* writable, fd_set* failed, struct timeval* timeout);
+int lwip_fcntl(int socket, int command, int value);
+int lwip_setsockopt(int socket, int level, int option, const void* value, socklen_t length);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+// Virtual clock and pin state behind the native HAL. Nothing advances on
+// its own: delay(), sleeps and sim::advance() move the clock forward and
+// fire esp_timer callbacks and hardware timer alarms in due order.
+namespace sim {
+
+// Microseconds since the simulated boot, as esp_timer_get_time() sees them
+uint64_t nowUs();
+
+// Sets the wall clock (time(), gettimeofday()) for the current instant
+void setEpoch(time_t epoch);
+
+// Moves the clock forward, running every timer that falls due on the way
+void advance(uint64_t us);
+
+// Microseconds until the next armed timer, or UINT64_MAX if none
+uint64_t nextTimerUs();
+
+// Level digitalRead() returns for an input, e.g. LOW for a pressed button
+void setInput(uint8_t pin, int level);
+
+// Level last driven on an output by digitalWrite() or GPIO.out_w1tc
+int outputLevel(uint8_t pin);
+
+// Number of digitalWrite() and GPIO register writes so far
+uint32_t pinWrites();
+
+// Whether the configured WiFi network is in range (default true)
+void setWiFiAvailable(bool available);
+bool wifiAvailable();
+
+// Simulated TCP, as a browser on the other end sees it. connect() opens
+// a connection to a listening port, returning its number or -1 if the
+// backlog is full; the firmware's tasks are woken by what the client does.
+// Connection numbers are below connectionCount() and are reused once the
+// firmware has closed the connection and the client has hung up.
+int connect(uint16_t port);
+void clientWrite(int connection, const std::string& data);
+std::string clientRead(int connection); // drains what the firmware sent
+bool clientConnected(int connection);   // false once the firmware closed it
+int connectionCount();
+
+// At most this many unread bytes before the firmware's sends would block,
+// like a client that stops reading (default: no limit)
+void setReceiveWindow(int connection, size_t bytes);
+
+// The peer closes a connection, or all with -1, like a browser tab going away
+void hangUp(int connection);
+
+// For code running in a task: sleeps until the clock reaches us from now
+// or a client does something, whichever comes first
+void waitForIo(uint64_t us);
+bool inTask();
+
+// Wakes every task in waitForIo(); the simulated network calls it
+void notifyIo();
+
+// The firmware's heap as laid out on the device: every malloc(), also
+// String's, is placed first fit in a heap of the device's free size. Also
+// behind ESP.getFreeHeap(), getMinFreeHeap() and getMaxAllocHeap().
+struct HeapStats {
+    size_t freeBytes;
+    size_t minFreeBytes;
+    size_t largestFreeBlock; // the largest malloc() that would succeed
+    size_t blocks;
+    uint64_t allocations;    // since boot
+};
+HeapStats heapStats();
+
+// Serial output on or off, e.g. to keep long runs quiet
+void setSerialEnabled(bool enabled);
+bool serialEnabled();
+
+}
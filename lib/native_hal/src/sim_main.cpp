@@ -0,0 +1,226 @@
+// Entry point of the native build: runs the firmware's setup() and loop()
+// on the virtual clock, driven by command line steps taken in order:
+//
+//   --epoch SECONDS       set the wall clock (before setup: the boot time)
+//   --run SECONDS         run loop() for this much virtual time
+//   --get TARGET          GET /path?query on port 80 and print the response
+//   --post TARGET         POST the form fields in the query as a form body
+//   --press PIN:MS        hold an input low for MS while running loop()
+//   --upload TARGET:BYTES stream a dummy image through an upload route
+//   --wifi on|off         put the WiFi network in or out of range
+//   --ntp OFFSET_MS       an SNTP reply OFFSET_MS ahead of the simulated clock
+//   --hangup CONN|all     the peer closes a connection a handler kept open
+//
+// Each request is a browser connection on the simulated network, served by
+// the firmware's HTTP task while loop() runs until the response is in.
+// What the firmware writes to kept connections, e.g. /events, is printed
+// after each step.
+//
+// Without steps it runs one virtual day. Programs with their own main(),
+// like tools/schedule_sim, build with -DSIM_NO_MAIN.
+
+#ifndef SIM_NO_MAIN
+
+#include <Arduino.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+
+#define SIM_POLL_US 10000
+#define SIM_RESPONSE_TIMEOUT_US 60000000ULL
+
+void setup();
+void loop();
+
+static void runFor(uint64_t us) {
+    uint64_t end = sim::nowUs() + us;
+    while (sim::nowUs() < end) {
+        uint64_t before = sim::nowUs();
+        loop();
+        if (sim::nowUs() == before) sim::advance(1000); // loop() without delay()
+    }
+}
+
+// End of the chunked body that starts at from, 0 while it is incomplete
+static size_t chunkedEnd(const std::string& received, size_t from) {
+    for (;;) {
+        size_t lineEnd = received.find("\r\n", from);
+        if (lineEnd == std::string::npos) return 0;
+        size_t size = strtoul(received.c_str() + from, nullptr, 16);
+        from = lineEnd + 2 + size + 2;
+        if (from > received.size()) return 0;
+        if (size == 0) return from;
+    }
+}
+
+// Chunks of a chunked body put back together
+static std::string dechunk(const std::string& body) {
+    std::string joined;
+    size_t at = 0;
+    for (;;) {
+        size_t lineEnd = body.find("\r\n", at);
+        if (lineEnd == std::string::npos) return joined;
+        size_t size = strtoul(body.c_str() + at, nullptr, 16);
+        if (size == 0) return joined;
+        joined += body.substr(lineEnd + 2, size);
+        at = lineEnd + 2 + size + 2;
+    }
+}
+
+// Waits, running loop(), until the firmware answered a request on the
+// connection: a response with its Content-Length or all its chunks in
+// full, one with neither (a stream it keeps open), or a closed connection
+static std::string awaitResponse(int connection) {
+    std::string received;
+    uint64_t end = sim::nowUs() + SIM_RESPONSE_TIMEOUT_US;
+    while (sim::nowUs() < end) {
+        received += sim::clientRead(connection);
+        size_t headEnd = received.find("\r\n\r\n");
+        if (headEnd != std::string::npos && received.compare(0, 12, "HTTP/1.1 100") == 0) {
+            received.erase(0, headEnd + 4);
+            continue;
+        }
+        if (headEnd != std::string::npos) {
+            const char* chunked = strcasestr(received.c_str(), "\r\nTransfer-Encoding: chunked");
+            if (chunked && chunked < received.c_str() + headEnd) {
+                if (chunkedEnd(received, headEnd + 4) > 0) break;
+                if (!sim::clientConnected(connection)) break;
+                runFor(SIM_POLL_US);
+                continue;
+            }
+            const char* length = strcasestr(received.c_str(), "\r\nContent-Length:");
+            if (!length || length > received.c_str() + headEnd) break;
+            if (received.size() >= headEnd + 4 + strtoul(length + 17, nullptr, 10)) break;
+        }
+        if (!sim::clientConnected(connection)) break;
+        runFor(SIM_POLL_US);
+    }
+    return received + sim::clientRead(connection);
+}
+
+static std::string headerValue(const std::string& head, const char* name) {
+    std::string key = std::string("\r\n") + name + ":";
+    const char* found = strcasestr(head.c_str(), key.c_str());
+    if (!found) return std::string();
+    found += key.size();
+    while (*found == ' ') found++;
+    return std::string(found, strcspn(found, "\r"));
+}
+
+static void printResponse(const char* method, const std::string& target, int connection, const std::string& response) {
+    size_t headEnd = response.find("\r\n\r\n");
+    if (connection < 0 || headEnd == std::string::npos) {
+        printf("[sim] %s %s -> no response\n", method, target.c_str());
+        return;
+    }
+    std::string head = response.substr(0, headEnd);
+    std::string body = response.substr(headEnd + 4);
+    bool chunked = headerValue(head, "Transfer-Encoding") == "chunked";
+    if (chunked) body = dechunk(body);
+    if (headerValue(head, "Content-Length").empty() && !chunked) {
+        printf("[sim] %s %s -> answered on connection %d\n", method, target.c_str(), connection);
+        printf("[sim] connection %d <-\n%s", connection, response.c_str());
+        return;
+    }
+    printf("[sim] %s %s -> %d %s, %u bytes\n", method, target.c_str(), atoi(head.c_str() + 9),
+           headerValue(head, "Content-Type").c_str(), (unsigned)body.size());
+    if (headerValue(head, "Content-Encoding") == "gzip") return;
+    if (!body.empty()) printf("%s\n", body.c_str());
+}
+
+// A browser's request on a new connection. POST form fields come from the
+// query and go out as a urlencoded body.
+static void request(const char* method, const char* target) {
+    std::string path(target);
+    std::string body;
+    size_t query = path.find('?');
+    if (strcmp(method, "POST") == 0 && query != std::string::npos) {
+        body = path.substr(query + 1);
+        path = path.substr(0, query);
+    }
+    char head[512];
+    snprintf(head, sizeof(head),
+             "%s %s HTTP/1.1\r\nHost: henny.local\r\nConnection: close\r\n"
+             "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %u\r\n\r\n",
+             method, path.c_str(), (unsigned)body.size());
+    int connection = sim::connect(80);
+    sim::clientWrite(connection, head + body);
+    printResponse(method, target, connection, awaitResponse(connection));
+}
+
+// Streams a dummy firmware image as a browser's form upload would
+static void upload(const char* target, size_t length) {
+    static const char boundary[] = "----HennySimBoundary";
+    std::string start = std::string("--") + boundary +
+                        "\r\nContent-Disposition: form-data; name=\"update\"; filename=\"firmware.bin\"\r\n"
+                        "Content-Type: application/octet-stream\r\n\r\n";
+    std::string finish = std::string("\r\n--") + boundary + "--\r\n";
+    char head[512];
+    snprintf(head, sizeof(head),
+             "POST %s HTTP/1.1\r\nHost: henny.local\r\nConnection: close\r\n"
+             "Content-Type: multipart/form-data; boundary=%s\r\nContent-Length: %u\r\n\r\n",
+             target, boundary, (unsigned)(start.size() + length + finish.size()));
+    int connection = sim::connect(80);
+    sim::clientWrite(connection, head + start + std::string(length, '\xE9') + finish);
+    printResponse("POST", target, connection, awaitResponse(connection));
+}
+
+static void printSent() {
+    for (int connection = 0; connection < sim::connectionCount(); connection++) {
+        std::string sent = sim::clientRead(connection);
+        if (!sent.empty()) printf("[sim] connection %d <-\n%s", connection, sent.c_str());
+    }
+}
+
+int main(int argc, char** argv) {
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "--epoch") == 0) {
+        sim::setEpoch((time_t)atoll(argv[2]));
+        first = 3;
+    }
+
+    setup();
+    if (first >= argc) runFor(86400ULL * 1000000);
+
+    for (int i = first; i + 1 < argc; i += 2) {
+        const char* option = argv[i];
+        const char* value = argv[i + 1];
+        if (strcmp(option, "--epoch") == 0) {
+            sim::setEpoch((time_t)atoll(value));
+        } else if (strcmp(option, "--run") == 0) {
+            runFor((uint64_t)(atof(value) * 1000000));
+        } else if (strcmp(option, "--get") == 0) {
+            request("GET", value);
+        } else if (strcmp(option, "--post") == 0) {
+            request("POST", value);
+        } else if (strcmp(option, "--press") == 0) {
+            uint8_t pin = atoi(value);
+            const char* duration = strchr(value, ':');
+            sim::setInput(pin, LOW);
+            runFor((uint64_t)(duration ? atol(duration + 1) : 100) * 1000);
+            sim::setInput(pin, HIGH);
+        } else if (strcmp(option, "--upload") == 0) {
+            std::string target(value);
+            size_t colon = target.rfind(':');
+            size_t length = colon == std::string::npos ? 4096 : atol(target.c_str() + colon + 1);
+            upload(target.substr(0, colon).c_str(), length);
+        } else if (strcmp(option, "--ntp") == 0) {
+            struct timeval tv;
+            gettimeofday(&tv, nullptr);
+            int64_t us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec + (int64_t)(atof(value) * 1000);
+            tv.tv_sec = us / 1000000;
+            tv.tv_usec = us % 1000000;
+            sntp_sync_time(&tv);
+        } else if (strcmp(option, "--hangup") == 0) {
+            sim::hangUp(strcmp(value, "all") == 0 ? -1 : atoi(value));
+        } else if (strcmp(option, "--wifi") == 0) {
+            sim::setWiFiAvailable(strcmp(value, "off") != 0);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", option);
+            return 2;
+        }
+        printSent();
+    }
+    return 0;
+}
+
+#endif
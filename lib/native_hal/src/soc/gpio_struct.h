@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// Write-one-to-set/clear registers act on the simulated output levels
+struct GpioSetRegister {
+    GpioSetRegister& operator=(uint32_t mask);
+};
+
+struct GpioClearRegister {
+    GpioClearRegister& operator=(uint32_t mask);
+};
+
+typedef struct {
+    GpioSetRegister out_w1ts;
+    GpioClearRegister out_w1tc;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
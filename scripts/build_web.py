@@ -0,0 +1,273 @@
+"""Compile the web UI in web/ into flash-resident C++ tables.
+
+Runs as a PlatformIO pre-build script (see extra_scripts in platformio.ini)
+and can also be invoked directly: `python3 scripts/build_web.py`.
+
+Pages are static: every {PLACEHOLDER} is resolved here, once per language
+from web/i18n.json, and the result is gzip-compressed with a content-hash
+ETag. Live values are fetched by the page from /api/status.
+
+web/i18n.json is the single source for all UI text: {SOME_KEY} in markup
+and lang.someKey in page scripts both refer to its "some_key" entry, and
+the firmware gets the same table as a Language x TextId array in flash
+(src/generated/i18n_table.h).
+
+Styling needs no internet access: the utility classes the pages use are
+compiled into one stylesheet (see webcss.py) served under a content-hashed
+URL, and every <i data-lucide="name"> becomes a reference into an inline
+SVG sprite built from web/icons/.
+"""
+
+import gzip
+import hashlib
+import html
+import json
+import os
+import re
+import sys
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+sys.path.insert(0, os.path.join(PROJECT_DIR, "scripts"))
+import webcss  # noqa: E402
+
+WEB_DIR = os.path.join(PROJECT_DIR, "web")
+OUT_DIR = os.path.join(PROJECT_DIR, "src", "generated")
+
+# Page name -> (source file in web/, localized). Localized pages get one
+# copy per language.
+PAGES = {
+    "dashboard": ("dashboard.html", True),
+    "update": ("update.html", True),
+}
+
+# Other files served as-is (after placeholder resolution)
+STATIC_FILES = {
+    "manifest": "manifest.json",
+    "service_worker": "sw.js",
+}
+
+SLOT_PATTERN = re.compile(r"\{([A-Z][A-Z0-9_]*)\}")
+SCRIPT_STRING_PATTERN = re.compile(r"\blang\.([a-z][a-zA-Z0-9]*)")
+ICON_PATTERN = re.compile(r'<i data-lucide="([a-z0-9-]+)"(?: class="([^"]*)")?></i>')
+SVG_BODY_PATTERN = re.compile(r"<svg[^>]*>(.*)</svg>", re.S)
+
+
+def read(filename):
+    with open(os.path.join(WEB_DIR, filename), encoding="utf-8") as f:
+        return f.read()
+
+
+def build_sprite(sources):
+    """Inline <symbol> sprite holding only the icons the pages reference."""
+    names = []
+    for source in sources:
+        for match in ICON_PATTERN.finditer(source):
+            if match.group(1) not in names:
+                names.append(match.group(1))
+    symbols = []
+    for name in names:
+        path = os.path.join("icons", name + ".svg")
+        if not os.path.exists(os.path.join(WEB_DIR, path)):
+            raise SystemExit("build_web: missing icon web/%s" % path)
+        body = SVG_BODY_PATTERN.search(read(path)).group(1)
+        body = re.sub(r"\s*/>", "/>", re.sub(r"\s*\n\s*", "", body))
+        symbols.append('<symbol id="i-%s" viewBox="0 0 24 24">%s</symbol>' % (name, body))
+    return '<svg style="display:none">%s</svg>' % "".join(symbols), names
+
+
+def replace_icons(source):
+    def replace(match):
+        classes = ((match.group(2) or "") + " icon").strip()
+        return '<svg class="%s"><use href="#i-%s"/></svg>' % (classes, match.group(1))
+    return ICON_PATTERN.sub(replace, source)
+
+
+def load_translations():
+    with open(os.path.join(WEB_DIR, "i18n.json"), encoding="utf-8") as f:
+        i18n = json.load(f)
+    languages = i18n["languages"]
+    for key, texts in i18n["strings"].items():
+        missing = [language for language in languages if language not in texts]
+        if missing:
+            raise SystemExit("build_web: i18n.json \"%s\" lacks %s" % (key, ", ".join(missing)))
+    return languages, i18n["strings"]
+
+
+def snake_case(name):
+    return re.sub(r"([A-Z])", r"_\1", name).lower()
+
+
+def script_strings(source, filename, language, strings):
+    """JS object literal with the strings a page script reads as lang.key."""
+    texts = {}
+    for name in sorted(set(SCRIPT_STRING_PATTERN.findall(source))):
+        key = snake_case(name)
+        if key not in strings:
+            raise SystemExit("build_web: unknown string lang.%s in web/%s" % (name, filename))
+        texts[name] = strings[key][language]
+    return json.dumps(texts, ensure_ascii=False).replace("</", "<\\/")
+
+
+def resolve(source, filename, language, languages, strings, shared):
+    def replace(match):
+        slot = match.group(1)
+        if slot in shared:
+            return shared[slot]
+        if slot in ("LANG", "LANGUAGE"):
+            return language
+        if slot == "LANGUAGE_DISPLAY":
+            return language.upper()
+        if slot == "LANGUAGE_LIST":
+            return json.dumps(languages)
+        if slot == "SCRIPT_STRINGS":
+            return script_strings(source, filename, language, strings)
+        if slot.lower() in strings:
+            return html.escape(strings[slot.lower()][language])
+        raise SystemExit("build_web: unknown placeholder {%s} in web/%s" % (slot, filename))
+
+    return SLOT_PATTERN.sub(replace, replace_icons(source))
+
+
+def c_string(text):
+    """C string literal; octal escapes keep UTF-8 bytes from merging with the next character."""
+    out = ""
+    for ch in text.encode("utf-8"):
+        if ch in (ord("\\"), ord('"')):
+            out += "\\" + chr(ch)
+        elif 0x20 <= ch < 0x7F:
+            out += chr(ch)
+        else:
+            out += "\\%03o" % ch
+    return '"%s"' % out
+
+
+def generate_text_table(languages, strings):
+    lines = [
+        "// Generated by scripts/build_web.py from web/i18n.json - do not edit.",
+        "#pragma once",
+        "",
+        "#include <stdint.h>",
+        "",
+        "enum Language : uint8_t {",
+    ]
+    lines += ["    LANGUAGE_%s," % language.upper() for language in languages]
+    lines += ["    LANGUAGE_COUNT", "};", ""]
+    lines.append("static constexpr const char* LANGUAGE_CODES[LANGUAGE_COUNT] = {%s};"
+                 % ", ".join('"%s"' % language for language in languages))
+    lines += ["", "enum TextId : uint16_t {"]
+    lines += ["    TEXT_%s," % key.upper() for key in strings]
+    lines += ["    TEXT_COUNT", "};", ""]
+    lines.append("static constexpr const char* TEXTS[LANGUAGE_COUNT][TEXT_COUNT] = {")
+    for language in languages:
+        lines.append("    { // %s" % language)
+        lines += ["        %s," % c_string(texts[language]) for texts in strings.values()]
+        lines.append("    },")
+    lines += ["};", ""]
+    write_if_changed(os.path.join(OUT_DIR, "i18n_table.h"), "\n".join(lines))
+
+
+def c_bytes(data):
+    rows = []
+    for i in range(0, len(data), 20):
+        rows.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 20]) + ",")
+    return "\n".join(rows)
+
+
+def compress(text):
+    # mtime=0 keeps the output (and so the ETag) stable between builds
+    return gzip.compress(text.encode("utf-8"), compresslevel=9, mtime=0)
+
+
+def emit_asset(lines, symbol, data):
+    etag = hashlib.sha1(data).hexdigest()[:16]
+    lines.append("static const uint8_t %s_GZ[] PROGMEM = {" % symbol)
+    lines.append(c_bytes(data))
+    lines.append("};")
+    lines.append("")
+    return '{%s_GZ, %d, "\\"%s\\""}' % (symbol, len(data), etag)
+
+
+def generate(languages, strings):
+    sources = {name: read(filename) for name, (filename, _) in PAGES.items()}
+
+    css = webcss.generate(sources.values(), read("base.css"))
+    css_data = compress(css)
+    stylesheet = "/app.%s.css" % hashlib.sha1(css_data).hexdigest()[:8]
+    sprite, icons = build_sprite(sources.values())
+    shared = {"STYLESHEET": stylesheet, "ICON_SPRITE": sprite}
+    print("build_web: stylesheet %s %d -> %d bytes gzip, %d icons"
+          % (stylesheet, len(css), len(css_data), len(icons)))
+
+    lines = [
+        "// Generated by scripts/build_web.py from web/ - do not edit.",
+        "#pragma once",
+        "",
+        '#include "../web_asset.h"',
+        '#include "i18n_table.h"',
+        "",
+    ]
+    entry = emit_asset(lines, "STYLESHEET", css_data)
+    lines.append('#define STYLESHEET_PATH "%s"' % stylesheet)
+    lines.append("static const WebAsset STYLESHEET_ASSET = %s;" % entry)
+    lines.append("")
+
+    # Changes whenever anything the service worker caches changes
+    version = hashlib.sha1(css_data)
+
+    for name, (filename, localized) in PAGES.items():
+        prefix = name.upper()
+        if localized:
+            entries = []
+            for language in languages:
+                page = resolve(sources[name], filename, language, languages, strings, shared)
+                data = compress(page)
+                version.update(data)
+                entries.append(emit_asset(lines, "%s_%s" % (prefix, language.upper()), data))
+                print("build_web: %s [%s] %d -> %d bytes gzip"
+                      % (filename, language, len(page.encode("utf-8")), len(data)))
+            lines.append("static const WebAsset %s_PAGES[LANGUAGE_COUNT] = {" % prefix)
+            for entry in entries:
+                lines.append("    %s," % entry)
+            lines.append("};")
+        else:
+            page = resolve(sources[name], filename, languages[0], languages, {}, shared)
+            data = compress(page)
+            version.update(data)
+            entry = emit_asset(lines, prefix, data)
+            lines.append("static const WebAsset %s_PAGE = %s;" % (prefix, entry))
+            print("build_web: %s %d -> %d bytes gzip" % (filename, len(page.encode("utf-8")), len(data)))
+        lines.append("")
+
+    shared["ASSET_VERSION"] = version.hexdigest()[:8]
+    for name, filename in STATIC_FILES.items():
+        data = compress(resolve(read(filename), filename, languages[0], languages, {}, shared))
+        entry = emit_asset(lines, name.upper(), data)
+        lines.append("static const WebAsset %s_ASSET = %s;" % (name.upper(), entry))
+        lines.append("")
+
+    write_if_changed(os.path.join(OUT_DIR, "web_assets.h"), "\n".join(lines))
+
+
+def write_if_changed(path, content):
+    """Only touch the output when it changed so incremental builds stay incremental."""
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as f:
+            if f.read() == content:
+                return
+    with open(path, "w", encoding="utf-8") as f:
+        f.write(content)
+
+
+def main():
+    os.makedirs(OUT_DIR, exist_ok=True)
+    languages, strings = load_translations()
+    generate_text_table(languages, strings)
+    generate(languages, strings)
+
+
+main()
@@ -0,0 +1,299 @@
+"""Build-time utility CSS for the web UI.
+
+Generates only the Tailwind-style utility classes that actually appear in
+the pages, so the device serves a few KB of static CSS instead of pulling
+the Tailwind JIT compiler from a CDN. Covers the subset of Tailwind v3
+(palette, spacing, variants) used by web/*.html; unknown tokens are
+ignored, so the scanner can be fed whole files including scripts.
+"""
+
+import re
+
+PALETTE = {
+    "slate": ["#f8fafc", "#f1f5f9", "#e2e8f0", "#cbd5e1", "#94a3b8", "#64748b", "#475569", "#334155", "#1e293b", "#0f172a"],
+    "gray": ["#f9fafb", "#f3f4f6", "#e5e7eb", "#d1d5db", "#9ca3af", "#6b7280", "#4b5563", "#374151", "#1f2937", "#111827"],
+    "red": ["#fef2f2", "#fee2e2", "#fecaca", "#fca5a5", "#f87171", "#ef4444", "#dc2626", "#b91c1c", "#991b1b", "#7f1d1d"],
+    "yellow": ["#fefce8", "#fef9c3", "#fef08a", "#fde047", "#facc15", "#eab308", "#ca8a04", "#a16207", "#854d0e", "#713f12"],
+    "green": ["#f0fdf4", "#dcfce7", "#bbf7d0", "#86efac", "#4ade80", "#22c55e", "#16a34a", "#15803d", "#166534", "#14532d"],
+    "emerald": ["#ecfdf5", "#d1fae5", "#a7f3d0", "#6ee7b7", "#34d399", "#10b981", "#059669", "#047857", "#065f46", "#064e3b"],
+    "teal": ["#f0fdfa", "#ccfbf1", "#99f6e4", "#5eead4", "#2dd4bf", "#14b8a6", "#0d9488", "#0f766e", "#115e59", "#134e4a"],
+    "blue": ["#eff6ff", "#dbeafe", "#bfdbfe", "#93c5fd", "#60a5fa", "#3b82f6", "#2563eb", "#1d4ed8", "#1e40af", "#1e3a8a"],
+    "purple": ["#faf5ff", "#f3e8ff", "#e9d5ff", "#d8b4fe", "#c084fc", "#a855f7", "#9333ea", "#7e22ce", "#6b21a8", "#581c87"],
+}
+SHADES = ["50", "100", "200", "300", "400", "500", "600", "700", "800", "900"]
+
+# Theme extensions the dashboard used to pass to tailwind.config
+CUSTOM_COLORS = {
+    "white": "#ffffff",
+    "black": "#000000",
+    "primary": "#4ade80",
+    "secondary": "#22c55e",
+    "accent": "#86efac",
+    "sage": "#94a3b8",
+    "green-soft": "#ecfdf5",
+    "green-card": "#6ee7b7",
+}
+
+BREAKPOINTS = [("sm", 640), ("md", 768), ("lg", 1024), ("xl", 1280), ("2xl", 1536)]
+
+FONT_SIZES = {
+    "xs": ("0.75rem", "1rem"),
+    "sm": ("0.875rem", "1.25rem"),
+    "base": ("1rem", "1.5rem"),
+    "lg": ("1.125rem", "1.75rem"),
+    "xl": ("1.25rem", "1.75rem"),
+    "2xl": ("1.5rem", "2rem"),
+    "3xl": ("1.875rem", "2.25rem"),
+}
+FONT_WEIGHTS = {"normal": "400", "medium": "500", "semibold": "600", "bold": "700"}
+RADII = {"": "0.25rem", "md": "0.375rem", "lg": "0.5rem", "xl": "0.75rem", "2xl": "1rem", "full": "9999px"}
+MAX_WIDTHS = {"md": "28rem", "lg": "32rem", "xl": "36rem", "2xl": "42rem", "3xl": "48rem", "4xl": "56rem"}
+SHADOWS = {
+    "sm": "0 1px 2px 0 rgb(0 0 0 / 0.05)",
+    "": "0 1px 3px 0 rgb(0 0 0 / 0.1), 0 1px 2px -1px rgb(0 0 0 / 0.1)",
+    "md": "0 4px 6px -1px rgb(0 0 0 / 0.1), 0 2px 4px -2px rgb(0 0 0 / 0.1)",
+    "lg": "0 10px 15px -3px rgb(0 0 0 / 0.1), 0 4px 6px -4px rgb(0 0 0 / 0.1)",
+    "xl": "0 20px 25px -5px rgb(0 0 0 / 0.1), 0 8px 10px -6px rgb(0 0 0 / 0.1)",
+}
+GRADIENT_DIRECTIONS = {"t": "top", "r": "right", "b": "bottom", "l": "left",
+                       "tr": "top right", "br": "bottom right", "bl": "bottom left", "tl": "top left"}
+TRANSITION_TIMING = "transition-timing-function:cubic-bezier(0.4,0,0.2,1);transition-duration:150ms"
+TRANSITIONS = {
+    "": "color,background-color,border-color,text-decoration-color,fill,stroke,opacity,box-shadow,transform,filter,backdrop-filter",
+    "all": "all",
+    "colors": "color,background-color,border-color,text-decoration-color,fill,stroke",
+    "transform": "transform",
+}
+TRANSFORM = "transform:translate(var(--tw-translate-x),var(--tw-translate-y))"
+
+# Emission order, mirroring Tailwind's so that later groups win ties the
+# same way they do with the CDN build (e.g. "hidden" after "grid").
+GROUPS = [
+    "position", "inset", "z", "order", "margin", "display", "size", "transform", "cursor",
+    "appearance", "grid-cols", "align", "justify", "gap", "space", "overflow", "rounded",
+    "border-width", "border-color", "background", "gradient", "padding", "text-align",
+    "font-size", "font-weight", "text-color", "shadow", "ring", "ring-color", "backdrop",
+    "transition", "duration",
+]
+DISPLAY = ["block", "inline-block", "inline", "flex", "inline-flex", "table", "grid", "hidden"]
+
+TOKEN_PATTERN = re.compile(r"[^\s\"'`<>=${}();,]+")
+
+
+def color(name):
+    """Resolve 'emerald-600' or 'white/20' to a CSS color, or None."""
+    opacity = None
+    if "/" in name:
+        name, opacity = name.split("/", 1)
+        if not opacity.isdigit():
+            return None
+    if name == "transparent" and opacity is None:
+        return "transparent"
+    value = CUSTOM_COLORS.get(name)
+    if value is None:
+        hue, _, shade = name.rpartition("-")
+        if hue not in PALETTE or shade not in SHADES:
+            return None
+        value = PALETTE[hue][SHADES.index(shade)]
+    if opacity is None:
+        return value
+    r, g, b = (int(value[i:i + 2], 16) for i in (1, 3, 5))
+    return "rgb(%d %d %d / %s)" % (r, g, b, _number(int(opacity) / 100))
+
+
+def _number(value):
+    text = ("%.6f" % value).rstrip("0").rstrip(".")
+    return text[1:] if text.startswith("0.") else ("-" + text[2:] if text.startswith("-0.") else text)
+
+
+def spacing(value, negative=False):
+    if value == "px":
+        size = "1px"
+    elif value == "full":
+        size = "100%"
+    elif re.fullmatch(r"\d+/\d+", value):
+        top, bottom = (int(v) for v in value.split("/"))
+        size = _number(top / bottom * 100) + "%"
+    elif re.fullmatch(r"\d+(\.5)?", value):
+        size = _number(float(value) * 0.25) + "rem" if value != "0" else "0px"
+    else:
+        return None
+    return "-" + size if negative and size not in ("0px",) else size
+
+
+def utility(name):
+    """Return (group, sort_key, declarations, selector_suffix) for a base utility."""
+    negative = name.startswith("-")
+    bare = name[1:] if negative else name
+
+    if name in DISPLAY:
+        value = "none" if name == "hidden" else name
+        return "display", DISPLAY.index(name), "display:" + value, ""
+    if name in ("static", "fixed", "absolute", "relative", "sticky"):
+        return "position", 0, "position:" + name, ""
+    if name in ("overflow-hidden", "overflow-auto"):
+        return "overflow", 0, "overflow:" + name.split("-")[1], ""
+    if name == "transform":
+        return "transform", 0, TRANSFORM, ""
+    if name == "cursor-pointer":
+        return "cursor", 0, "cursor:pointer", ""
+    if name == "appearance-none":
+        return "appearance", 0, "-webkit-appearance:none;appearance:none", ""
+    if name == "min-h-screen":
+        return "size", 0, "min-height:100vh", ""
+    if name.startswith("max-w-") and name[6:] in MAX_WIDTHS:
+        return "size", 0, "max-width:" + MAX_WIDTHS[name[6:]], ""
+    if name.startswith("items-") and name[6:] in ("start", "end", "center", "stretch"):
+        value = name[6:] if name[6:] in ("center", "stretch") else "flex-" + name[6:]
+        return "align", 0, "align-items:" + value, ""
+    if name.startswith("justify-") and name[8:] in ("start", "end", "center", "between"):
+        value = {"start": "flex-start", "end": "flex-end", "between": "space-between"}.get(name[8:], name[8:])
+        return "justify", 0, "justify-content:" + value, ""
+    if name.startswith("text-") and name[5:] in ("left", "center", "right"):
+        return "text-align", 0, "text-align:" + name[5:], ""
+    if name.startswith("text-") and name[5:] in FONT_SIZES:
+        size, height = FONT_SIZES[name[5:]]
+        return "font-size", 0, "font-size:%s;line-height:%s" % (size, height), ""
+    if name.startswith("font-") and name[5:] in FONT_WEIGHTS:
+        return "font-weight", 0, "font-weight:" + FONT_WEIGHTS[name[5:]], ""
+    if name == "rounded" or (name.startswith("rounded-") and name[8:] in RADII):
+        return "rounded", 0, "border-radius:" + RADII[name[8:]], ""
+    if name == "shadow" or (name.startswith("shadow-") and name[7:] in SHADOWS):
+        return "shadow", 0, "box-shadow:" + SHADOWS[name[7:]], ""
+    if name == "backdrop-blur-sm":
+        return "backdrop", 0, "-webkit-backdrop-filter:blur(4px);backdrop-filter:blur(4px)", ""
+    if name == "transition" or (name.startswith("transition-") and name[11:] in TRANSITIONS):
+        return "transition", 0, "transition-property:%s;%s" % (TRANSITIONS[name[11:]], TRANSITION_TIMING), ""
+    if name.startswith("duration-") and name[9:].isdigit():
+        return "duration", 0, "transition-duration:%sms" % name[9:], ""
+    if name.startswith("z-") and name[2:].isdigit():
+        return "z", 0, "z-index:" + name[2:], ""
+    if name.startswith("order-") and name[6:].isdigit():
+        return "order", 0, "order:" + name[6:], ""
+    if name.startswith("grid-cols-") and name[10:].isdigit():
+        return "grid-cols", 0, "grid-template-columns:repeat(%s,minmax(0,1fr))" % name[10:], ""
+    if name.startswith("bg-gradient-to-") and name[15:] in GRADIENT_DIRECTIONS:
+        return "background", 1, "background-image:linear-gradient(to %s,var(--tw-gradient-stops))" % GRADIENT_DIRECTIONS[name[15:]], ""
+    if name in ("border", "border-t", "border-b", "border-l", "border-r"):
+        side = {"border": "", "border-t": "-top", "border-b": "-bottom", "border-l": "-left", "border-r": "-right"}[name]
+        return "border-width", 0 if not side else 1, "border%s-width:1px" % side, ""
+    if name.startswith("ring-") and name[5:].isdigit():
+        return "ring", 0, "box-shadow:0 0 0 %spx var(--tw-ring-color,rgb(59 130 246 / .5))" % name[5:], ""
+
+    match = re.fullmatch(r"(top|right|bottom|left)-(.+)", bare)
+    if match:
+        value = spacing(match.group(2), negative)
+        if value:
+            return "inset", 0, "%s:%s" % (match.group(1), value), ""
+    match = re.fullmatch(r"translate-([xy])-(.+)", bare)
+    if match:
+        value = spacing(match.group(2), negative)
+        if value:
+            return "transform", 1, "--tw-translate-%s:%s;%s" % (match.group(1), value, TRANSFORM), ""
+    match = re.fullmatch(r"(m|mx|my|mt|mr|mb|ml)-(.+)", bare)
+    if match:
+        value = "auto" if match.group(2) == "auto" else spacing(match.group(2), negative)
+        if value:
+            return "margin", len(match.group(1)), _box("margin", match.group(1)[1:], value), ""
+    match = re.fullmatch(r"(p|px|py|pt|pr|pb|pl)-(.+)", name)
+    if match:
+        value = spacing(match.group(2))
+        if value:
+            return "padding", len(match.group(1)), _box("padding", match.group(1)[1:], value), ""
+    match = re.fullmatch(r"(w|h)-(.+)", name)
+    if match:
+        value = spacing(match.group(2))
+        if value:
+            return "size", 1, "%s:%s" % ("width" if match.group(1) == "w" else "height", value), ""
+    match = re.fullmatch(r"gap-(.+)", name)
+    if match and spacing(match.group(1)):
+        return "gap", 0, "gap:" + spacing(match.group(1)), ""
+    match = re.fullmatch(r"space-([xy])-(.+)", name)
+    if match and spacing(match.group(2)):
+        prop = "margin-top" if match.group(1) == "y" else "margin-left"
+        return "space", 0, "%s:%s" % (prop, spacing(match.group(2))), ">:not([hidden])~:not([hidden])"
+
+    match = re.fullmatch(r"(text|bg|border|from|to|ring)-(.+)", name)
+    if match and color(match.group(2)):
+        kind, value = match.group(1), color(match.group(2))
+        if kind == "text":
+            return "text-color", 0, "color:" + value, ""
+        if kind == "bg":
+            return "background", 0, "background-color:" + value, ""
+        if kind == "border":
+            return "border-color", 0, "border-color:" + value, ""
+        if kind == "ring":
+            return "ring-color", 0, "--tw-ring-color:" + value, ""
+        if kind == "from":
+            return "gradient", 0, ("--tw-gradient-from:%s;--tw-gradient-to:%s;"
+                                   "--tw-gradient-stops:var(--tw-gradient-from),var(--tw-gradient-to)"
+                                   % (value, _transparent(value))), ""
+        return "gradient", 1, "--tw-gradient-to:" + value, ""
+    return None
+
+
+def _box(prop, axis, value):
+    sides = {"": [""], "x": ["-left", "-right"], "y": ["-top", "-bottom"],
+             "t": ["-top"], "r": ["-right"], "b": ["-bottom"], "l": ["-left"]}[axis]
+    return ";".join("%s%s:%s" % (prop, side, value) for side in sides)
+
+
+def _transparent(value):
+    if value.startswith("#"):
+        r, g, b = (int(value[i:i + 2], 16) for i in (1, 3, 5))
+        return "rgb(%d %d %d / 0)" % (r, g, b)
+    return "transparent"
+
+
+def escape(name):
+    return re.sub(r"([:/.])", r"\\\1", name)
+
+
+def generate(sources, base_css):
+    """Return minified CSS covering every utility token found in sources."""
+    tokens = set()
+    for source in sources:
+        tokens.update(TOKEN_PATTERN.findall(source))
+
+    rules = {"": [], "hover": [], "focus": []}
+    media = {bp: [] for bp, _ in BREAKPOINTS}
+    container = "container" in tokens
+
+    for token in sorted(tokens):
+        *variants, base = token.split(":")
+        if len(variants) > 1:
+            continue
+        spec = utility(base)
+        if spec is None:
+            continue
+        group, key, declarations, suffix = spec
+        selector = "." + escape(token)
+        variant = variants[0] if variants else ""
+        if variant in ("hover", "focus"):
+            selector += ":" + variant
+            bucket = rules[variant]
+        elif variant in media:
+            bucket = media[variant]
+        elif variant == "":
+            bucket = rules[""]
+        else:
+            continue
+        bucket.append((GROUPS.index(group), key, token, "%s%s{%s}" % (selector, suffix, declarations)))
+
+    css = [minify(base_css)]
+    if container:
+        css.append(".container{width:100%}")
+        css.extend("@media (min-width:%dpx){.container{max-width:%dpx}}" % (px, px) for _, px in BREAKPOINTS)
+    for variant in ("", "hover", "focus"):
+        css.extend(rule for *_, rule in sorted(rules[variant]))
+    for bp, px in BREAKPOINTS:
+        if media[bp]:
+            css.append("@media (min-width:%dpx){%s}" % (px, "".join(rule for *_, rule in sorted(media[bp]))))
+    return "".join(css)
+
+
+def minify(css):
+    css = re.sub(r"/\*.*?\*/", "", css, flags=re.S)
+    css = re.sub(r"\s+", " ", css)
+    css = re.sub(r"\s*([{}:;,>~])\s*", r"\1", css)
+    return css.replace(";}", "}").strip()
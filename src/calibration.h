@@ -0,0 +1,141 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <math.h>
+
+#define CALIBRATION_MAX_POINTS 8
+#define CALIBRATION_DEFAULT_GRAMS_PER_SECOND 5.0
+
+struct CalibrationPoint {
+    uint32_t durationMs;
+    float grams;
+};
+
+// Auger output model: nothing comes out for deadTimeMs while the auger
+// spins up, then a steady gramsPerSecond. Fitted by least squares over the
+// most recent calibration runs; a new run replaces the oldest once full,
+// so the model follows a drifting hopper or auger.
+class CalibrationModel {
+private:
+    struct Stored {
+        uint8_t count;
+        uint8_t next;
+        CalibrationPoint points[CALIBRATION_MAX_POINTS];
+    };
+
+    Stored data = {};
+    float gramsPerSecond = CALIBRATION_DEFAULT_GRAMS_PER_SECOND;
+    float deadTimeMs = 0;
+    float rmsResidual = 0;
+
+    // Best rate for a line through the origin, used when the runs cannot
+    // separate dead time from rate (a single duration, or a fit that would
+    // need negative dead time)
+    void fitRateOnly() {
+        float sumGT = 0;
+        float sumTT = 0;
+        for (uint8_t i = 0; i < data.count; i++) {
+            float t = data.points[i].durationMs / 1000.0;
+            sumGT += data.points[i].grams * t;
+            sumTT += t * t;
+        }
+        gramsPerSecond = sumGT > 0 ? sumGT / sumTT : CALIBRATION_DEFAULT_GRAMS_PER_SECOND;
+        deadTimeMs = 0;
+    }
+
+    void fit() {
+        if (data.count == 0) {
+            gramsPerSecond = CALIBRATION_DEFAULT_GRAMS_PER_SECOND;
+            deadTimeMs = 0;
+            rmsResidual = 0;
+            return;
+        }
+
+        float meanT = 0;
+        float meanG = 0;
+        for (uint8_t i = 0; i < data.count; i++) {
+            meanT += data.points[i].durationMs / 1000.0;
+            meanG += data.points[i].grams;
+        }
+        meanT /= data.count;
+        meanG /= data.count;
+
+        float sxx = 0;
+        float sxy = 0;
+        for (uint8_t i = 0; i < data.count; i++) {
+            float dt = data.points[i].durationMs / 1000.0 - meanT;
+            sxx += dt * dt;
+            sxy += dt * (data.points[i].grams - meanG);
+        }
+
+        // Durations must differ by a meaningful amount to see the dead time
+        if (sxx < 0.25 || sxy <= 0) {
+            fitRateOnly();
+        } else {
+            gramsPerSecond = sxy / sxx;
+            deadTimeMs = (meanT - meanG / gramsPerSecond) * 1000.0;
+            if (deadTimeMs < 0) fitRateOnly();
+        }
+
+        float sumSquares = 0;
+        for (uint8_t i = 0; i < data.count; i++) {
+            float r = residual(i);
+            sumSquares += r * r;
+        }
+        rmsResidual = sqrt(sumSquares / data.count);
+    }
+
+public:
+    // Loads stored runs; an old single-value calibration ("cal", grams per
+    // 10 s) becomes the first run
+    void load(Preferences& preferences) {
+        if (preferences.getBytes("calModel", &data, sizeof(data)) != sizeof(data) || data.count > CALIBRATION_MAX_POINTS) {
+            data = {};
+            if (preferences.isKey("cal")) {
+                addPoint(10000, preferences.getFloat("cal", 50.0));
+                save(preferences);
+                return;
+            }
+        }
+        fit();
+    }
+
+    void save(Preferences& preferences) {
+        preferences.putBytes("calModel", &data, sizeof(data));
+    }
+
+    void addPoint(uint32_t durationMs, float grams) {
+        data.points[data.next] = {durationMs, grams};
+        data.next = (data.next + 1) % CALIBRATION_MAX_POINTS;
+        if (data.count < CALIBRATION_MAX_POINTS) data.count++;
+        fit();
+    }
+
+    void clear() {
+        data = {};
+        fit();
+    }
+
+    float predictGrams(float durationMs) const {
+        if (durationMs <= deadTimeMs) return 0;
+        return gramsPerSecond * (durationMs - deadTimeMs) / 1000.0;
+    }
+
+    unsigned long durationForGrams(float grams) const {
+        if (grams <= 0) return 0;
+        return (unsigned long)(deadTimeMs + grams / gramsPerSecond * 1000.0 + 0.5);
+    }
+
+    // Measured minus predicted grams for a stored run; a growing spread
+    // means the hopper or auger has drifted since those runs
+    float residual(uint8_t index) const {
+        return data.points[index].grams - predictGrams(data.points[index].durationMs);
+    }
+
+    uint8_t pointCount() const { return data.count; }
+    const CalibrationPoint& point(uint8_t index) const { return data.points[index]; }
+    float getGramsPerSecond() const { return gramsPerSecond; }
+    float getDeadTimeMs() const { return deadTimeMs; }
+    float getRmsResidual() const { return rmsResidual; }
+};
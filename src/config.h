@@ -0,0 +1,200 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "i18n.h"
+#include "power.h"
+#include "scheduler.h"
+
+#define CONFIG_VERSION 3
+#define DEFAULT_TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3"
+
+// Every user setting, loaded once at boot and edited in RAM. New fields go
+// at the end with a CONFIG_VERSION bump; older blobs are then read over
+// the defaults, so the new fields start out at their default. Laid out
+// without padding, so two copies compare equal with memcmp.
+struct Config {
+    int32_t adults;
+    int32_t feedAmount;    // grams per chicken and day
+    int32_t feedFrequency; // feedings per day
+    int32_t sunriseOffset; // hours after sunrise
+    int32_t sunsetOffset;  // hours before sunset
+    float latitude;
+    float longitude;
+    uint32_t catchUpWindow; // minutes
+    uint32_t wifiInterval;  // minutes
+    Language language;
+    CatchUpPolicy catchUp;
+    PowerMode powerMode;
+    char timezone[64];
+    char ssid[33];
+    char password[64]; // WPA2 passphrases are at most 63 characters
+    uint32_t hopperCapacity; // grams when full, 0 if unknown (version 2)
+    uint32_t staticIp;       // 0 for DHCP (version 3)
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;            // 0 to use the gateway
+};
+
+// Keeps the settings in NVS as one CRC-checked, versioned blob ("config")
+// instead of a key per setting, and writes it only when its bytes changed.
+class ConfigStore {
+private:
+    struct Header {
+        uint16_t version;
+        uint16_t size;
+        uint32_t crc;
+    };
+
+    struct Stored {
+        Header header;
+        Config config;
+    };
+
+    Stored stored = {}; // image of what NVS holds
+    bool pending = false;
+
+    static uint32_t crc32(const uint8_t* data, size_t length) {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < length; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+            }
+        }
+        return ~crc;
+    }
+
+    static void setDefaults(Config& config) {
+        memset(&config, 0, sizeof(config));
+        config.adults = 6;
+        config.feedAmount = 120;
+        config.feedFrequency = 3;
+        config.sunriseOffset = 2;
+        config.sunsetOffset = 2;
+        config.latitude = DEFAULT_LATITUDE;
+        config.longitude = DEFAULT_LONGITUDE;
+        config.catchUpWindow = DEFAULT_CATCHUP_WINDOW_MIN;
+        config.wifiInterval = DEFAULT_WIFI_INTERVAL_MIN;
+        config.language = LANGUAGE_DE;
+        config.catchUp = CATCHUP_LATEST;
+        config.powerMode = POWER_ALWAYS_ON;
+        strcpy(config.timezone, DEFAULT_TIMEZONE);
+    }
+
+    static void copyString(char* target, size_t size, const String& value) {
+        strncpy(target, value.c_str(), size - 1);
+        target[size - 1] = '\0';
+    }
+
+    // Firmware before the blob kept one NVS key per setting
+    static const char* const* legacyKeys() {
+        static const char* const keys[] = {
+            "adults", "feedAmount", "feedFreq", "sunriseOff", "sunsetOff", "lat", "lon", "lang",
+            "catchUp", "catchUpMin", "powerMode", "wifiEvery", "timezone", "ssid", "pass", nullptr
+        };
+        return keys;
+    }
+
+    static bool readLegacy(Preferences& preferences, Config& config) {
+        bool found = false;
+        for (const char* const* key = legacyKeys(); *key; key++) {
+            found = found || preferences.isKey(*key);
+        }
+        if (!found) return false;
+
+        config.adults = preferences.getInt("adults", config.adults);
+        config.feedAmount = preferences.getInt("feedAmount", config.feedAmount);
+        config.feedFrequency = preferences.getInt("feedFreq", config.feedFrequency);
+        config.sunriseOffset = preferences.getInt("sunriseOff", config.sunriseOffset);
+        config.sunsetOffset = preferences.getInt("sunsetOff", config.sunsetOffset);
+        config.latitude = preferences.getFloat("lat", config.latitude);
+        config.longitude = preferences.getFloat("lon", config.longitude);
+        parseLanguage(preferences.getString("lang", LANGUAGE_CODES[config.language]).c_str(), config.language);
+        config.catchUp = (CatchUpPolicy)preferences.getUChar("catchUp", config.catchUp);
+        config.catchUpWindow = preferences.getUInt("catchUpMin", config.catchUpWindow);
+        config.powerMode = (PowerMode)preferences.getUChar("powerMode", config.powerMode);
+        config.wifiInterval = preferences.getUInt("wifiEvery", config.wifiInterval);
+        copyString(config.timezone, sizeof(config.timezone), preferences.getString("timezone", config.timezone));
+        copyString(config.ssid, sizeof(config.ssid), preferences.getString("ssid", ""));
+        copyString(config.password, sizeof(config.password), preferences.getString("pass", ""));
+        return true;
+    }
+
+    // Values a valid CRC does not vouch for, e.g. a language dropped since
+    static void sanitize(Config& config) {
+        if (config.language >= LANGUAGE_COUNT) config.language = LANGUAGE_DE;
+        if (config.catchUp > CATCHUP_ALL) config.catchUp = CATCHUP_LATEST;
+        if (config.powerMode > POWER_DEEP_SLEEP) config.powerMode = POWER_ALWAYS_ON;
+        config.timezone[sizeof(config.timezone) - 1] = '\0';
+        config.ssid[sizeof(config.ssid) - 1] = '\0';
+        config.password[sizeof(config.password) - 1] = '\0';
+    }
+
+public:
+    void load(Preferences& preferences, Config& config) {
+        setDefaults(config);
+        Stored blob;
+        size_t length = preferences.getBytes("config", &blob, sizeof(blob));
+        bool valid = length >= sizeof(Header) && blob.header.version >= 1 && blob.header.version <= CONFIG_VERSION &&
+                     blob.header.size <= sizeof(Config) && length == sizeof(Header) + blob.header.size &&
+                     blob.header.crc == crc32((const uint8_t*)&blob.config, blob.header.size);
+
+        if (valid) {
+            memcpy(&config, &blob.config, blob.header.size);
+            sanitize(config);
+            if (blob.header.version == CONFIG_VERSION) {
+                stored = blob;
+            } else {
+                Serial.printf("Config v%u upgraded to v%u\n", blob.header.version, CONFIG_VERSION);
+                commit(preferences, config);
+            }
+            return;
+        }
+
+        if (length > 0) {
+            Serial.println("Config blob invalid, using defaults");
+        } else if (readLegacy(preferences, config)) {
+            sanitize(config);
+            if (commit(preferences, config)) {
+                for (const char* const* key = legacyKeys(); *key; key++) {
+                    preferences.remove(*key);
+                }
+                Serial.println("Config migrated from individual keys");
+            }
+        }
+    }
+
+    // Marks the settings for the next commitPending(), keeping the flash
+    // write out of the request that changed them
+    void requestCommit() {
+        pending = true;
+    }
+
+    bool commitPending(Preferences& preferences, const Config& config) {
+        if (!pending) return false;
+        pending = false;
+        return commit(preferences, config);
+    }
+
+    // Writes the blob if it differs from what NVS holds; true if written
+    bool commit(Preferences& preferences, const Config& config) {
+        pending = false;
+        if (stored.header.version == CONFIG_VERSION && memcmp(&stored.config, &config, sizeof(Config)) == 0) {
+            return false;
+        }
+
+        Stored blob;
+        blob.header.version = CONFIG_VERSION;
+        blob.header.size = sizeof(Config);
+        blob.config = config;
+        blob.header.crc = crc32((const uint8_t*)&blob.config, sizeof(Config));
+        if (preferences.putBytes("config", &blob, sizeof(blob)) != sizeof(blob)) {
+            Serial.println("Config write failed");
+            return false;
+        }
+        stored = blob;
+        return true;
+    }
+};
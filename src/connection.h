@@ -0,0 +1,230 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <Preferences.h>
+
+#include "config.h"
+#include "fixed_string.h"
+
+#define WIFI_HOSTNAME "henny"
+#define WIFI_AP_SSID "Henny-Setup"
+#define WIFI_AP_PASSWORD "hennyfeeder"
+#define WIFI_CACHED_CONNECT_MS 3000  // how long the remembered access point gets before a full scan
+#define WIFI_CONNECT_TIMEOUT_MS 10000 // then the setup AP comes up
+#define WIFI_RETRY_MIN_MS 15000
+#define WIFI_RETRY_MAX_MS 300000
+
+enum ConnectionState : uint8_t {
+    CONNECTION_OFF,
+    CONNECTION_CONNECTING,
+    CONNECTION_CONNECTED,
+    CONNECTION_ACCESS_POINT // setup AP up, station retried in the background
+};
+
+// Access point of the last successful connection, for the next one
+struct WiFiCache {
+    uint32_t ssidHash;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+};
+
+// Brings the station up without blocking: update() from loop() drives the
+// connection. The first attempt goes straight to the access point and
+// channel that worked last time, skipping the scan, and a static IP skips
+// DHCP. If the station is not up within WIFI_CONNECT_TIMEOUT_MS, the setup
+// AP comes up and the station keeps retrying behind it with a growing
+// backoff; once it connects, the AP closes as soon as no one is using it.
+class ConnectionManager {
+private:
+    const Config* config = nullptr;
+    Preferences* store = nullptr;
+    WiFiCache cache = {};
+    ConnectionState state = CONNECTION_OFF;
+    bool accessPoint = false;
+    bool mdnsStarted = false;
+    bool usingCache = false;
+    unsigned long connectStart = 0; // first attempt since start() or the link was lost
+    unsigned long attemptStart = 0;
+    unsigned long retryAt = 0;
+    unsigned long retryInterval = WIFI_RETRY_MIN_MS;
+    unsigned long startedAt = 0;
+    long reachableMs = -1; // from start() until the first way in was up
+
+    static uint32_t hash(const char* text) {
+        uint32_t value = 2166136261UL; // FNV-1a
+        while (*text) {
+            value = (value ^ (uint8_t)*text++) * 16777619UL;
+        }
+        return value;
+    }
+
+    bool cacheUsable() const {
+        return cache.channel != 0 && cache.ssidHash == hash(config->ssid);
+    }
+
+    void beginStation(bool fast) {
+        if (config->staticIp) {
+            WiFi.config(IPAddress(config->staticIp), IPAddress(config->gateway), IPAddress(config->subnet),
+                        IPAddress(config->dns ? config->dns : config->gateway));
+        }
+        usingCache = fast && cacheUsable();
+        if (usingCache) {
+            WiFi.begin(config->ssid, config->password, cache.channel, cache.bssid);
+        } else {
+            WiFi.begin(config->ssid, config->password);
+        }
+        attemptStart = millis();
+    }
+
+    void startMdns() {
+        if (mdnsStarted) return;
+        if (!MDNS.begin(WIFI_HOSTNAME)) {
+            Serial.println("Error setting up mDNS responder!");
+            return;
+        }
+        mdnsStarted = true;
+        MDNS.addService("http", "tcp", 80);
+        MDNS.addServiceTxt("http", "tcp", "model", "Henny Smart Chicken Feeder");
+        MDNS.addServiceTxt("http", "tcp", "version", "v2.0");
+        Serial.println("mDNS responder started, http://" WIFI_HOSTNAME ".local");
+    }
+
+    void markReachable() {
+        if (reachableMs < 0) reachableMs = millis() - startedAt;
+    }
+
+    void onConnected() {
+        state = CONNECTION_CONNECTED;
+        retryInterval = WIFI_RETRY_MIN_MS;
+        markReachable();
+        Serial.printf("WiFi connected in %lums%s, IP %s\n", millis() - attemptStart,
+                      usingCache ? " (remembered access point)" : "", ipToText(WiFi.localIP()).c_str());
+        startMdns();
+
+        WiFiCache current = {hash(config->ssid), {}, (uint8_t)WiFi.channel(), 0};
+        const uint8_t* bssid = WiFi.BSSID();
+        if (bssid) memcpy(current.bssid, bssid, sizeof(current.bssid));
+        if (memcmp(&current, &cache, sizeof(cache)) != 0) {
+            cache = current;
+            store->putBytes("wifiCache", &cache, sizeof(cache));
+        }
+    }
+
+    void startAccessPoint() {
+        if (accessPoint) return;
+        WiFi.mode(WIFI_AP_STA);
+        WiFi.softAP(WIFI_AP_SSID, WIFI_AP_PASSWORD);
+        WiFi.softAPsetHostname(WIFI_HOSTNAME);
+        accessPoint = true;
+        markReachable();
+        Serial.printf("Setup AP %s up at %s\n", WIFI_AP_SSID, ipToText(WiFi.softAPIP()).c_str());
+        startMdns();
+    }
+
+    void stopAccessPoint() {
+        WiFi.softAPdisconnect(true);
+        WiFi.mode(WIFI_STA);
+        accessPoint = false;
+        Serial.println("Setup AP closed");
+    }
+
+public:
+    void begin(Preferences& preferences, const Config& settings) {
+        store = &preferences;
+        config = &settings;
+        if (store->getBytes("wifiCache", &cache, sizeof(cache)) != sizeof(cache)) {
+            cache = {};
+        }
+    }
+
+    // Returns at once; update() finishes the job
+    void start() {
+        startedAt = millis();
+        reachableMs = -1;
+        retryInterval = WIFI_RETRY_MIN_MS;
+        WiFi.persistent(false); // the credentials live in Config, not in the WiFi driver's NVS
+        WiFi.setHostname(WIFI_HOSTNAME);
+        WiFi.mode(WIFI_STA);
+        if (config->ssid[0] == '\0') {
+            Serial.println("No WiFi configured");
+            startAccessPoint();
+            state = CONNECTION_ACCESS_POINT;
+            return;
+        }
+        Serial.printf("Connecting to %s\n", config->ssid);
+        state = CONNECTION_CONNECTING;
+        connectStart = millis();
+        beginStation(true);
+    }
+
+    void stop() {
+        if (mdnsStarted) MDNS.end();
+        mdnsStarted = false;
+        accessPoint = false;
+        WiFi.disconnect(true);
+        WiFi.mode(WIFI_OFF);
+        state = CONNECTION_OFF;
+    }
+
+    void update() {
+        switch (state) {
+        case CONNECTION_OFF:
+            break;
+
+        case CONNECTION_CONNECTING:
+            if (WiFi.status() == WL_CONNECTED) {
+                onConnected();
+            } else if (usingCache && millis() - attemptStart >= WIFI_CACHED_CONNECT_MS) {
+                Serial.println("Remembered access point not answering, scanning");
+                WiFi.disconnect();
+                beginStation(false);
+            } else if (millis() - connectStart >= WIFI_CONNECT_TIMEOUT_MS) {
+                Serial.println("WiFi connection failed");
+                startAccessPoint();
+                state = CONNECTION_ACCESS_POINT;
+                retryAt = millis() + retryInterval;
+            }
+            break;
+
+        case CONNECTION_CONNECTED:
+            if (WiFi.status() != WL_CONNECTED) {
+                Serial.println("WiFi connection lost, reconnecting");
+                state = CONNECTION_CONNECTING;
+                connectStart = millis();
+                WiFi.disconnect();
+                beginStation(true);
+            } else if (accessPoint && WiFi.softAPgetStationNum() == 0) {
+                stopAccessPoint();
+            }
+            break;
+
+        case CONNECTION_ACCESS_POINT:
+            if (config->ssid[0] == '\0') break;
+            if (WiFi.status() == WL_CONNECTED) {
+                onConnected();
+            } else if ((long)(millis() - retryAt) >= 0) {
+                // A station scan hops channels and drops AP clients, so
+                // wait while someone is connected to the AP
+                if (WiFi.softAPgetStationNum() == 0) {
+                    Serial.println("Retrying WiFi");
+                    WiFi.disconnect();
+                    beginStation(false);
+                    retryInterval = min(retryInterval * 2, (unsigned long)WIFI_RETRY_MAX_MS);
+                }
+                retryAt = millis() + retryInterval;
+            }
+            break;
+        }
+    }
+
+    ConnectionState getState() const { return state; }
+    bool isAccessPoint() const { return accessPoint; }
+    bool usedCache() const { return usingCache; }
+
+    // Milliseconds from start() until the station or the setup AP was up,
+    // -1 while neither is
+    long getReachableMs() const { return reachableMs; }
+};
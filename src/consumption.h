@@ -0,0 +1,150 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <time.h>
+
+#include "scheduler.h"
+
+#define ROLLUP_DAYS 14
+#define ROLLUP_WEEKS 8
+#define ROLLUP_MONTHS 12
+#define ROLLUP_TREND_DAYS 7 // complete days the depletion forecast averages over
+
+// Dispensed feed and motor time of one local day, week or month
+struct RollupBucket {
+    int32_t period; // day, week or month number, -1 while unused
+    float grams;
+    uint32_t motorMs;
+};
+
+// Running totals per day, week and month, updated as each motor run
+// finishes, so the dashboard shows real consumption without rescanning the
+// history log. Each period has a small ring indexed by its number modulo
+// the ring size; a bucket still holding an older period counts as empty,
+// so gaps while the device was off need no bookkeeping.
+class ConsumptionRollups {
+private:
+    struct Stored {
+        RollupBucket days[ROLLUP_DAYS];
+        RollupBucket weeks[ROLLUP_WEEKS];
+        RollupBucket months[ROLLUP_MONTHS];
+        int32_t firstDay;   // first day anything was recorded, -1 if none
+        float sinceRefill;  // grams dispensed since the hopper was filled
+        uint32_t refilledAt;
+    };
+
+    Stored data;
+
+    // Days since 1970-01-01 of a civil date (Howard Hinnant's algorithm)
+    static int32_t dayNumber(int year, int month, int day) {
+        year -= month <= 2;
+        int32_t era = (year >= 0 ? year : year - 399) / 400;
+        int32_t yearOfEra = year - era * 400;
+        int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    // Local day, Monday-based week and month numbers; false until the
+    // clock is set
+    static bool periods(time_t when, int32_t& day, int32_t& week, int32_t& month) {
+        if (when < MIN_VALID_EPOCH) return false;
+        struct tm local;
+        localtime_r(&when, &local);
+        day = dayNumber(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+        week = (day + 3) / 7; // 1970-01-01 was a Thursday
+        month = (local.tm_year + 1900) * 12 + local.tm_mon;
+        return true;
+    }
+
+    static RollupBucket& slot(RollupBucket* ring, size_t size, int32_t period) {
+        RollupBucket& bucket = ring[period % size];
+        if (bucket.period != period) bucket = {period, 0, 0};
+        return bucket;
+    }
+
+    static RollupBucket find(const RollupBucket* ring, size_t size, int32_t period) {
+        const RollupBucket& bucket = ring[period % size];
+        if (bucket.period == period) return bucket;
+        RollupBucket empty = {period, 0, 0};
+        return empty;
+    }
+
+    void clear() {
+        for (int i = 0; i < ROLLUP_DAYS; i++) data.days[i] = {-1, 0, 0};
+        for (int i = 0; i < ROLLUP_WEEKS; i++) data.weeks[i] = {-1, 0, 0};
+        for (int i = 0; i < ROLLUP_MONTHS; i++) data.months[i] = {-1, 0, 0};
+        data.firstDay = -1;
+        data.sinceRefill = 0;
+        data.refilledAt = 0;
+    }
+
+public:
+    void load(Preferences& preferences) {
+        if (preferences.getBytes("rollups", &data, sizeof(data)) != sizeof(data)) {
+            clear();
+        }
+    }
+
+    // Adds a finished motor run. Runs before the clock is set still count
+    // against the hopper, just not towards any day.
+    void record(Preferences& preferences, time_t when, float grams, uint32_t motorMs) {
+        data.sinceRefill += grams;
+        int32_t day = 0, week = 0, month = 0;
+        if (periods(when, day, week, month)) {
+            RollupBucket* buckets[] = {
+                &slot(data.days, ROLLUP_DAYS, day),
+                &slot(data.weeks, ROLLUP_WEEKS, week),
+                &slot(data.months, ROLLUP_MONTHS, month)
+            };
+            for (RollupBucket* bucket : buckets) {
+                bucket->grams += grams;
+                bucket->motorMs += motorMs;
+            }
+            if (data.firstDay < 0) data.firstDay = day;
+        }
+        preferences.putBytes("rollups", &data, sizeof(data));
+    }
+
+    void refill(Preferences& preferences, time_t now) {
+        data.sinceRefill = 0;
+        data.refilledAt = (uint32_t)now;
+        preferences.putBytes("rollups", &data, sizeof(data));
+    }
+
+    // Totals of the day, week or month containing now
+    RollupBucket today(time_t now) const {
+        int32_t day = 0, week = 0, month = 0;
+        if (!periods(now, day, week, month)) return {-1, 0, 0};
+        return find(data.days, ROLLUP_DAYS, day);
+    }
+
+    RollupBucket thisWeek(time_t now) const {
+        int32_t day = 0, week = 0, month = 0;
+        if (!periods(now, day, week, month)) return {-1, 0, 0};
+        return find(data.weeks, ROLLUP_WEEKS, week);
+    }
+
+    RollupBucket thisMonth(time_t now) const {
+        int32_t day = 0, week = 0, month = 0;
+        if (!periods(now, day, week, month)) return {-1, 0, 0};
+        return find(data.months, ROLLUP_MONTHS, month);
+    }
+
+    // Average grams per day over the complete days before today, up to
+    // ROLLUP_TREND_DAYS of them; 0 until one full day has been recorded
+    float trailingDailyGrams(time_t now) const {
+        int32_t day = 0, week = 0, month = 0;
+        if (!periods(now, day, week, month) || data.firstDay < 0 || data.firstDay >= day) return 0;
+        int32_t days = min(day - data.firstDay, (int32_t)ROLLUP_TREND_DAYS);
+        float grams = 0;
+        for (int32_t d = day - days; d < day; d++) {
+            grams += find(data.days, ROLLUP_DAYS, d).grams;
+        }
+        return grams / days;
+    }
+
+    float getSinceRefill() const { return data.sinceRefill; }
+    time_t getRefilledAt() const { return data.refilledAt; }
+};
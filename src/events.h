@@ -0,0 +1,112 @@
+#pragma once
+
+#include <Arduino.h>
+#include <errno.h>
+#include <lwip/sockets.h>
+
+#include "json_buffer.h"
+
+#define EVENT_MAX_SUBSCRIBERS 4
+#define EVENT_MAX_SIZE 256
+#define EVENT_HEARTBEAT_MS 15000
+#define EVENT_RETRY_MS 3000 // how long a browser waits before reconnecting
+
+// Server-Sent Events for the dashboard. A subscriber's socket is taken
+// over from the web server when it asks for /events and kept here, so
+// every event goes out the moment it happens. Writes never wait: an event
+// that does not fit into the socket's send buffer whole drops that
+// subscriber, whose browser then reconnects, instead of stalling loop().
+class EventStream {
+private:
+    int sockets[EVENT_MAX_SUBSCRIBERS];
+    unsigned long lastHeartbeat = 0;
+
+    static bool write(int& socket, const char* data, size_t length) {
+        if (lwip_send(socket, data, length, MSG_DONTWAIT) == (ssize_t)length) return true;
+        drop(socket);
+        return false;
+    }
+
+    static void drop(int& socket) {
+        lwip_close(socket);
+        socket = -1;
+    }
+
+    // Subscribers send nothing, so anything but "no data yet" means the
+    // connection is gone
+    static bool closed(int socket) {
+        char c;
+        ssize_t received = lwip_recv(socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+
+    void heartbeat() {
+        JsonBuffer<128> json;
+        json.add("uptimeS", (unsigned long)(millis() / 1000));
+        json.add("heap", (unsigned long)ESP.getFreeHeap());
+        json.add("minHeap", (unsigned long)ESP.getMinFreeHeap());
+        json.add("subscribers", (int)subscriberCount());
+        publish("heartbeat", json.finish());
+    }
+
+public:
+    EventStream() {
+        for (uint8_t i = 0; i < EVENT_MAX_SUBSCRIBERS; i++) sockets[i] = -1;
+    }
+
+    bool full() const {
+        return subscriberCount() == EVENT_MAX_SUBSCRIBERS;
+    }
+
+    // Takes over the socket of a request, closing it if there is no room
+    bool subscribe(int socket) {
+        for (uint8_t i = 0; i < EVENT_MAX_SUBSCRIBERS; i++) {
+            if (sockets[i] >= 0) continue;
+            char header[160];
+            int length = snprintf(header, sizeof(header),
+                                  "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\nConnection: close\r\n\r\nretry: %d\n\n",
+                                  EVENT_RETRY_MS);
+            if (!write(socket, header, length)) return false;
+            sockets[i] = socket;
+            Serial.printf("Event subscriber %u connected\n", i);
+            return true;
+        }
+        lwip_close(socket);
+        return false;
+    }
+
+    // data is a JSON object; nothing is formatted without subscribers
+    void publish(const char* type, const char* data) {
+        if (subscriberCount() == 0) return;
+        char message[EVENT_MAX_SIZE];
+        int length = snprintf(message, sizeof(message), "event: %s\ndata: %s\n\n", type, data);
+        if (length < 0 || length >= (int)sizeof(message)) {
+            Serial.printf("Event %s too large\n", type);
+            return;
+        }
+        for (uint8_t i = 0; i < EVENT_MAX_SUBSCRIBERS; i++) {
+            if (sockets[i] >= 0 && !write(sockets[i], message, length)) {
+                Serial.printf("Event subscriber %u too slow, dropped\n", i);
+            }
+        }
+    }
+
+    // Call from loop(): the heartbeat also finds connections that went away
+    void update() {
+        if (millis() - lastHeartbeat < EVENT_HEARTBEAT_MS) return;
+        lastHeartbeat = millis();
+        for (uint8_t i = 0; i < EVENT_MAX_SUBSCRIBERS; i++) {
+            if (sockets[i] >= 0 && closed(sockets[i])) drop(sockets[i]);
+        }
+        heartbeat();
+    }
+
+    uint8_t subscriberCount() const {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < EVENT_MAX_SUBSCRIBERS; i++) {
+            if (sockets[i] >= 0) count++;
+        }
+        return count;
+    }
+};
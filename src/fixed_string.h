@@ -0,0 +1,70 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// Text of at most Capacity - 1 characters in place, for labels and log
+// lines that String would build on the heap. What does not fit is cut off
+// and flagged by overflowed().
+template <size_t Capacity>
+class FixedString {
+private:
+    char data[Capacity];
+    size_t used = 0;
+    bool overflow = false;
+
+public:
+    FixedString() { data[0] = '\0'; }
+    FixedString(const char* text) : FixedString() { append(text); }
+
+    FixedString& append(const char* text) {
+        size_t length = strlen(text);
+        if (used + length >= Capacity) {
+            length = Capacity - 1 - used;
+            overflow = true;
+        }
+        memcpy(data + used, text, length);
+        used += length;
+        data[used] = '\0';
+        return *this;
+    }
+
+    FixedString& appendf(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(data + used, Capacity - used, format, args);
+        va_end(args);
+        if (length < 0) {
+            data[used] = '\0';
+            overflow = true;
+        } else if (used + length >= Capacity) {
+            used = Capacity - 1;
+            overflow = true;
+        } else {
+            used += length;
+        }
+        return *this;
+    }
+
+    void clear() {
+        used = 0;
+        overflow = false;
+        data[0] = '\0';
+    }
+
+    const char* c_str() const { return data; }
+    size_t length() const { return used; }
+    bool overflowed() const { return overflow; }
+
+    bool operator==(const char* other) const { return strcmp(data, other ? other : "") == 0; }
+    bool operator!=(const char* other) const { return !(*this == other); }
+};
+
+// Dotted quad of an address as IPAddress keeps it, first octet in the
+// lowest byte, without IPAddress::toString()'s String
+inline FixedString<16> ipToText(uint32_t address) {
+    FixedString<16> text;
+    text.appendf("%u.%u.%u.%u", (unsigned)(address & 0xff), (unsigned)(address >> 8 & 0xff),
+                 (unsigned)(address >> 16 & 0xff), (unsigned)(address >> 24));
+    return text;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#define HISTORY_PARTITION_LABEL "history"
+#define HISTORY_PARTITION_SUBTYPE 0x40
+#define HISTORY_SECTOR_SIZE 4096
+#define HISTORY_SECTOR_MAGIC 0x48495354 // "HIST"
+#define HISTORY_NO_SLOT 0xFF
+
+enum HistorySource : uint8_t {
+    HISTORY_SCHEDULE,
+    HISTORY_WEB,
+    HISTORY_BUTTON,
+    HISTORY_RESUMED,    // rest of a feeding cut short by a reset
+    HISTORY_CALIBRATION,
+    HISTORY_TEST,
+    HISTORY_SOURCE_COUNT
+};
+
+static const char* const HISTORY_SOURCE_NAMES[HISTORY_SOURCE_COUNT] = {
+    "schedule", "web", "button", "resumed", "calibration", "test"
+};
+
+// One motor run, 16 bytes so a sector holds a whole number of them.
+// Erased flash reads as all ones, so an unwritten slot has a timestamp of
+// 0xFFFFFFFF; check catches a record torn by a reset mid-write.
+struct HistoryRecord {
+    uint32_t timestamp;      // epoch when the relay opened again
+    uint32_t onTimeUs;       // measured relay on-time
+    float requestedGrams;    // 0 for calibration runs and tests
+    uint8_t slot;            // feeding of the day, or HISTORY_NO_SLOT
+    uint8_t source;          // HistorySource
+    uint8_t completed;       // 0 if stopped before the requested time
+    uint8_t check;
+};
+
+// Append-only log of motor runs on its own flash partition, used as a ring
+// of sectors. Each sector starts with a header carrying a sequence number,
+// so the newest sector is found at boot without any state in NVS, and its
+// erase count. Sectors are reused strictly in turn, which spreads erases
+// evenly; a sector that fails to erase or verify is skipped.
+class HistoryLog {
+private:
+    struct SectorHeader {
+        uint32_t magic;
+        uint32_t sequence;
+        uint32_t eraseCount;
+        uint32_t check;
+    };
+
+    static const uint16_t RECORDS_PER_SECTOR = (HISTORY_SECTOR_SIZE - sizeof(SectorHeader)) / sizeof(HistoryRecord);
+
+    const esp_partition_t* partition = nullptr;
+    uint16_t sectorCount = 0;
+    uint16_t headSector = 0;  // sector being appended to
+    uint16_t headRecord = 0;  // next free slot in it
+    uint32_t headSequence = 0;
+
+    static uint8_t checksum(const HistoryRecord& record) {
+        const uint8_t* bytes = (const uint8_t*)&record;
+        uint8_t sum = 0xA5;
+        for (size_t i = 0; i < offsetof(HistoryRecord, check); i++) {
+            sum = (sum << 1 | sum >> 7) ^ bytes[i];
+        }
+        return sum;
+    }
+
+    static uint32_t headerCheck(const SectorHeader& header) {
+        return header.magic ^ header.sequence ^ ~header.eraseCount;
+    }
+
+    uint32_t sectorOffset(uint16_t sector) const {
+        return (uint32_t)sector * HISTORY_SECTOR_SIZE;
+    }
+
+    uint32_t recordOffset(uint16_t sector, uint16_t index) const {
+        return sectorOffset(sector) + sizeof(SectorHeader) + (uint32_t)index * sizeof(HistoryRecord);
+    }
+
+    bool readHeader(uint16_t sector, SectorHeader& header) const {
+        return esp_partition_read(partition, sectorOffset(sector), &header, sizeof(header)) == ESP_OK &&
+               header.magic == HISTORY_SECTOR_MAGIC && header.check == headerCheck(header);
+    }
+
+    bool isErased(uint16_t sector, uint16_t index) const {
+        uint32_t timestamp;
+        if (esp_partition_read(partition, recordOffset(sector, index), &timestamp, sizeof(timestamp)) != ESP_OK) return false;
+        return timestamp == 0xFFFFFFFF;
+    }
+
+    // Records are written in order, so the used part of a sector is a prefix
+    uint16_t findFreeRecord(uint16_t sector) const {
+        uint16_t low = 0;
+        uint16_t high = RECORDS_PER_SECTOR;
+        while (low < high) {
+            uint16_t middle = (low + high) / 2;
+            if (isErased(sector, middle)) high = middle;
+            else low = middle + 1;
+        }
+        return low;
+    }
+
+    // Moves the head to the next sector that erases cleanly
+    bool advanceSector() {
+        for (uint16_t attempt = 0; attempt < sectorCount; attempt++) {
+            uint16_t sector = (headSector + 1 + attempt) % sectorCount;
+            SectorHeader old;
+            uint32_t eraseCount = readHeader(sector, old) ? old.eraseCount : 0;
+
+            SectorHeader header = {HISTORY_SECTOR_MAGIC, headSequence + 1, eraseCount + 1, 0};
+            header.check = headerCheck(header);
+            SectorHeader verify;
+            if (esp_partition_erase_range(partition, sectorOffset(sector), HISTORY_SECTOR_SIZE) == ESP_OK &&
+                esp_partition_write(partition, sectorOffset(sector), &header, sizeof(header)) == ESP_OK &&
+                readHeader(sector, verify) && verify.sequence == header.sequence) {
+                headSector = sector;
+                headRecord = 0;
+                headSequence = header.sequence;
+                return true;
+            }
+            Serial.printf("History sector %u failed, skipping it\n", sector);
+        }
+        return false;
+    }
+
+public:
+    // Walks the records oldest first, a sector at a time, so a query never
+    // holds more than one record in RAM
+    class Cursor {
+    private:
+        const HistoryLog* log;
+        uint16_t sector;
+        uint16_t index = 0;
+        uint16_t visited = 0;
+        uint32_t sequence = 0;
+
+        friend class HistoryLog;
+        Cursor(const HistoryLog* owner) : log(owner), sector(owner->headSector) {
+            nextSector();
+        }
+
+        // Skips to the next sector holding a newer header than the last one
+        void nextSector() {
+            index = 0;
+            while (visited < log->sectorCount) {
+                sector = (sector + 1) % log->sectorCount;
+                visited++;
+                SectorHeader header;
+                if (log->readHeader(sector, header) && header.sequence > sequence &&
+                    header.sequence <= log->headSequence) {
+                    sequence = header.sequence;
+                    return;
+                }
+            }
+            log = nullptr;
+        }
+
+    public:
+        // False once past the newest record; torn records are skipped
+        bool next(HistoryRecord& record) {
+            while (log) {
+                if (index >= RECORDS_PER_SECTOR) {
+                    nextSector();
+                    continue;
+                }
+                if (esp_partition_read(log->partition, log->recordOffset(sector, index), &record, sizeof(record)) != ESP_OK ||
+                    record.timestamp == 0xFFFFFFFF) {
+                    index = RECORDS_PER_SECTOR;
+                    continue;
+                }
+                index++;
+                if (record.check == checksum(record)) return true;
+            }
+            return false;
+        }
+    };
+
+    // Finds the partition and the newest sector; formats a blank partition
+    bool begin() {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE,
+                                             HISTORY_PARTITION_LABEL);
+        if (!partition) {
+            Serial.println("No history partition, feedings are not recorded");
+            return false;
+        }
+        sectorCount = partition->size / HISTORY_SECTOR_SIZE;
+
+        bool found = false;
+        for (uint16_t sector = 0; sector < sectorCount; sector++) {
+            SectorHeader header;
+            if (readHeader(sector, header) && (!found || header.sequence > headSequence)) {
+                found = true;
+                headSector = sector;
+                headSequence = header.sequence;
+            }
+        }
+
+        if (!found) {
+            headSector = sectorCount - 1; // so the first sector used is 0
+            if (!advanceSector()) {
+                partition = nullptr;
+                Serial.println("History partition unusable");
+                return false;
+            }
+        } else {
+            headRecord = findFreeRecord(headSector);
+        }
+        Serial.printf("History: %u sectors, writing sector %u at record %u\n", sectorCount, headSector, headRecord);
+        return true;
+    }
+
+    bool available() const {
+        return partition != nullptr;
+    }
+
+    bool append(HistoryRecord record) {
+        if (!partition) return false;
+        if (headRecord >= RECORDS_PER_SECTOR && !advanceSector()) return false;
+        record.check = checksum(record);
+        if (esp_partition_write(partition, recordOffset(headSector, headRecord), &record, sizeof(record)) != ESP_OK) {
+            Serial.println("History write failed");
+            return false;
+        }
+        headRecord++;
+        return true;
+    }
+
+    Cursor records() const {
+        return Cursor(this);
+    }
+
+    // Records the log holds before the oldest sector is reused
+    uint32_t capacity() const {
+        return (uint32_t)(sectorCount - 1) * RECORDS_PER_SECTOR;
+    }
+};
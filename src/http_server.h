@@ -0,0 +1,1049 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WebServer.h> // HTTPMethod, HTTPUpload
+#include <errno.h>
+#include <fcntl.h>
+#include <lwip/sockets.h>
+
+#include "metrics.h"
+#include "request_arena.h"
+#include "task_stats.h"
+
+#define HTTP_MAX_CONNECTIONS 8
+#define HTTP_MAX_ROUTES 32
+#define HTTP_MAX_REQUEST 2048          // request line, headers and a form body
+#define HTTP_MAX_ARGS 16
+#define HTTP_MAX_COLLECTED_HEADERS 4
+#define HTTP_MAX_RESPONSE_HEAD 640
+#define HTTP_ARENA_SIZE 2048           // per connection, for its response body
+#define HTTP_ARENA_SIZE_PSRAM 16384
+#define HTTP_STREAM_CHUNK 1536         // most a body source writes at a time
+#define HTTP_CHUNK_HEAD 8              // room for the chunk size line
+#define HTTP_HEAD_TIMEOUT_MS 5000      // from the first byte to the end of the headers
+#define HTTP_REQUEST_TIMEOUT_MS 10000  // default per route: headers in to last byte out
+#define HTTP_KEEPALIVE_MS 15000        // idle connection between requests
+#define HTTP_KEEPALIVE_REQUESTS 100
+#define HTTP_IDLE_POLL_MS 1000         // select() timeout without any deadline
+#define HTTP_TASK_STACK 8192
+#define HTTP_TASK_PRIORITY 2
+
+// HTTP/1.1 server for many connections at once, driven by select() on
+// non-blocking lwIP sockets from its own task. A handler runs once its
+// request is complete and only fills in the response; the task writes it
+// out as the client takes it, so a slow client holds up neither other
+// clients nor loop(). Connections stay open for further requests, and
+// each route sets how long a request may take before it is dropped.
+//
+// Handlers use the request API of the core's WebServer (arg(), send(),
+// sendHeader(), ...) and run one at a time under the lock given to
+// startTask(), which loop() holds while it works on the same state.
+// Upload handlers run without it and must keep to their own state.
+//
+// Arguments and headers are handed out as pointers into the request
+// buffer, and each connection builds its response body in an arena of
+// its own that is reset once the body is sent; only a body too large for
+// the arena goes to the heap. A body of unknown length comes from a
+// source that sendStream() registers instead: the server asks it for one
+// piece at a time, under the lock, whenever the client has taken the
+// last one, and sends each as a chunk.
+class HttpServer {
+public:
+    typedef void (*Handler)();
+
+    // Writes the next piece of a streamed body, at most size bytes, and
+    // returns its length; 0 once the body is complete
+    typedef size_t (*BodySource)(void* state, char* buffer, size_t size);
+
+private:
+    enum SlotState : uint8_t {
+        SLOT_FREE,
+        SLOT_HEAD,    // reading the request line and headers
+        SLOT_BODY,    // reading a form body into the request buffer
+        SLOT_UPLOAD,  // streaming a multipart body to an upload handler
+        SLOT_DISCARD, // skipping a body nobody reads
+        SLOT_WRITING
+    };
+
+    enum MultipartState : uint8_t {
+        MULTIPART_PREAMBLE,
+        MULTIPART_HEADERS,
+        MULTIPART_DATA,
+        MULTIPART_DONE
+    };
+
+    struct Route {
+        const char* uri;
+        HTTPMethod method;
+        Handler handler;
+        Handler uploadHandler;
+        uint32_t timeoutMs;
+        LatencyHistogram latency; // handler run time
+    };
+
+    struct Connection {
+        int socket;
+        SlotState state;
+        bool keepAlive;
+        bool http10;         // no chunked responses
+        bool headOnly;       // HEAD request: no body goes out
+        uint8_t route;       // index into routes, HTTP_MAX_ROUTES if none
+        uint16_t requests;
+        unsigned long deadline;
+        size_t used;         // bytes in request
+        size_t headLength;   // through the blank line ending the headers
+        size_t bodyLength;
+        size_t bodyReceived;
+        HTTPMethod method;
+        char* path;
+        char* query;
+        const char* collected[HTTP_MAX_COLLECTED_HEADERS];
+        char request[HTTP_MAX_REQUEST];
+
+        char head[HTTP_MAX_RESPONSE_HEAD];
+        size_t headOut;
+        size_t headSent;
+        const char* body;
+        size_t bodyOut;
+        size_t bodySent;
+        char* ownedBody;     // on the heap, freed once sent
+        RequestArena arena;  // reset once the response is sent
+
+        // A streamed body: the source's pieces go out one by one through
+        // chunk, both in the arena
+        BodySource source;
+        void* sourceState;
+        char* chunk;
+        bool sourceDone;
+    };
+
+    struct Arg {
+        const char* name;
+        const char* value;
+    };
+
+    int listener = -1;
+    uint16_t port;
+    Route routes[HTTP_MAX_ROUTES];
+    uint8_t routeCount = 0;
+    const char* headerKeys[HTTP_MAX_COLLECTED_HEADERS] = {};
+    uint8_t headerKeyCount = 0;
+    Connection connections[HTTP_MAX_CONNECTIONS];
+    SemaphoreHandle_t lock = nullptr;
+    TaskHandle_t task = nullptr;
+    TaskStats* stats = nullptr;
+    LatencyHistogram lockWait;
+
+    // The request being handled; handlers run one at a time
+    Connection* current = nullptr;
+    Arg args[HTTP_MAX_ARGS];
+    uint8_t argCount = 0;
+    int responseCode = 0;
+    const char* responseType = "";
+    char responseHeaders[HTTP_MAX_RESPONSE_HEAD / 2];
+    size_t responseHeadersUsed = 0;
+    bool closeAfterResponse = false;
+    BodySource responseSource = nullptr;
+    void* responseSourceState = nullptr;
+    char* responseBody = nullptr;
+    size_t responseBodyLength = 0;
+    size_t responseBodyCapacity = 0;
+    const char* staticBody = nullptr;
+    bool detached = false;
+    uint32_t heapBodies = 0; // bodies that did not fit their arena
+
+    // One multipart upload at a time, parsed in this buffer
+    Connection* uploader = nullptr;
+    HTTPUpload currentUpload;
+    MultipartState multipart = MULTIPART_PREAMBLE;
+    bool uploadIsFile = false;
+    char boundary[76]; // "\r\n--" and the boundary from Content-Type
+    size_t boundaryLength = 0;
+    char scratch[HTTP_UPLOAD_BUFLEN * 2];
+    size_t scratchUsed = 0;
+
+    static const char* reason(int code) {
+        switch (code) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+        }
+    }
+
+    static bool parseMethod(const char* name, HTTPMethod& method) {
+        static const struct {
+            const char* name;
+            HTTPMethod method;
+        } methods[] = {
+            {"GET", HTTP_GET}, {"POST", HTTP_POST}, {"HEAD", HTTP_HEAD}, {"PUT", HTTP_PUT},
+            {"DELETE", HTTP_DELETE}, {"PATCH", HTTP_PATCH}, {"OPTIONS", HTTP_OPTIONS}
+        };
+        for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+            if (strcmp(name, methods[i].name) == 0) {
+                method = methods[i].method;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Decodes %XX and '+' in place
+    static void urlDecode(char* text) {
+        char* out = text;
+        for (char* in = text; *in; in++) {
+            if (*in == '+') {
+                *out++ = ' ';
+            } else if (*in == '%' && hexValue(in[1]) >= 0 && hexValue(in[2]) >= 0) {
+                *out++ = (char)(hexValue(in[1]) << 4 | hexValue(in[2]));
+                in += 2;
+            } else {
+                *out++ = *in;
+            }
+        }
+        *out = '\0';
+    }
+
+    // Splits "a=1&b=2" in place into args
+    void parseArgs(char* text) {
+        while (text && *text && argCount < HTTP_MAX_ARGS) {
+            char* next = strchr(text, '&');
+            if (next) *next++ = '\0';
+            char* value = strchr(text, '=');
+            if (value) *value++ = '\0';
+            urlDecode(text);
+            if (value) urlDecode(value);
+            if (*text) args[argCount++] = {text, value ? value : ""};
+            text = next;
+        }
+    }
+
+    static char* findText(char* data, size_t length, const char* text, size_t textLength) {
+        if (length < textLength) return nullptr;
+        for (size_t i = 0; i + textLength <= length; i++) {
+            if (data[i] == text[0] && memcmp(data + i, text, textLength) == 0) return data + i;
+        }
+        return nullptr;
+    }
+
+    static ssize_t sendNow(int socket, const char* data, size_t length) {
+        return lwip_send(socket, data, length, MSG_DONTWAIT);
+    }
+
+    Connection* freeConnection() {
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            if (connections[i].state == SLOT_FREE) return &connections[i];
+        }
+        // Make room by closing a keep-alive connection waiting for its next request
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            Connection& c = connections[i];
+            if (c.state == SLOT_HEAD && c.used == 0 && c.requests > 0) {
+                close(c);
+                return &c;
+            }
+        }
+        return nullptr;
+    }
+
+    void resetRequest(Connection& c) {
+        c.state = SLOT_HEAD;
+        c.route = HTTP_MAX_ROUTES;
+        c.headLength = 0;
+        c.bodyLength = 0;
+        c.bodyReceived = 0;
+        c.headOnly = false;
+        c.path = nullptr;
+        c.query = nullptr;
+        memset(c.collected, 0, sizeof(c.collected));
+        c.headOut = c.headSent = 0;
+        c.body = nullptr;
+        c.bodyOut = c.bodySent = 0;
+        c.source = nullptr;
+        c.sourceState = nullptr;
+        c.chunk = nullptr;
+        c.sourceDone = false;
+    }
+
+    void close(Connection& c) {
+        if (uploader == &c) abortUpload();
+        if (c.socket >= 0) lwip_close(c.socket);
+        c.socket = -1;
+        free(c.ownedBody);
+        c.ownedBody = nullptr;
+        c.arena.reset();
+        c.state = SLOT_FREE;
+    }
+
+    void accept() {
+        for (;;) {
+            int socket = lwip_accept(listener, nullptr, nullptr);
+            if (socket < 0) return;
+            lwip_fcntl(socket, F_SETFL, lwip_fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+            int noDelay = 1;
+            lwip_setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            Connection* c = freeConnection();
+            if (!c) {
+                static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+                sendNow(socket, busy, sizeof(busy) - 1);
+                lwip_close(socket);
+                continue;
+            }
+            c->socket = socket;
+            c->used = 0;
+            c->requests = 0;
+            c->ownedBody = nullptr;
+            resetRequest(*c);
+            c->deadline = millis() + HTTP_HEAD_TIMEOUT_MS;
+        }
+    }
+
+    // Answers without running a handler, then closes
+    void reject(Connection& c, int code) {
+        beginResponse(c);
+        responseCode = code;
+        responseType = "text/plain";
+        closeAfterResponse = true;
+        finishResponse(c);
+    }
+
+    const Route* findRoute(const char* path, HTTPMethod method, uint8_t& index) const {
+        for (uint8_t i = 0; i < routeCount; i++) {
+            HTTPMethod routeMethod = routes[i].method;
+            if (strcmp(routes[i].uri, path) == 0 &&
+                (routeMethod == HTTP_ANY || routeMethod == method || (routeMethod == HTTP_GET && method == HTTP_HEAD))) {
+                index = i;
+                return &routes[i];
+            }
+        }
+        index = HTTP_MAX_ROUTES;
+        return nullptr;
+    }
+
+    // Splits the request line and headers in place once they are complete
+    void parseHead(Connection& c) {
+        char* end = c.request + c.headLength - 4;
+        *end = '\0';
+        char* line = c.request;
+        char* lineEnd = strstr(line, "\r\n");
+        if (lineEnd) *lineEnd = '\0';
+
+        char* target = strchr(line, ' ');
+        char* version = target ? strchr(target + 1, ' ') : nullptr;
+        if (!target || !version) {
+            reject(c, 400);
+            return;
+        }
+        *target++ = '\0';
+        *version++ = '\0';
+        if (!parseMethod(line, c.method)) {
+            reject(c, 400);
+            return;
+        }
+        c.headOnly = c.method == HTTP_HEAD;
+        c.path = target;
+        c.query = strchr(target, '?');
+        if (c.query) *c.query++ = '\0';
+        c.http10 = strcmp(version, "HTTP/1.0") == 0;
+        c.keepAlive = !c.http10;
+
+        bool multipartBody = false;
+        bool formBody = false;
+        bool expectContinue = false;
+        const char* boundaryValue = nullptr;
+        for (line = lineEnd ? lineEnd + 2 : end; line < end; line = lineEnd + 2) {
+            lineEnd = strstr(line, "\r\n");
+            if (!lineEnd) lineEnd = end;
+            *lineEnd = '\0';
+            char* value = strchr(line, ':');
+            if (!value) continue;
+            *value++ = '\0';
+            while (*value == ' ') value++;
+
+            if (strcasecmp(line, "Content-Length") == 0) {
+                c.bodyLength = strtoul(value, nullptr, 10);
+            } else if (strcasecmp(line, "Content-Type") == 0) {
+                formBody = strncasecmp(value, "application/x-www-form-urlencoded", 33) == 0;
+                multipartBody = strncasecmp(value, "multipart/form-data", 19) == 0;
+                const char* found = strstr(value, "boundary=");
+                if (found) boundaryValue = found + 9;
+            } else if (strcasecmp(line, "Connection") == 0) {
+                if (strcasecmp(value, "close") == 0) c.keepAlive = false;
+                else if (strcasecmp(value, "keep-alive") == 0) c.keepAlive = true;
+            } else if (strcasecmp(line, "Expect") == 0) {
+                expectContinue = strcasecmp(value, "100-continue") == 0;
+            }
+            for (uint8_t i = 0; i < headerKeyCount; i++) {
+                if (strcasecmp(line, headerKeys[i]) == 0) c.collected[i] = value;
+            }
+        }
+
+        const Route* route = findRoute(c.path, c.method, c.route);
+        c.deadline = millis() + (route ? route->timeoutMs : HTTP_REQUEST_TIMEOUT_MS);
+        if (c.bodyLength == 0) {
+            dispatch(c);
+            return;
+        }
+        if (expectContinue) {
+            static const char proceed[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            sendNow(c.socket, proceed, sizeof(proceed) - 1);
+        }
+
+        if (route && route->uploadHandler && multipartBody && boundaryValue) {
+            if (uploader || strlen(boundaryValue) > sizeof(boundary) - 5) {
+                reject(c, 503);
+                return;
+            }
+            beginUpload(c, boundaryValue);
+        } else if (formBody && c.headLength + c.bodyLength < sizeof(c.request)) {
+            c.state = SLOT_BODY;
+        } else if (formBody) {
+            reject(c, 413);
+            return;
+        } else {
+            c.state = SLOT_DISCARD;
+        }
+        takeBody(c, c.used - c.headLength);
+    }
+
+    // Handles the last length bytes read into the request buffer, which
+    // belong to the body
+    void takeBody(Connection& c, size_t length) {
+        char* data = c.request + c.used - length;
+        length = min(length, c.bodyLength - c.bodyReceived);
+        c.bodyReceived += length;
+        if (c.state == SLOT_UPLOAD) {
+            // On to the multipart parser; the request buffer keeps the head only
+            while (length > 0 && uploader == &c) {
+                size_t chunk = min(length, sizeof(scratch) - scratchUsed);
+                memcpy(scratch + scratchUsed, data, chunk);
+                scratchUsed += chunk;
+                data += chunk;
+                length -= chunk;
+                parseMultipart(c.bodyReceived == c.bodyLength && length == 0);
+            }
+            c.used = c.headLength;
+        } else if (c.state == SLOT_DISCARD) {
+            c.used = c.headLength;
+        }
+        if (c.bodyReceived == c.bodyLength) dispatch(c);
+    }
+
+    void beginUpload(Connection& c, const char* boundaryValue) {
+        uploader = &c;
+        c.state = SLOT_UPLOAD;
+        multipart = MULTIPART_PREAMBLE;
+        uploadIsFile = false;
+        boundaryLength = snprintf(boundary, sizeof(boundary), "\r\n--%s", boundaryValue);
+        // The first delimiter has no line break before it; with one in
+        // front, every delimiter looks the same
+        scratch[0] = '\r';
+        scratch[1] = '\n';
+        scratchUsed = 2;
+        currentUpload.totalSize = 0;
+        currentUpload.currentSize = 0;
+    }
+
+    void callUpload(HTTPUploadStatus status) {
+        currentUpload.status = status;
+        routes[uploader->route].uploadHandler();
+    }
+
+    void emitUploadData(const char* data, size_t length) {
+        while (length > 0) {
+            size_t chunk = min(length, (size_t)HTTP_UPLOAD_BUFLEN);
+            memcpy(currentUpload.buf, data, chunk);
+            currentUpload.currentSize = chunk;
+            currentUpload.totalSize += chunk;
+            callUpload(UPLOAD_FILE_WRITE);
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    static String partParameter(const char* headers, const char* name) {
+        char key[16];
+        snprintf(key, sizeof(key), " %s=\"", name);
+        const char* start = strstr(headers, key);
+        if (!start) return String();
+        start += strlen(key);
+        const char* end = strchr(start, '"');
+        if (!end) return String();
+        return String(start).substring(0, end - start);
+    }
+
+    void consumeScratch(size_t length) {
+        memmove(scratch, scratch + length, scratchUsed - length);
+        scratchUsed -= length;
+    }
+
+    // Works through scratch as far as it can; last is set once the whole
+    // body is in
+    void parseMultipart(bool last) {
+        for (;;) {
+            if (multipart == MULTIPART_DONE) {
+                scratchUsed = 0;
+                return;
+            }
+            if (multipart == MULTIPART_HEADERS) {
+                char* end = findText(scratch, scratchUsed, "\r\n\r\n", 4);
+                if (!end) {
+                    if (scratchUsed == sizeof(scratch) || last) multipart = MULTIPART_DONE; // malformed
+                    if (multipart == MULTIPART_DONE) continue;
+                    return;
+                }
+                *end = '\0';
+                String filename = partParameter(scratch, "filename");
+                if (filename.length() > 0) {
+                    currentUpload.filename = filename;
+                    currentUpload.name = partParameter(scratch, "name");
+                    currentUpload.type = "application/octet-stream";
+                    currentUpload.totalSize = 0;
+                    currentUpload.currentSize = 0;
+                    uploadIsFile = true;
+                    callUpload(UPLOAD_FILE_START);
+                }
+                consumeScratch(end + 4 - scratch);
+                multipart = MULTIPART_DATA;
+                continue;
+            }
+
+            // Preamble or part data, up to the next delimiter
+            char* found = findText(scratch, scratchUsed, boundary, boundaryLength);
+            bool complete = found && (found + boundaryLength + 2 <= scratch + scratchUsed || last);
+            size_t data;
+            if (found) {
+                data = found - scratch;
+            } else {
+                // The tail may be the start of a delimiter
+                data = scratchUsed - min(scratchUsed, boundaryLength - 1);
+            }
+            if (multipart == MULTIPART_DATA && uploadIsFile) emitUploadData(scratch, data);
+            consumeScratch(data);
+            if (!complete) {
+                if (last) multipart = MULTIPART_DONE;
+                else return;
+                continue;
+            }
+            if (multipart == MULTIPART_DATA && uploadIsFile) {
+                callUpload(UPLOAD_FILE_END);
+                uploadIsFile = false;
+            }
+            bool closing = scratchUsed >= boundaryLength + 2 && scratch[boundaryLength] == '-' &&
+                         scratch[boundaryLength + 1] == '-';
+            consumeScratch(min(scratchUsed, boundaryLength + 2)); // the delimiter and its line break
+            multipart = closing ? MULTIPART_DONE : MULTIPART_HEADERS;
+        }
+    }
+
+    void abortUpload() {
+        if (uploadIsFile) callUpload(UPLOAD_FILE_ABORTED);
+        uploadIsFile = false;
+        uploader = nullptr;
+    }
+
+    void beginResponse(Connection& c) {
+        current = &c;
+        argCount = 0;
+        responseCode = 0;
+        responseType = "";
+        responseHeadersUsed = 0;
+        responseHeaders[0] = '\0';
+        closeAfterResponse = !c.keepAlive || c.requests + 1 >= HTTP_KEEPALIVE_REQUESTS;
+        responseSource = nullptr;
+        responseSourceState = nullptr;
+        responseBody = nullptr;
+        responseBodyLength = 0;
+        responseBodyCapacity = 0;
+        staticBody = nullptr;
+        detached = false;
+    }
+
+    // Runs the route's handler on a complete request
+    void dispatch(Connection& c) {
+        if (uploader == &c) {
+            if (uploadIsFile) callUpload(UPLOAD_FILE_ABORTED); // body ended inside the file
+            uploadIsFile = false;
+            uploader = nullptr;
+        }
+        beginResponse(c);
+        parseArgs(c.query);
+        // The byte after a form body may start a pipelined request. Only a
+        // body kept in the request buffer has one there; an upload's or a
+        // discarded body's length is far past the buffer.
+        char* bodyEnd = nullptr;
+        char afterBody = '\0';
+        if (c.state == SLOT_BODY) {
+            bodyEnd = c.request + c.headLength + c.bodyLength;
+            afterBody = *bodyEnd;
+            *bodyEnd = '\0';
+            parseArgs(c.request + c.headLength);
+        }
+
+        if (c.route < routeCount) {
+            uint32_t waiting = ESP.getCycleCount();
+            if (lock) xSemaphoreTake(lock, portMAX_DELAY);
+            uint32_t started = lockWait.recordSince(waiting);
+            routes[c.route].handler();
+            routes[c.route].latency.recordSince(started);
+            if (lock) xSemaphoreGive(lock);
+        } else {
+            send(404, "text/plain", "Not found");
+        }
+        if (detached) {
+            // The handler took the connection over
+            if (!c.arena.owns(responseBody)) free(responseBody);
+            c.arena.reset();
+            c.socket = -1;
+            c.state = SLOT_FREE;
+            current = nullptr;
+            return;
+        }
+        if (bodyEnd) *bodyEnd = afterBody;
+        if (responseCode == 0) send(500, "text/plain", "No response");
+        finishResponse(c);
+    }
+
+    void finishResponse(Connection& c) {
+        const char* body = staticBody ? staticBody : responseBody;
+        char length[32];
+        if (!responseSource) snprintf(length, sizeof(length), "Content-Length: %u", (unsigned)responseBodyLength);
+        else if (c.http10) closeAfterResponse = true; // the end of the body is the end of the connection
+        else strcpy(length, "Transfer-Encoding: chunked");
+        bool framed = !responseSource || !c.http10;
+        c.headOut = snprintf(c.head, sizeof(c.head),
+                             "HTTP/1.1 %d %s\r\n%s%s%s%s%sConnection: %s\r\n%s\r\n",
+                             responseCode, reason(responseCode), *responseType ? "Content-Type: " : "",
+                             responseType, *responseType ? "\r\n" : "", framed ? length : "", framed ? "\r\n" : "",
+                             closeAfterResponse ? "close" : "keep-alive", responseHeaders);
+        c.headOut = min(c.headOut, sizeof(c.head) - 1);
+        c.headSent = 0;
+        c.body = c.headOnly ? nullptr : body;
+        c.bodyOut = c.headOnly ? 0 : responseBodyLength;
+        c.bodySent = 0;
+        c.ownedBody = c.arena.owns(responseBody) ? nullptr : responseBody;
+        if (responseSource && !c.headOnly) {
+            c.source = responseSource;
+            c.sourceState = responseSourceState;
+            c.chunk = responseBody;
+            c.body = nullptr;
+            c.bodyOut = 0;
+        }
+        c.keepAlive = !closeAfterResponse;
+        c.state = SLOT_WRITING;
+        current = nullptr;
+        write(c);
+    }
+
+    void write(Connection& c) {
+        while (c.headSent < c.headOut) {
+            ssize_t sent = sendNow(c.socket, c.head + c.headSent, c.headOut - c.headSent);
+            if (sent <= 0) {
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                close(c);
+                return;
+            }
+            c.headSent += sent;
+        }
+        for (;;) {
+            while (c.bodySent < c.bodyOut) {
+                ssize_t sent = sendNow(c.socket, c.body + c.bodySent, c.bodyOut - c.bodySent);
+                if (sent <= 0) {
+                    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+                    close(c);
+                    return;
+                }
+                c.bodySent += sent;
+            }
+            if (!c.source || !nextChunk(c)) break;
+        }
+
+        free(c.ownedBody);
+        c.ownedBody = nullptr;
+        c.arena.reset();
+        if (!c.keepAlive) {
+            close(c);
+            return;
+        }
+        // Keep what the client already sent of its next request
+        size_t consumed = c.headLength + c.bodyLength;
+        if (c.used > consumed) {
+            memmove(c.request, c.request + consumed, c.used - consumed);
+            c.used -= consumed;
+        } else {
+            c.used = 0;
+        }
+        c.requests++;
+        resetRequest(c);
+        c.deadline = millis() + HTTP_KEEPALIVE_MS;
+        if (c.used > 0) scanHead(c);
+    }
+
+    // Asks a streamed body's source for its next piece and frames it as a
+    // chunk; false once the last chunk has gone out
+    bool nextChunk(Connection& c) {
+        if (c.sourceDone) return false;
+        char* data = c.chunk + HTTP_CHUNK_HEAD;
+        uint32_t waiting = ESP.getCycleCount();
+        if (lock) xSemaphoreTake(lock, portMAX_DELAY);
+        lockWait.recordSince(waiting);
+        size_t length = c.source(c.sourceState, data, HTTP_STREAM_CHUNK);
+        if (lock) xSemaphoreGive(lock);
+        length = min(length, (size_t)HTTP_STREAM_CHUNK);
+        c.sourceDone = length == 0;
+        if (c.http10) {
+            c.body = data;
+            c.bodyOut = length;
+        } else {
+            char size[HTTP_CHUNK_HEAD + 1];
+            size_t sizeLength = snprintf(size, sizeof(size), "%x\r\n", (unsigned)length);
+            memcpy(data - sizeLength, size, sizeLength);
+            memcpy(data + length, "\r\n", 2);
+            c.body = data - sizeLength;
+            c.bodyOut = sizeLength + length + 2;
+        }
+        c.bodySent = 0;
+        return true;
+    }
+
+    // Looks for the end of the headers in what has been read so far
+    void scanHead(Connection& c) {
+        char* end = findText(c.request, c.used, "\r\n\r\n", 4);
+        if (end) {
+            c.headLength = end + 4 - c.request;
+            parseHead(c);
+        } else if (c.used >= sizeof(c.request) - 1) {
+            reject(c, 431);
+        }
+    }
+
+    void read(Connection& c) {
+        size_t room = sizeof(c.request) - 1 - c.used;
+        if (room == 0) {
+            if (c.state == SLOT_HEAD) reject(c, 431);
+            return;
+        }
+        ssize_t received = lwip_recv(c.socket, c.request + c.used, room, MSG_DONTWAIT);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close(c);
+            return;
+        }
+        if (received < 0) return;
+        bool firstByte = c.used == 0 && c.state == SLOT_HEAD;
+        c.used += received;
+        if (c.state == SLOT_HEAD) {
+            if (firstByte) c.deadline = millis() + HTTP_HEAD_TIMEOUT_MS;
+            scanHead(c);
+        } else {
+            takeBody(c, received);
+        }
+    }
+
+    void expire(Connection& c) {
+        bool midRequest = c.state != SLOT_WRITING && (c.used > 0 || c.state != SLOT_HEAD);
+        if (midRequest) {
+            static const char timeout[] = "HTTP/1.1 408 Request Timeout\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            sendNow(c.socket, timeout, sizeof(timeout) - 1);
+        }
+        close(c);
+    }
+
+    static void run(void* arg) {
+        HttpServer* server = (HttpServer*)arg;
+        for (;;) {
+            server->poll(HTTP_IDLE_POLL_MS);
+        }
+    }
+
+public:
+    HttpServer(uint16_t listenPort = 80) : port(listenPort) {
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            connections[i].socket = -1;
+            connections[i].state = SLOT_FREE;
+            connections[i].ownedBody = nullptr;
+            connections[i].source = nullptr;
+        }
+    }
+
+    // timeoutMs: from the end of the request headers until the response
+    // is written, after which the connection is dropped
+    void on(const char* uri, Handler handler) { on(uri, HTTP_ANY, handler); }
+    void on(const char* uri, HTTPMethod method, Handler handler) { on(uri, method, handler, nullptr); }
+    void on(const char* uri, HTTPMethod method, Handler handler, Handler uploadHandler,
+            uint32_t timeoutMs = HTTP_REQUEST_TIMEOUT_MS) {
+        if (routeCount == HTTP_MAX_ROUTES) {
+            Serial.printf("Too many routes, %s not served\n", uri);
+            return;
+        }
+        routes[routeCount++] = {uri, method, handler, uploadHandler, timeoutMs, LatencyHistogram()};
+    }
+
+    void collectHeaders(const char* keys[], size_t count) {
+        headerKeyCount = min(count, (size_t)HTTP_MAX_COLLECTED_HEADERS);
+        for (uint8_t i = 0; i < headerKeyCount; i++) headerKeys[i] = keys[i];
+    }
+
+    bool begin() {
+        // Taken once and kept, so serving leaves no holes in the heap
+        size_t arenaSize = HTTP_ARENA_SIZE;
+#ifdef BOARD_HAS_PSRAM
+        if (psramFound()) arenaSize = HTTP_ARENA_SIZE_PSRAM;
+#endif
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            if (!connections[i].arena.begin(arenaSize)) Serial.println("HTTP server: no memory for a request arena");
+        }
+        listener = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener < 0) {
+            Serial.println("HTTP server: no socket");
+            return false;
+        }
+        int reuse = 1;
+        lwip_setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (lwip_bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 ||
+            lwip_listen(listener, HTTP_MAX_CONNECTIONS) < 0) {
+            Serial.printf("HTTP server: cannot listen on port %u\n", port);
+            lwip_close(listener);
+            listener = -1;
+            return false;
+        }
+        lwip_fcntl(listener, F_SETFL, lwip_fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+        return true;
+    }
+
+    // Serves from a task of its own; handlers run holding stateLock.
+    // taskStats, if given, times each pass after select() returns,
+    // including any wait for the lock.
+    bool startTask(SemaphoreHandle_t stateLock, BaseType_t core, TaskStats* taskStats = nullptr) {
+        lock = stateLock;
+        stats = taskStats;
+        if (xTaskCreatePinnedToCore(run, "http", HTTP_TASK_STACK, this, HTTP_TASK_PRIORITY, &task, core) != pdPASS) {
+            return false;
+        }
+        if (stats) stats->handle = task;
+        return true;
+    }
+
+    TaskHandle_t getTask() const { return task; }
+
+    // Waits up to waitMs for socket activity or a deadline, then does all
+    // the reading, handling and writing that is possible without blocking
+    void poll(uint32_t waitMs) {
+        if (listener < 0) {
+            delay(waitMs);
+            return;
+        }
+        fd_set readable, writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        FD_SET(listener, &readable);
+        int highest = listener;
+        unsigned long now = millis();
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            Connection& c = connections[i];
+            if (c.state == SLOT_FREE) continue;
+            if (c.state == SLOT_WRITING) FD_SET(c.socket, &writable);
+            else FD_SET(c.socket, &readable);
+            highest = max(highest, c.socket);
+            long left = (long)(c.deadline - now);
+            waitMs = min(waitMs, (uint32_t)max(left, 1L));
+        }
+        struct timeval timeout = {(time_t)(waitMs / 1000), (suseconds_t)(waitMs % 1000 * 1000)};
+        if (lwip_select(highest + 1, &readable, &writable, nullptr, &timeout) < 0) return;
+
+        if (stats) stats->begin();
+        if (FD_ISSET(listener, &readable)) accept();
+        now = millis();
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            Connection& c = connections[i];
+            if (c.state == SLOT_FREE) continue;
+            if (c.state == SLOT_WRITING && FD_ISSET(c.socket, &writable)) write(c);
+            else if (c.state != SLOT_WRITING && FD_ISSET(c.socket, &readable)) read(c);
+            if (c.state != SLOT_FREE && (long)(now - c.deadline) >= 0) expire(c);
+        }
+        if (stats) stats->end();
+    }
+
+    // Per route for metrics, in the order they were added
+    uint8_t routesAdded() const { return routeCount; }
+    const char* routeUri(uint8_t route) const { return routes[route].uri; }
+    HTTPMethod routeMethod(uint8_t route) const { return routes[route].method; }
+    const LatencyHistogram& routeLatency(uint8_t route) const { return routes[route].latency; }
+
+    // How long handlers waited for the state lock, i.e. for loop()
+    const LatencyHistogram& lockWaits() const { return lockWait; }
+
+    // Most any one request took of its connection's arena so far
+    size_t arenaHighWater() const {
+        size_t most = 0;
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) most = max(most, connections[i].arena.highWater());
+        return most;
+    }
+    size_t arenaSize() const { return connections[0].arena.size(); }
+    uint32_t heapBodyCount() const { return heapBodies; }
+
+    static const char* methodName(HTTPMethod method) {
+        static const char* const names[] = {"ANY", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"};
+        return method <= HTTP_OPTIONS ? names[method] : "?";
+    }
+
+    uint8_t activeConnections() const {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+            if (connections[i].state != SLOT_FREE) count++;
+        }
+        return count;
+    }
+
+    // Request API for handlers
+
+    bool hasArg(const char* name) const {
+        for (uint8_t i = 0; i < argCount; i++) {
+            if (strcmp(args[i].name, name) == 0) return true;
+        }
+        return false;
+    }
+
+    // Valid until the handler returns; "" if missing
+    const char* arg(const char* name) const {
+        for (uint8_t i = 0; i < argCount; i++) {
+            if (strcmp(args[i].name, name) == 0) return args[i].value;
+        }
+        return "";
+    }
+
+    // Only headers named in collectHeaders() are kept; "" if missing
+    const char* header(const char* name) const {
+        if (!current) return "";
+        for (uint8_t i = 0; i < headerKeyCount; i++) {
+            if (strcasecmp(headerKeys[i], name) == 0 && current->collected[i]) return current->collected[i];
+        }
+        return "";
+    }
+
+    HTTPUpload& upload() { return currentUpload; }
+
+    // Response API for handlers
+
+    void sendHeader(const char* name, const char* value, bool first = false) {
+        if (strcasecmp(name, "Connection") == 0) {
+            if (strcasecmp(value, "close") == 0) closeAfterResponse = true;
+            return;
+        }
+        int length = snprintf(responseHeaders + responseHeadersUsed, sizeof(responseHeaders) - responseHeadersUsed,
+                              "%s: %s\r\n", name, value);
+        if (length > 0 && responseHeadersUsed + length < sizeof(responseHeaders)) {
+            responseHeadersUsed += length;
+        } else {
+            responseHeaders[responseHeadersUsed] = '\0';
+            Serial.printf("Response header %s dropped\n", name);
+        }
+    }
+    void send(int code, const char* contentType = nullptr, const char* content = "") {
+        send_P(code, contentType, content, strlen(content));
+    }
+
+    // Copies the body, so it may live on the handler's stack
+    void send_P(int code, PGM_P contentType, PGM_P content, size_t length) {
+        responseCode = code;
+        responseType = contentType ? contentType : "";
+        responseSource = nullptr;
+        responseBodyLength = 0;
+        sendContent(content, length);
+    }
+    void send_P(int code, PGM_P contentType, PGM_P content) { send_P(code, contentType, content, strlen(content)); }
+
+    // For data in flash that outlives the response: sent without a copy
+    void sendStatic(int code, const char* contentType, const uint8_t* content, size_t length) {
+        responseCode = code;
+        responseType = contentType;
+        responseSource = nullptr;
+        staticBody = (const char*)content;
+        responseBodyLength = length;
+    }
+
+    // A body of unknown length, e.g. a log or a scrape, that source writes
+    // piece by piece while the client takes it, so it is never held whole.
+    // state must stay valid until then and need no destructor; keep it in
+    // requestMemory(). Between pieces the lock is released and other
+    // requests and loop() run.
+    void sendStream(int code, const char* contentType, BodySource source, void* state) {
+        responseCode = code;
+        responseType = contentType ? contentType : "";
+        responseBodyLength = 0;
+        responseBody = (char*)requestMemory(HTTP_CHUNK_HEAD + HTTP_STREAM_CHUNK + 2);
+        if (!responseBody) {
+            send(503, "text/plain", "No memory for the response");
+            return;
+        }
+        responseSource = source;
+        responseSourceState = state;
+    }
+
+    // Memory that lasts until the current request's response is sent,
+    // from the connection's arena; null if the arena is full
+    void* requestMemory(size_t size) {
+        return current ? current->arena.allocate(size) : nullptr;
+    }
+
+    void sendContent(const char* content, size_t length) {
+        if (length == 0) return;
+        size_t needed = responseBodyLength + length;
+        RequestArena* arena = current ? &current->arena : nullptr;
+        if (needed > responseBodyCapacity && arena && !responseBody) {
+            responseBody = (char*)arena->allocate(needed);
+            if (responseBody) responseBodyCapacity = needed;
+        } else if (needed > responseBodyCapacity && arena && arena->extend(responseBody, needed)) {
+            responseBodyCapacity = needed;
+        }
+        if (needed > responseBodyCapacity) {
+            // Past what the arena holds: on to the heap, where it doubles
+            bool inArena = arena && arena->owns(responseBody);
+            if (inArena || !responseBody) heapBodies++;
+            size_t capacity = max(responseBodyCapacity * 2, needed);
+            char* grown = (char*)(inArena ? malloc(capacity) : realloc(responseBody, capacity));
+            if (grown && inArena) memcpy(grown, responseBody, responseBodyLength);
+            if (!grown) {
+                Serial.println("No memory for the response body");
+                if (!inArena) free(responseBody);
+                responseBody = nullptr;
+                responseBodyLength = responseBodyCapacity = 0;
+                responseCode = 503;
+                closeAfterResponse = true;
+                return;
+            }
+            responseBody = grown;
+            responseBodyCapacity = capacity;
+        }
+        memcpy(responseBody + responseBodyLength, content, length);
+        responseBodyLength += length;
+    }
+    void sendContent(const char* content) { sendContent(content, strlen(content)); }
+
+    // Hands the request's socket to the caller, e.g. for an event stream;
+    // the server forgets it and sends nothing
+    int takeConnection() {
+        if (!current) return -1;
+        detached = true;
+        return current->socket;
+    }
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string.h>
+
+#include "generated/i18n_table.h"
+
+// UI text lookup. The table itself is generated from web/i18n.json, so
+// adding a string or a language never touches this file.
+inline const char* tr(TextId id, Language language) {
+    return TEXTS[language][id];
+}
+
+// Maps a language code ("de", "en", ...) to its Language; false if unknown
+inline bool parseLanguage(const char* code, Language& language) {
+    for (uint8_t i = 0; i < LANGUAGE_COUNT; i++) {
+        if (strcmp(code, LANGUAGE_CODES[i]) == 0) {
+            language = (Language)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+// Serializes a JSON object into a fixed-size buffer without touching the
+// heap. Output that does not fit is dropped and flagged by overflowed().
+template <size_t Capacity>
+class JsonBuffer {
+private:
+    char data[Capacity];
+    size_t used = 0;
+    bool needComma = false;
+    bool overflow = false;
+
+    void append(const char* text, size_t length) {
+        if (used + length >= Capacity) {
+            overflow = true;
+            return;
+        }
+        memcpy(data + used, text, length);
+        used += length;
+        data[used] = '\0';
+    }
+
+    void appendf(const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(data + used, Capacity - used, format, args);
+        va_end(args);
+        if (length < 0 || used + length >= Capacity) {
+            overflow = true;
+            data[used] = '\0';
+            return;
+        }
+        used += length;
+    }
+
+    void appendEscaped(const char* text) {
+        append("\"", 1);
+        for (const char* c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                char escaped[2] = {'\\', *c};
+                append(escaped, 2);
+            } else if ((uint8_t)*c < 0x20) {
+                appendf("\\u%04x", (uint8_t)*c);
+            } else {
+                append(c, 1);
+            }
+        }
+        append("\"", 1);
+    }
+
+    // A null name starts an array element instead of an object member
+    void key(const char* name) {
+        if (needComma) append(",", 1);
+        if (name) {
+            appendEscaped(name);
+            append(":", 1);
+        }
+        needComma = true;
+    }
+
+public:
+    JsonBuffer() {
+        data[0] = '\0';
+        append("{", 1);
+    }
+
+    void add(const char* name, const char* value) {
+        key(name);
+        appendEscaped(value);
+    }
+
+    void add(const char* name, int value) {
+        key(name);
+        appendf("%d", value);
+    }
+
+    void add(const char* name, unsigned long value) {
+        key(name);
+        appendf("%lu", value);
+    }
+
+    void add(const char* name, float value, int decimals) {
+        key(name);
+        appendf("%.*f", decimals, value);
+    }
+
+    void add(const char* name, bool value) {
+        key(name);
+        if (value) append("true", 4);
+        else append("false", 5);
+    }
+
+    void beginObject(const char* name) {
+        key(name);
+        append("{", 1);
+        needComma = false;
+    }
+
+    void endObject() {
+        append("}", 1);
+        needComma = true;
+    }
+    
+    // Elements are added with a null name, e.g. beginObject(nullptr)
+    void beginArray(const char* name) {
+        key(name);
+        append("[", 1);
+        needComma = false;
+    }
+    
+    void endArray() {
+        append("]", 1);
+        needComma = true;
+    }
+
+    // Closes the top-level object; call once before sending
+    const char* finish() {
+        append("}", 1);
+        return data;
+    }
+
+    size_t length() const { return used; }
+    bool overflowed() const { return overflow; }
+};
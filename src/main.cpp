@@ -1,12 +1,35 @@
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WebServer.h>
 #include <Update.h>
 #include <ArduinoOTA.h>
-#include <ESPmDNS.h>
 #include <time.h>
 #include <Preferences.h>
 #include <math.h>
+#include <new>
+#include <esp_timer.h>
+#include <esp_sntp.h>
+#include <soc/gpio_struct.h>
+
+#include "http_server.h"
+#include "web_asset.h"
+#include "json_buffer.h"
+#include "fixed_string.h"
+#include "response_cache.h"
+#include "calibration.h"
+#include "scheduler.h"
+#include "power.h"
+#include "config.h"
+#include "history.h"
+#include "consumption.h"
+#include "connection.h"
+#include "time_service.h"
+#include "events.h"
+#include "i18n.h"
+#include "spsc_queue.h"
+#include "snapshot.h"
+#include "task_stats.h"
+#include "metrics.h"
+#include "generated/web_assets.h"
 
 #define RELAY_PIN 1     // D0/GPIO1 on XIAO ESP32-S3
 #define LED_PIN 48      // Built-in RGB LED on XIAO ESP32-S3  
@@ -14,30 +37,302 @@
 
 #define MOTOR_TIMEOUT_MS 30000
 #define CALIBRATION_DURATION_MS 10000
+#define CALIBRATION_MIN_DURATION_MS 1000UL
+#define MOTOR_TEST_DURATION_MS 3000
+#define MOTOR_QUEUE_SIZE 8
+#define MOTOR_RESULT_COUNT 8
+#define MOTOR_JOURNAL_INTERVAL_MS 1000
+#define MOTOR_COMMAND_QUEUE_SIZE 8  // per producing task
+#define MOTOR_EVENT_QUEUE_SIZE 16
+#define MOTOR_TASK_STACK 4096
+#define MOTOR_TASK_PRIORITY 5       // above the web server and loop()
+#define MOTOR_TASK_CORE 1
+#define SAFETY_TIMER_NUM 0
 #define BUTTON_LONG_PRESS_MS 3000
+#define STATUS_CACHE_SIZE 1536
+#define HISTORY_RECORD_JSON_MAX 160
+#define HTTP_TASK_CORE 0            // loop() runs on core 1
+#define HISTORY_TIMEOUT_MS 30000    // a full history is a few hundred KB
+#define UPDATE_TIMEOUT_MS 300000    // a firmware image over a weak link
+#define RESTART_DELAY_MS 2000       // lets the response reach the browser first
+#define OTA_TASK_STACK 4096
+#define OTA_TASK_PRIORITY 1
+#define OTA_TASK_CORE 0
+#define OTA_POLL_MS 1000            // an upload starts within a poll or two
+#define TASKS_JSON_SIZE 1024
 
-WebServer server(80);
+HttpServer server(80);
+SemaphoreHandle_t stateLock; // loop() and the web server's handlers take turns
+unsigned long restartAt = 0; // 0: no restart scheduled
 Preferences preferences;
+HistoryLog history;
+ConsumptionRollups consumption;
+EventStream events;
+TaskMonitor taskMonitor;
+TaskStats* loopStats = nullptr;
+TaskStats* otaStats = nullptr;
 
-class Spreader {
+enum LoopPhase : uint8_t {
+    PHASE_MOTOR_EVENTS,
+    PHASE_CONNECTION,
+    PHASE_CONFIG_COMMIT,
+    PHASE_TIME,
+    PHASE_EVENTS,
+    PHASE_SCHEDULER,
+    LOOP_PHASE_COUNT
+};
+
+static const char* const LOOP_PHASE_NAMES[] = {"motor_events", "connection", "config_commit", "time", "events", "scheduler"};
+
+// Each phase of loop() and the whole pass, which is how long loop() holds
+// the state lock
+LatencyHistogram loopPhases[LOOP_PHASE_COUNT];
+LatencyHistogram loopPasses;
+
+// Bumped on every settings change and recorded motor run; part of the
+// /api/status cache key
+uint32_t configGeneration = 0;
+
+enum MotorJobType : uint8_t {
+    JOB_FEED,
+    JOB_CALIBRATION,
+    JOB_TEST
+};
+
+static const char* const JOB_TYPE_NAMES[] = {"feed", "calibration", "test"};
+
+// Higher runs first; an emergency stop bypasses the queue entirely
+enum MotorJobPriority : uint8_t {
+    PRIORITY_MANUAL,
+    PRIORITY_SCHEDULED
+};
+
+enum MotorJobState : uint8_t {
+    JOB_UNKNOWN,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_CANCELLED,
+    JOB_EXPIRED // finished so long ago that its result is no longer kept
+};
+
+static const char* const JOB_STATE_NAMES[] = {"unknown", "queued", "running", "done", "cancelled", "expired"};
+
+struct MotorJob {
+    uint32_t id;
+    MotorJobType type;
+    MotorJobPriority priority;
+    unsigned long durationMs;
+    HistorySource source;
+    uint8_t slot;
+    float grams;
+};
+
+struct MotorJobResult {
+    uint32_t id;
+    MotorJobState state;
+    int64_t onTimeUs;
+};
+
+// Write-ahead record of the running job, kept in NVS until it finishes
+struct MotorJournal {
+    uint32_t jobId;
+    uint8_t type;
+    uint8_t priority;
+    uint32_t durationMs;
+    uint32_t elapsedMs; // last checkpoint
+};
+
+enum MotorCommandType : uint8_t {
+    COMMAND_SUBMIT,
+    COMMAND_STOP,
+    COMMAND_IGNORE_PRESS // the press that woke the feeder from sleep
+};
+
+struct MotorCommand {
+    MotorCommandType type;
+    MotorJob job;
+};
+
+enum MotorEventType : uint8_t {
+    MOTOR_STARTED,
+    MOTOR_FINISHED,
+    BUTTON_RELEASED
+};
+
+// What the motor task reports back to loop(), which does the bookkeeping
+struct MotorEvent {
+    MotorEventType type;
+    MotorJobState state;
+    MotorJob job;
+    int64_t onTimeUs;
+    unsigned long pressMs;
+};
+
+// A request folded into a job that was already queued
+struct JobAlias {
+    uint32_t id;
+    uint32_t target;
+};
+
+// Published by the motor task after every pass, for everyone else to read
+struct MotorState {
+    bool running;
+    uint32_t currentJob;
+    uint8_t queueCount;
+    uint32_t queued[MOTOR_QUEUE_SIZE];
+    MotorJobResult results[MOTOR_RESULT_COUNT];
+    JobAlias aliases[MOTOR_RESULT_COUNT];
+    uint32_t takenBelow;     // every job id below this left the command queues
+    int64_t longestOnTimeUs; // against MOTOR_TIMEOUT_MS
+    int64_t maxOverrunUs;    // relay on past the requested duration
+};
+
+// Each producing task has its own queue, so every queue has one producer
+SpscQueue<MotorCommand, MOTOR_COMMAND_QUEUE_SIZE> webCommands;
+SpscQueue<MotorCommand, MOTOR_COMMAND_QUEUE_SIZE> loopCommands;
+SpscQueue<MotorEvent, MOTOR_EVENT_QUEUE_SIZE> motorEvents;
+Snapshot<MotorState> motorState;
+std::atomic<uint32_t> nextJobId{1};
+TaskHandle_t motorTask = nullptr;
+
+volatile bool motorSafetyTripped = false;
+volatile int64_t relayOffMicros = 0;
+
+// Hardware timer alarm at MOTOR_TIMEOUT_MS, independent of every task and
+// of the esp_timer task: cuts the relay straight through the GPIO registers.
+void IRAM_ATTR onMotorSafetyTimer() {
+    GPIO.out_w1tc = 1UL << RELAY_PIN;
+    relayOffMicros = esp_timer_get_time();
+    motorSafetyTripped = true;
+    BaseType_t woken = pdFALSE;
+    if (motorTask) vTaskNotifyGiveFromISR(motorTask, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void IRAM_ATTR onButtonChange() {
+    BaseType_t woken = pdFALSE;
+    if (motorTask) vTaskNotifyGiveFromISR(motorTask, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// Owns the relay, the job queue and the button, in a task of its own at
+// the highest priority on core 1: it sleeps until a command, the dose
+// timer, the safety timer or the button wakes it, so neither loop() nor
+// the web server can hold up a stop. The relay itself is switched off by
+// a one-shot esp_timer armed when it switches on, so the dose length does
+// not depend on the task either.
+//
+// Other tasks talk to it only through the command and event queues and
+// read its state from the motorState snapshot. The running job is
+// journaled to NVS with its progress, so a dose cut short by a reset is
+// finished after boot instead of repeated or lost.
+class MotorControl {
 private:
-    unsigned long motorStartTime = 0;
     bool motorRunning = false;
-    float gramsPerSecond = 0.5;
+    esp_timer_handle_t doseTimer = nullptr;
+    hw_timer_t* safetyTimer = nullptr;
+    volatile bool doseEnded = false;
+    int64_t relayOnMicros = 0;
+    unsigned long lastCheckpoint = 0;
+    TaskStats* stats = nullptr;
     
-public:
-    void begin() {
-        pinMode(RELAY_PIN, OUTPUT);
-        pinMode(LED_PIN, OUTPUT);
+    // Sorted by priority, FIFO within a priority
+    MotorJob queue[MOTOR_QUEUE_SIZE];
+    uint8_t queueCount = 0;
+    MotorJob currentJob = {0, JOB_FEED, PRIORITY_MANUAL, 0, HISTORY_WEB, HISTORY_NO_SLOT, 0};
+    
+    MotorJobResult results[MOTOR_RESULT_COUNT] = {};
+    uint8_t nextResult = 0;
+    JobAlias aliases[MOTOR_RESULT_COUNT] = {};
+    uint8_t nextAlias = 0;
+    uint32_t takenBelow = 0;
+    int64_t longestOnTimeUs = 0;
+    int64_t maxOverrunUs = 0;
+    LatencyHistogram journalWrites;
+    
+    unsigned long buttonPressStart = 0;
+    bool buttonPressed = false;
+    bool lastButtonState = HIGH;
+    
+    void enqueue(MotorJob job) {
+        job.durationMs = min(job.durationMs, (unsigned long)MOTOR_TIMEOUT_MS);
+    
+        // Repeated button presses or clicks fold into the one already waiting
+        if (job.priority == PRIORITY_MANUAL) {
+            for (uint8_t i = 0; i < queueCount; i++) {
+                if (queue[i].priority == PRIORITY_MANUAL && queue[i].type == job.type) {
+                    queue[i].durationMs = max(queue[i].durationMs, job.durationMs);
+                    queue[i].grams = max(queue[i].grams, job.grams);
+                    aliases[nextAlias] = {job.id, queue[i].id};
+                    nextAlias = (nextAlias + 1) % MOTOR_RESULT_COUNT;
+                    Serial.printf("Coalesced job %lu into job %lu\n", (unsigned long)job.id, (unsigned long)queue[i].id);
+                    return;
+                }
+            }
+        }
+    
+        if (queueCount == MOTOR_QUEUE_SIZE) {
+            Serial.println("Motor queue full, job rejected");
+            recordResult(job.id, JOB_CANCELLED, 0);
+            return;
+        }
+        uint8_t position = queueCount;
+        while (position > 0 && queue[position - 1].priority < job.priority) {
+            queue[position] = queue[position - 1];
+            position--;
+        }
+        queue[position] = job;
+        queueCount++;
+    }
+    
+    void recordResult(uint32_t id, MotorJobState state, int64_t onTimeUs) {
+        results[nextResult] = {id, state, onTimeUs};
+        nextResult = (nextResult + 1) % MOTOR_RESULT_COUNT;
+    }
+    
+    void writeJournal(uint32_t elapsedMs) {
+        // NVS serializes access, so this may run beside loop()'s writes
+        uint32_t started = ESP.getCycleCount();
+        MotorJournal journal = {currentJob.id, currentJob.type, currentJob.priority, (uint32_t)currentJob.durationMs, elapsedMs};
+        preferences.putBytes("motorWal", &journal, sizeof(journal));
+        journalWrites.recordSince(started);
+    }
+    
+    static void onDoseTimer(void* arg) {
         digitalWrite(RELAY_PIN, LOW);
-        digitalWrite(LED_PIN, LOW);
+        relayOffMicros = esp_timer_get_time();
+        ((MotorControl*)arg)->doseEnded = true;
+        xTaskNotifyGive(motorTask);
     }
     
-    void startMotor() {
+    void report(MotorEventType type, MotorJobState state = JOB_UNKNOWN, int64_t onTimeUs = 0, unsigned long pressMs = 0) {
+        MotorEvent event = {type, state, currentJob, onTimeUs, pressMs};
+        if (!motorEvents.push(event)) Serial.println("Motor event queue full, event dropped");
+    }
+    
+    void finishJob(MotorJobState state) {
+        stopMotor();
+        preferences.remove("motorWal");
+        int64_t onTimeUs = relayOffMicros - relayOnMicros;
+        recordResult(currentJob.id, state, onTimeUs);
+        longestOnTimeUs = max(longestOnTimeUs, onTimeUs);
+        if (state == JOB_DONE) {
+            maxOverrunUs = max(maxOverrunUs, onTimeUs - (int64_t)currentJob.durationMs * 1000);
+        }
+        report(MOTOR_FINISHED, state, onTimeUs);
+    }
+    
+    void startMotor(unsigned long durationMs) {
         if (!motorRunning) {
+            doseEnded = false;
+            motorSafetyTripped = false;
+            timerWrite(safetyTimer, 0);
+            timerAlarmEnable(safetyTimer);
             digitalWrite(RELAY_PIN, HIGH);
+            relayOnMicros = esp_timer_get_time();
+            esp_timer_start_once(doseTimer, (uint64_t)durationMs * 1000);
             digitalWrite(LED_PIN, HIGH);
-            motorStartTime = millis();
             motorRunning = true;
             Serial.println("Motor started");
         }
@@ -45,1104 +340,1066 @@ public:
     
     void stopMotor() {
         if (motorRunning) {
-            digitalWrite(RELAY_PIN, LOW);
+            esp_timer_stop(doseTimer);
+            timerAlarmDisable(safetyTimer);
+            if (!doseEnded && !motorSafetyTripped) {
+                digitalWrite(RELAY_PIN, LOW);
+                relayOffMicros = esp_timer_get_time();
+            }
             digitalWrite(LED_PIN, LOW);
             motorRunning = false;
             Serial.println("Motor stopped");
         }
     }
     
-    void spreadFeed(float grams) {
-        float duration = (grams / gramsPerSecond) * 1000;
-        Serial.printf("Spreading %.1fg for %.1f seconds\n", grams, duration/1000.0);
-        
-        startMotor();
-        unsigned long startTime = millis();
-        
-        while (millis() - startTime < duration && millis() - motorStartTime < MOTOR_TIMEOUT_MS) {
-            delay(10);
+    // Highest priority: stops the motor and cancels everything queued
+    void emergencyStop() {
+        Serial.println("Emergency stop");
+        if (motorRunning) finishJob(JOB_CANCELLED);
+        for (uint8_t i = 0; i < queueCount; i++) {
+            recordResult(queue[i].id, JOB_CANCELLED, 0);
         }
-        
-        stopMotor();
+        queueCount = 0;
     }
     
-    void calibrationRun() {
-        Serial.println("Starting 10 second calibration run");
-        startMotor();
-        delay(CALIBRATION_DURATION_MS);
-        stopMotor();
-        Serial.println("Calibration complete - measure dispensed amount");
+    void take(const MotorCommand& command) {
+        if (command.type == COMMAND_SUBMIT) {
+            enqueue(command.job);
+        } else if (command.type == COMMAND_STOP) {
+            emergencyStop();
+        } else if (command.type == COMMAND_IGNORE_PRESS) {
+            lastButtonState = LOW;
+            buttonPressed = false;
+        }
     }
     
-    void testRun() {
-        Serial.println("Starting 3 second motor test");
-        startMotor();
-        delay(3000); // 3 seconds
-        stopMotor();
-        Serial.println("Motor test complete");
+    // A release stops whatever runs or waits; otherwise loop() decides
+    // what the press asks for
+    void handleButton() {
+        bool currentState = digitalRead(BUTTON_PIN);
+    
+        if (currentState == LOW && lastButtonState == HIGH) {
+            buttonPressStart = millis();
+            buttonPressed = true;
+        }
+    
+        if (currentState == HIGH && lastButtonState == LOW && buttonPressed) {
+            if (motorRunning || queueCount > 0) {
+                emergencyStop();
+            } else {
+                report(BUTTON_RELEASED, JOB_UNKNOWN, 0, millis() - buttonPressStart);
+            }
+            buttonPressed = false;
+        }
+    
+        lastButtonState = currentState;
     }
     
-    void setCalibration(float gramsPerTenSeconds) {
-        gramsPerSecond = gramsPerTenSeconds / 10.0;
-        preferences.putFloat("cal", gramsPerTenSeconds);
-        Serial.printf("Calibration set: %.2fg per second\n", gramsPerSecond);
+    void update() {
+        if (motorRunning) {
+            if (motorSafetyTripped) {
+                Serial.println("Motor timeout! Relay cut by safety timer");
+                finishJob(JOB_DONE);
+            } else if (doseEnded) {
+                finishJob(JOB_DONE);
+            } else if (millis() - lastCheckpoint >= MOTOR_JOURNAL_INTERVAL_MS) {
+                lastCheckpoint = millis();
+                writeJournal((esp_timer_get_time() - relayOnMicros) / 1000);
+            }
+            return;
+        }
+        if (queueCount > 0) {
+            currentJob = queue[0];
+            queueCount--;
+            memmove(queue, queue + 1, queueCount * sizeof(MotorJob));
+            Serial.printf("Starting job %lu (%lums)\n", (unsigned long)currentJob.id, currentJob.durationMs);
+            // Journal before the relay closes, so a reset at any point after is covered
+            writeJournal(0);
+            lastCheckpoint = millis();
+            startMotor(currentJob.durationMs);
+            report(MOTOR_STARTED);
+        }
     }
     
-    float getCalibration() {
-        return gramsPerSecond * 10.0;
+    void publish() {
+        MotorState state;
+        state.running = motorRunning;
+        state.currentJob = currentJob.id;
+        state.queueCount = queueCount;
+        for (uint8_t i = 0; i < MOTOR_QUEUE_SIZE; i++) {
+            state.queued[i] = i < queueCount ? queue[i].id : 0;
+        }
+        memcpy(state.results, results, sizeof(results));
+        memcpy(state.aliases, aliases, sizeof(aliases));
+        state.takenBelow = takenBelow;
+        state.longestOnTimeUs = longestOnTimeUs;
+        state.maxOverrunUs = maxOverrunUs;
+        motorState.publish(state);
     }
     
-    void update() {
-        if (motorRunning && millis() - motorStartTime > MOTOR_TIMEOUT_MS) {
-            stopMotor();
-            Serial.println("Motor timeout!");
+    // How long the task may sleep before the next journal checkpoint
+    TickType_t idleTicks() {
+        if (!motorRunning) return portMAX_DELAY;
+        unsigned long since = millis() - lastCheckpoint;
+        return pdMS_TO_TICKS(since >= MOTOR_JOURNAL_INTERVAL_MS ? 1 : MOTOR_JOURNAL_INTERVAL_MS - since);
+    }
+    
+    static void run(void* arg) {
+        MotorControl* motor = (MotorControl*)arg;
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, motor->idleTicks());
+            motor->stats->begin();
+            // Read before draining: submit() pushes a job before it
+            // counts its id, so every id below this is in a queue by now
+            uint32_t submitted = nextJobId.load();
+            MotorCommand command;
+            while (loopCommands.pop(command)) motor->take(command);
+            while (webCommands.pop(command)) motor->take(command);
+            motor->takenBelow = submitted;
+            motor->handleButton();
+            motor->update();
+            motor->update(); // starts the next job right after one finished
+            motor->publish();
+            motor->stats->end();
+        }
+    }
+    
+public:
+    void begin() {
+        pinMode(RELAY_PIN, OUTPUT);
+        pinMode(LED_PIN, OUTPUT);
+        digitalWrite(RELAY_PIN, LOW);
+        digitalWrite(LED_PIN, LOW);
+        gpio_hold_dis((gpio_num_t)RELAY_PIN); // held low through deep sleep
+        pinMode(BUTTON_PIN, INPUT_PULLUP);
+    
+        esp_timer_create_args_t doseTimerArgs = {};
+        doseTimerArgs.callback = onDoseTimer;
+        doseTimerArgs.arg = this;
+        doseTimerArgs.dispatch_method = ESP_TIMER_TASK;
+        doseTimerArgs.name = "dose";
+        esp_timer_create(&doseTimerArgs, &doseTimer);
+    
+        safetyTimer = timerBegin(SAFETY_TIMER_NUM, 80, true); // 1 MHz from the 80 MHz APB clock
+        timerAttachInterrupt(safetyTimer, onMotorSafetyTimer, true);
+        timerAlarmWrite(safetyTimer, (uint64_t)MOTOR_TIMEOUT_MS * 1000, false);
+        publish();
+    }
+    
+    // The press that woke the feeder only brings WiFi up
+    void ignorePress() {
+        lastButtonState = LOW;
+    }
+    
+    // Light sleep leaves the button's pin set up for the wake, so this is
+    // also called after each
+    void armButton() {
+        attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), onButtonChange, CHANGE);
+    }
+    
+    // NVS writes of the job journal, while the relay is on
+    const LatencyHistogram& journalWriteTimes() const {
+        return journalWrites;
+    }
+    
+    bool startTask() {
+        stats = taskMonitor.add("motor", nullptr, MOTOR_TASK_CORE);
+        armButton();
+        if (xTaskCreatePinnedToCore(run, "motor", MOTOR_TASK_STACK, this, MOTOR_TASK_PRIORITY, &motorTask,
+                                    MOTOR_TASK_CORE) != pdPASS) {
+            return false;
         }
+        stats->handle = motorTask;
+        // Jobs queued before the task existed, like a resumed feeding, are
+        // waiting without a notification
+        xTaskNotifyGive(motorTask);
+        return true;
     }
 };
 
-class Scheduler {
+// The rest of the firmware's view of the motor: queues jobs, reads their
+// state from the snapshot, and keeps the calibration and the records of
+// finished runs, all from loop() or a web handler under the state lock.
+class Spreader {
 private:
-    struct FeedingTime {
-        int hour;
-        int minute;
-    };
-    
-    FeedingTime summerSchedule[4] = {{6,0}, {10,0}, {15,0}, {19,0}};
-    FeedingTime winterSchedule[3] = {{8,0}, {13,0}, {17,0}};
-    FeedingTime springSchedule[3] = {{7,0}, {12,0}, {17,0}};
-    
-    bool fedToday[8] = {false, false, false, false, false, false, false, false};
-    int lastFeedDay = -1;
-    
-    // Calculate sunset time based on day of year (approximate for Central Europe)
-    int getSunsetHour(int dayOfYear) {
-        // Simplified sunset calculation for latitude ~50°N (Germany)
-        // Summer solstice (day 172): sunset ~21:30
-        // Winter solstice (day 355): sunset ~16:30
-        float angle = (dayOfYear - 172) * 2.0 * M_PI / 365.0;
-        float sunsetDecimal = 19.0 + 2.5 * cos(angle); // Between 16.5 and 21.5
-        return (int)sunsetDecimal;
-    }
-    
-    // Calculate sunrise time based on day of year (approximate for Central Europe)
-    int getSunriseHour(int dayOfYear) {
-        // Simplified sunrise calculation for latitude ~50°N (Germany)
-        // Summer solstice (day 172): sunrise ~5:30
-        // Winter solstice (day 355): sunrise ~8:30
-        float angle = (dayOfYear - 172) * 2.0 * M_PI / 365.0;
-        float sunriseDecimal = 7.0 - 1.5 * cos(angle); // Between 5.5 and 8.5
-        return (int)sunriseDecimal;
+    CalibrationModel calibration;
+    unsigned long pendingCalibrationMs = 0; // last calibration run awaiting its weighing
+    
+    static bool send(const MotorCommand& command) {
+        bool fromWeb = motorTask && xTaskGetCurrentTaskHandle() == server.getTask();
+        if (!(fromWeb ? webCommands : loopCommands).push(command)) return false;
+        if (motorTask) xTaskNotifyGive(motorTask);
+        return true;
     }
     
-public:
-    float getDailyFeedAmount(int adultChickens, int gramsPerChicken) {
-        float total = adultChickens * gramsPerChicken;
-        
-        int month = 0;
-        struct tm timeinfo;
-        if (getLocalTime(&timeinfo)) {
-            month = timeinfo.tm_mon + 1;
+    // Returns the job id, or 0 if the queue is full
+    uint32_t submit(MotorJobType type, MotorJobPriority priority, unsigned long durationMs,
+                    HistorySource source, float grams = 0, uint8_t slot = HISTORY_NO_SLOT) {
+        if (motorState.read().queueCount == MOTOR_QUEUE_SIZE) {
+            Serial.println("Motor queue full, job rejected");
+            return 0;
         }
-        
-        if (month == 12 || month <= 2) total *= 1.15;
-        else if (month >= 3 && month <= 5) total *= 1.05;
-        else if (month >= 6 && month <= 8) total *= 0.95;
-        
-        return total;
-    }
-    
-    FeedingTime* getCurrentSchedule(int &count, int frequency, int sunriseOff, int sunsetOff) {
-        struct tm timeinfo;
-        if (!getLocalTime(&timeinfo)) {
-            count = frequency;
-            // Generate fallback schedule
-            static FeedingTime fallbackSchedule[8];
-            for (int i = 0; i < frequency; i++) {
-                fallbackSchedule[i].hour = 8 + (i * 10 / frequency);
-                fallbackSchedule[i].minute = 0;
-            }
-            return fallbackSchedule;
+        // Only the task holding the state lock submits, so the id can be
+        // counted once the job is in its queue, see MotorState::takenBelow
+        MotorCommand command = {COMMAND_SUBMIT, {nextJobId.load(), type, priority, durationMs, source, slot, grams}};
+        if (!send(command)) return 0;
+        nextJobId.store(command.job.id + 1);
+        return command.job.id;
+    }
+    
+    void publishStarted(const MotorJob& job) {
+        JsonBuffer<128> json;
+        json.add("job", (unsigned long)job.id);
+        json.add("type", JOB_TYPE_NAMES[job.type]);
+        json.add("running", true);
+        json.add("durationMs", job.durationMs);
+        events.publish("motor", json.finish());
+    }
+    
+    void publishStopped(const MotorJob& job, MotorJobState state, int64_t onTimeUs, float grams) {
+        JsonBuffer<128> json;
+        json.add("job", (unsigned long)job.id);
+        json.add("type", JOB_TYPE_NAMES[job.type]);
+        json.add("running", false);
+        json.add("state", JOB_STATE_NAMES[state]);
+        json.add("onTimeUs", (unsigned long)onTimeUs);
+        events.publish("motor", json.finish());
+        if (job.type != JOB_FEED) return;
+    
+        JsonBuffer<160> feeding;
+        feeding.add("job", (unsigned long)job.id);
+        feeding.add("grams", grams, 1);
+        feeding.add("requested", job.grams, 1);
+        feeding.add("slot", job.slot == HISTORY_NO_SLOT ? -1 : (int)job.slot);
+        feeding.add("source", HISTORY_SOURCE_NAMES[job.source]);
+        feeding.add("completed", state == JOB_DONE);
+        events.publish("feeding", feeding.finish());
+    }
+    
+    void finished(const MotorJob& job, MotorJobState state, int64_t onTimeUs) {
+        Serial.printf("Job %lu: relay on for %lldus of %lums requested\n",
+                      (unsigned long)job.id, (long long)onTimeUs, job.durationMs);
+        HistoryRecord record = {(uint32_t)time(nullptr), (uint32_t)onTimeUs, job.grams,
+                                job.slot, job.source, state == JOB_DONE, 0};
+        history.append(record);
+        float grams = calibration.predictGrams(onTimeUs / 1000.0);
+        // Calibration and test runs are history, but not feed the flock ate
+        if (job.source != HISTORY_CALIBRATION && job.source != HISTORY_TEST) {
+            consumption.record(preferences, record.timestamp, grams, onTimeUs / 1000);
         }
-        
-        int dayOfYear = timeinfo.tm_yday;
-        int sunriseHour = getSunriseHour(dayOfYear);
-        int sunsetHour = getSunsetHour(dayOfYear);
-        
-        // Generate schedule based on frequency
-        static FeedingTime dynamicSchedule[8];
-        count = frequency;
-        
-        // Calculate feeding times between sunrise+offset and sunset-offset
-        int startHour = sunriseHour + sunriseOff;
-        int endHour = sunsetHour - sunsetOff;
-        int totalHours = endHour - startHour;
-        
-        // Ensure we have at least 1 hour window
-        if (totalHours < 1) {
-            startHour = sunriseHour + 1;
-            endHour = sunsetHour - 1;
-            totalHours = endHour - startHour;
+        configGeneration++;
+        publishStopped(job, state, onTimeUs, grams);
+        if (state != JOB_DONE) return;
+        if (job.type == JOB_CALIBRATION) {
+            pendingCalibrationMs = (onTimeUs + 500) / 1000;
+            Serial.println("Calibration complete - measure dispensed amount");
+        } else if (job.type == JOB_TEST) {
+            Serial.println("Motor test complete");
         }
-        
-        if (frequency == 1) {
-            dynamicSchedule[0].hour = startHour + (totalHours / 2);
-            dynamicSchedule[0].minute = 0;
-        } else {
-            for (int i = 0; i < frequency; i++) {
-                float position = (float)i / (frequency - 1);
-                dynamicSchedule[i].hour = startHour + (int)(totalHours * position);
-                dynamicSchedule[i].minute = 0;
+    }
+    
+public:
+    // Call once preferences are open. Re-queues whatever part of an
+    // interrupted feeding is left; the relay may have run for up to one
+    // checkpoint interval past the last record, so that much counts as
+    // dispensed. The rest is worked out in grams, since the new run pays
+    // the motor's dead time again. Interrupted tests and calibration runs
+    // are dropped.
+    void recoverJournal() {
+        MotorJournal journal;
+        if (preferences.getBytes("motorWal", &journal, sizeof(journal)) != sizeof(journal)) return;
+        preferences.remove("motorWal");
+    
+        unsigned long dispensedMs = journal.elapsedMs + MOTOR_JOURNAL_INTERVAL_MS;
+        Serial.printf("Job %lu was interrupted after %lu of %lums\n",
+                      (unsigned long)journal.jobId, (unsigned long)journal.elapsedMs, (unsigned long)journal.durationMs);
+        if (journal.type != JOB_FEED || dispensedMs >= journal.durationMs) return;
+        float remaining = calibration.predictGrams(journal.durationMs) - calibration.predictGrams(dispensedMs);
+        if (remaining <= 0) return;
+    
+        unsigned long durationMs = calibration.durationForGrams(remaining);
+        uint32_t id = submit(JOB_FEED, (MotorJobPriority)journal.priority, durationMs, HISTORY_RESUMED, remaining);
+        Serial.printf("Resuming as job %lu for the remaining %.1fg (%lums)\n", (unsigned long)id, remaining, durationMs);
+    }
+    
+    // From loop(): records what the motor task finished and acts on presses
+    void handleMotorEvents() {
+        MotorEvent event;
+        while (motorEvents.pop(event)) {
+            if (event.type == MOTOR_STARTED) {
+                publishStarted(event.job);
+            } else if (event.type == MOTOR_FINISHED) {
+                finished(event.job, event.state, event.onTimeUs);
+            } else if (event.pressMs > BUTTON_LONG_PRESS_MS) {
+                calibrationRun();
+            } else {
+                spreadFeed(25.0, HISTORY_BUTTON);
             }
         }
-        
-        return dynamicSchedule;
     }
     
-    bool shouldFeedNow(float &feedAmount, int adultChickens, int gramsPerChicken, int frequency, int sunriseOff, int sunsetOff) {
-        struct tm timeinfo;
-        if (!getLocalTime(&timeinfo)) {
-            return false;
+    // Stops the motor and cancels all queued jobs, within one pass of the
+    // motor task
+    bool emergencyStop() {
+        MotorCommand command = {COMMAND_STOP, {}};
+        return send(command);
+    }
+    
+    void ignoreButtonPress() {
+        MotorCommand command = {COMMAND_IGNORE_PRESS, {}};
+        send(command);
+    }
+    
+    uint32_t spreadFeed(float grams, HistorySource source, uint8_t slot = HISTORY_NO_SLOT) {
+        unsigned long duration = calibration.durationForGrams(grams);
+        Serial.printf("Queueing %.1fg for %.1f seconds\n", grams, duration/1000.0);
+        MotorJobPriority priority = source == HISTORY_SCHEDULE ? PRIORITY_SCHEDULED : PRIORITY_MANUAL;
+        return submit(JOB_FEED, priority, duration, source, grams, slot);
+    }
+    
+    uint32_t calibrationRun(unsigned long durationMs = CALIBRATION_DURATION_MS) {
+        durationMs = constrain(durationMs, CALIBRATION_MIN_DURATION_MS, (unsigned long)MOTOR_TIMEOUT_MS);
+        Serial.printf("Queueing %lu ms calibration run\n", durationMs);
+        return submit(JOB_CALIBRATION, PRIORITY_MANUAL, durationMs, HISTORY_CALIBRATION);
+    }
+    
+    uint32_t testRun() {
+        Serial.println("Queueing 3 second motor test");
+        return submit(JOB_TEST, PRIORITY_MANUAL, MOTOR_TEST_DURATION_MS, HISTORY_TEST);
+    }
+    
+    // State and, once finished, measured relay on-time of a job
+    MotorJobResult getJobResult(uint32_t id) {
+        MotorJobResult result = {id, JOB_UNKNOWN, 0};
+        if (id == 0) return result;
+        MotorState state = motorState.read();
+        for (uint8_t i = 0; i < MOTOR_RESULT_COUNT; i++) {
+            if (state.aliases[i].id == id) id = state.aliases[i].target;
         }
-        
-        int currentDay = timeinfo.tm_yday;
-        if (currentDay != lastFeedDay) {
-            for (int i = 0; i < 8; i++) fedToday[i] = false; // Clear all slots
-            lastFeedDay = currentDay;
+        if (state.running && id == state.currentJob) {
+            result.state = JOB_RUNNING;
+            return result;
         }
-        
-        int scheduleCount;
-        FeedingTime* schedule = getCurrentSchedule(scheduleCount, frequency, sunriseOff, sunsetOff);
-        float dailyTotal = getDailyFeedAmount(adultChickens, gramsPerChicken);
-        float perFeeding = dailyTotal / scheduleCount;
-        
-        for (int i = 0; i < scheduleCount; i++) {
-            if (!fedToday[i] && 
-                timeinfo.tm_hour == schedule[i].hour && 
-                timeinfo.tm_min >= schedule[i].minute &&
-                timeinfo.tm_min < schedule[i].minute + 5) {
-                fedToday[i] = true;
-                feedAmount = perFeeding;
-                return true;
+        for (uint8_t i = 0; i < state.queueCount; i++) {
+            if (state.queued[i] == id) {
+                result.state = JOB_QUEUED;
+                return result;
             }
         }
-        
-        return false;
+        for (uint8_t i = 0; i < MOTOR_RESULT_COUNT; i++) {
+            if (state.results[i].id == id) {
+                result.state = state.results[i].state;
+                result.onTimeUs = state.results[i].onTimeUs;
+                return result;
+            }
+        }
+        // Taken by the motor task and finished, but no longer in the results
+        if (id < state.takenBelow) result.state = JOB_EXPIRED;
+        // Sent, but not yet taken
+        else if (id < nextJobId) result.state = JOB_QUEUED;
+        return result;
     }
     
-    String getSunriseTime() {
-        struct tm timeinfo;
-        if (!getLocalTime(&timeinfo)) {
-            return "---";
-        }
-        int hour = getSunriseHour(timeinfo.tm_yday);
-        return String(hour) + ":30";
+    // Also while a job is still on its way to the motor task
+    bool isBusy() {
+        MotorState state = motorState.read();
+        return state.running || state.queueCount > 0 || !loopCommands.empty() || !webCommands.empty() ||
+               !motorEvents.empty();
     }
     
-    String getSunsetTime() {
-        struct tm timeinfo;
-        if (!getLocalTime(&timeinfo)) {
-            return "---";
-        }
-        int hour = getSunsetHour(timeinfo.tm_yday);
-        return String(hour) + ":30";
+    void loadCalibration() {
+        calibration.load(preferences);
+        printCalibration();
+    }
+    
+    // Weighed output of the last calibration run, or of a 10 s run if none
+    // has finished since the last measurement
+    void addCalibrationMeasurement(float grams) {
+        unsigned long durationMs = pendingCalibrationMs ? pendingCalibrationMs : CALIBRATION_DURATION_MS;
+        pendingCalibrationMs = 0;
+        calibration.addPoint(durationMs, grams);
+        calibration.save(preferences);
+        Serial.printf("Calibration run: %.1fg in %lums\n", grams, durationMs);
+        printCalibration();
+    }
+    
+    void clearCalibration() {
+        calibration.clear();
+        calibration.save(preferences);
+        printCalibration();
+    }
+    
+    void printCalibration() {
+        Serial.printf("Calibration: %.2fg per second after %.0fms, %d runs, rms residual %.2fg\n",
+                      calibration.getGramsPerSecond(), calibration.getDeadTimeMs(),
+                      calibration.pointCount(), calibration.getRmsResidual());
+    }
+    
+    const CalibrationModel& getCalibrationModel() {
+        return calibration;
+    }
+    
+    // Output of a standard 10 s calibration run, as shown on the dashboard
+    float getCalibration() {
+        return calibration.predictGrams(CALIBRATION_DURATION_MS);
     }
 };
 
+MotorControl motor;
+
 Spreader spreader;
 Scheduler scheduler;
+PowerManager power;
 
-int adultChickens = 6;
-int feedAmountPerChicken = 120; // grams per day
-int feedFrequency = 3; // times per day
-int sunriseOffset = 2; // hours after sunrise
-int sunsetOffset = 2; // hours before sunset
-String language = "de"; // "de" or "en"
-
-unsigned long buttonPressStart = 0;
-bool buttonPressed = false;
-bool lastButtonState = HIGH;
-
-String getTranslation(String key, String lang) {
-    // German translations
-    if (lang == "de") {
-        if (key == "subtitle") return "Intelligente H&uuml;hnerf&uuml;tterung";
-        if (key == "feeding_schedule_title") return "Heutige F&uuml;tterungszeiten";
-        if (key == "sunrise_text") return "Sonnenaufgang";
-        if (key == "sunset_text") return "Sonnenuntergang";
-        if (key == "system_status_title") return "System-Status";
-        if (key == "adult_chickens_text") return "Erwachsene H&uuml;hner";
-        if (key == "calibration_text") return "Kalibrierung";
-        if (key == "time_text") return "Zeit";
-        if (key == "daily_feed_text") return "Futter pro Tag";
-        if (key == "monthly_feed_text") return "Futter pro Monat";
-        if (key == "chicken_config_title") return "H&uuml;hner-Konfiguration";
-        if (key == "adult_chickens_label") return "Erwachsene H&uuml;hner";
-        if (key == "feed_per_chicken_label") return "Futter pro Huhn/Tag";
-        if (key == "feedings_per_day_label") return "F&uuml;tterungen pro Tag";
-        if (key == "first_feeding_label") return "Erste F&uuml;tterung";
-        if (key == "last_feeding_label") return "Letzte F&uuml;tterung";
-        if (key == "after_sunrise_text") return "nach Sonnenaufgang";
-        if (key == "before_sunset_text") return "vor Sonnenuntergang";
-        if (key == "update_button_text") return "Aktualisieren";
-        if (key == "calibration_title") return "Kalibrierung";
-        if (key == "calibration_instruction") return "F&uuml;hren Sie einen 10-Sekunden-Kalibrierungstest durch, messen Sie dann die tats&auml;chlich ausgegebene Menge und geben Sie diese ein.";
-        if (key == "measured_amount_label") return "Gemessene Menge (g)";
-        if (key == "dispensed_grams_placeholder") return "Ausgegebene Gramm";
-        if (key == "start_test_button") return "Test starten";
-        if (key == "save_calibration_button") return "Kalibrierung speichern";
-    }
-    // English translations
-    else if (lang == "en") {
-        if (key == "subtitle") return "Intelligent Chicken Feeding";
-        if (key == "feeding_schedule_title") return "Today's Feeding Schedule";
-        if (key == "sunrise_text") return "Sunrise";
-        if (key == "sunset_text") return "Sunset";
-        if (key == "system_status_title") return "System Status";
-        if (key == "adult_chickens_text") return "Adult Chickens";
-        if (key == "calibration_text") return "Calibration";
-        if (key == "time_text") return "Time";
-        if (key == "daily_feed_text") return "Daily Feed";
-        if (key == "monthly_feed_text") return "Monthly Feed";
-        if (key == "chicken_config_title") return "Chicken Configuration";
-        if (key == "adult_chickens_label") return "Adult Chickens";
-        if (key == "feed_per_chicken_label") return "Feed per Chicken/Day";
-        if (key == "feedings_per_day_label") return "Feedings per Day";
-        if (key == "first_feeding_label") return "First Feeding";
-        if (key == "last_feeding_label") return "Last Feeding";
-        if (key == "after_sunrise_text") return "after sunrise";
-        if (key == "before_sunset_text") return "before sunset";
-        if (key == "update_button_text") return "Update";
-        if (key == "calibration_title") return "Calibration";
-        if (key == "calibration_instruction") return "Run a 10-second calibration test, then measure the actual dispensed amount and enter it below.";
-        if (key == "measured_amount_label") return "Measured Amount (g)";
-        if (key == "dispensed_grams_placeholder") return "Dispensed Grams";
-        if (key == "start_test_button") return "Start Test";
-        if (key == "save_calibration_button") return "Save Calibration";
-    }
-    return key; // Fallback
-}
+// Kept in RTC memory across deep sleep; the feeding cursor also across
+// resets, so it is not initialized at boot
+RTC_DATA_ATTR PowerState powerState;
+RTC_NOINIT_ATTR FeedingCursor feedingCursor;
+RTC_NOINIT_ATTR TimeState timeState;
 
-String generateHTML() {
-    String html = R"HTML(
-<!DOCTYPE html>
-<html lang="{LANG}">
-<head>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <title>Henny</title>
-    <link rel="manifest" href="/manifest.json">
-    <meta name="theme-color" content="#059669">
-    <meta name="apple-mobile-web-app-capable" content="yes">
-    <meta name="apple-mobile-web-app-status-bar-style" content="default">
-    <meta name="apple-mobile-web-app-title" content="Henny">
-    <link rel="apple-touch-icon" href="/icon-192.png">
-    <script src="https://cdn.tailwindcss.com"></script>
-    <script src="https://unpkg.com/lucide@latest/dist/umd/lucide.js"></script>
-    <style>
-        .slider::-webkit-slider-thumb {
-            appearance: none;
-            height: 20px;
-            width: 20px;
-            border-radius: 50%;
-            background: #4ade80;
-            cursor: pointer;
-            box-shadow: 0 0 2px 0 #555;
-        }
-        .slider::-moz-range-thumb {
-            height: 20px;
-            width: 20px;
-            border-radius: 50%;
-            background: #4ade80;
-            cursor: pointer;
-            border: none;
-            box-shadow: 0 0 2px 0 #555;
-        }
-    </style>
-    <script>
-        tailwind.config = {
-            theme: {
-                extend: {
-                    colors: {
-                        primary: '#4ade80',
-                        secondary: '#22c55e',
-                        accent: '#86efac',
-                        sage: '#94a3b8',
-                        'green-soft': '#ecfdf5',
-                        'green-card': '#6ee7b7'
-                    }
-                }
-            }
-        }
-    </script>
-</head>
-<body class="min-h-screen" style="background: #415554;">
-    <div class="container mx-auto px-4 py-8 max-w-4xl">
-        <!-- Header -->
-        <div class="bg-gradient-to-br from-emerald-600 to-teal-700 rounded-2xl shadow-xl p-6 mb-6 relative overflow-hidden">
-            <!-- Decorative elements -->
-            <div class="absolute top-0 right-0 w-32 h-32 bg-white/10 rounded-full -translate-y-16 translate-x-16"></div>
-            <div class="absolute bottom-0 left-0 w-24 h-24 bg-white/5 rounded-full translate-y-12 -translate-x-12"></div>
-            <div class="absolute top-1/2 right-1/4 w-6 h-6 bg-white/20 rounded-full"></div>
-            <div class="absolute top-1/4 right-1/3 w-3 h-3 bg-white/15 rounded-full"></div>
-            
-            <div class="flex items-center justify-between relative z-10">
-                <div>
-                    <h1 class="text-3xl font-bold text-white flex items-center gap-3">
-                        <i data-lucide="bird" class="w-8 h-8 text-emerald-200"></i>
-                        Henny
-                    </h1>
-                    <p class="text-emerald-100 text-sm mt-1">{SUBTITLE}</p>
-                </div>
-                <div class="flex gap-3">
-                    <button id="test-motor-btn" class="bg-white/20 hover:bg-white/30 backdrop-blur-sm text-white p-3 rounded-xl transition-all shadow-lg hover:shadow-xl border border-white/20" title="Motor Test (3s)">
-                        <i data-lucide="zap" class="w-5 h-5"></i>
-                    </button>
-                    <button id="language-btn" class="bg-white/20 hover:bg-white/30 backdrop-blur-sm text-white p-3 rounded-xl transition-all shadow-lg hover:shadow-xl border border-white/20" title="Language / Sprache">
-                        <span class="text-sm font-medium">{LANGUAGE_DISPLAY}</span>
-                    </button>
-                    <button id="install-btn" class="bg-white/20 hover:bg-white/30 backdrop-blur-sm text-white p-3 rounded-xl transition-all shadow-lg hover:shadow-xl border border-white/20 hidden" title="Install App">
-                        <i data-lucide="download" class="w-5 h-5"></i>
-                    </button>
-                    <button id="settings-btn" class="bg-white/20 hover:bg-white/30 backdrop-blur-sm text-white p-3 rounded-xl transition-all shadow-lg hover:shadow-xl border border-white/20" title="Settings / Einstellungen">
-                        <i data-lucide="settings" class="w-5 h-5"></i>
-                    </button>
-                </div>
-            </div>
-        </div>
-
-        <!-- Dashboard Grid -->
-        <div id="dashboard-grid" class="grid md:grid-cols-2 gap-6 mb-8">
-            <!-- Today's Feeding Schedule -->
-            <div class="bg-gradient-to-br from-white to-emerald-50 rounded-2xl shadow-xl border border-emerald-200/30 p-6 md:order-2">
-                <div class="flex items-center justify-between mb-4">
-                    <h3 class="text-lg font-semibold text-gray-800">{FEEDING_SCHEDULE_TITLE}</h3>
-                    <i data-lucide="calendar" class="w-6 h-6 text-gray-500"></i>
-                </div>
-                <table class="w-full">
-                    <tbody>
-                        <tr class="border-b border-gray-100">
-                            <td class="text-gray-500 text-sm text-right py-2 pr-3">{SUNRISE}</td>
-                            <td class="text-gray-500 text-sm py-2 px-3">
-                                <span class="flex items-center gap-1">
-                                    <i data-lucide="sunrise" class="w-4 h-4"></i>
-                                    {SUNRISE_TEXT}
-                                </span>
-                            </td>
-                            <td class="py-2 px-3"></td>
-                            <td class="py-2 pl-3"></td>
-                        </tr>
-                        <tbody id="feeding-schedule">
-                            <!-- This will be populated by JavaScript -->
-                        </tbody>
-                        <tr class="border-t border-gray-100">
-                            <td class="text-gray-500 text-sm text-right py-2 pr-3">{SUNSET}</td>
-                            <td class="text-gray-500 text-sm py-2 px-3">
-                                <span class="flex items-center gap-1">
-                                    <i data-lucide="sunset" class="w-4 h-4"></i>
-                                    {SUNSET_TEXT}
-                                </span>
-                            </td>
-                            <td class="py-2 px-3"></td>
-                            <td class="py-2 pl-3"></td>
-                        </tr>
-                    </tbody>
-                </table>
-            </div>
-
-            <!-- System Status Card -->
-            <div class="bg-gradient-to-br from-white to-green-soft rounded-2xl shadow-xl border border-green-200/30 p-6 md:order-1">
-                <div class="flex items-center justify-between mb-4">
-                    <h3 class="text-lg font-semibold text-gray-800">{SYSTEM_STATUS_TITLE}</h3>
-                    <i data-lucide="activity" class="w-6 h-6 text-gray-500"></i>
-                </div>
-                <div class="space-y-3">
-                    <div class="flex justify-between">
-                        <span class="text-gray-600">{ADULT_CHICKENS_TEXT}</span>
-                        <span class="font-medium" id="adults">{ADULTS}</span>
-                    </div>
-                    <div class="flex justify-between">
-                        <span class="text-gray-600">{CALIBRATION_TEXT}</span>
-                        <span class="font-medium" id="calibration">{CALIBRATION}g/10s</span>
-                    </div>
-                    <div class="flex justify-between">
-                        <span class="text-gray-600">WiFi</span>
-                        <span class="font-medium text-green-600" id="wifi-status">{WIFI_NETWORK}</span>
-                    </div>
-                    <div class="flex justify-between">
-                        <span class="text-gray-600">{TIME_TEXT}</span>
-                        <span class="font-medium" id="current-time">{CURRENT_TIME}</span>
-                    </div>
-                    <div class="flex justify-between">
-                        <span class="text-gray-600">{DAILY_FEED_TEXT}</span>
-                        <span class="font-medium">{DAILY_FEED}g</span>
-                    </div>
-                    <div class="flex justify-between">
-                        <span class="text-gray-600">{MONTHLY_FEED_TEXT}</span>
-                        <span class="font-medium">{MONTHLY_FEED}kg</span>
-                    </div>
-                </div>
-            </div>
-        </div>
-
-
-        <!-- Settings Panel (Initially Hidden) -->
-        <div id="settings-panel" class="hidden space-y-6">
-            <!-- Configuration -->
-            <div class="bg-gradient-to-br from-white to-green-soft rounded-2xl shadow-xl border border-green-200/30 p-6">
-                <h3 class="text-xl font-semibold text-gray-800 mb-4 flex items-center gap-2">
-                    <i data-lucide="bird" class="w-6 h-6 text-gray-500"></i>
-                    {CHICKEN_CONFIG_TITLE}
-                </h3>
-                <div class="space-y-4">
-                    <div>
-                        <label class="block text-sm font-medium text-gray-700 mb-2">{ADULT_CHICKENS_LABEL}: <span id="chickenCountDisplay">{ADULTS}</span></label>
-                        <input type="range" id="adultCount" min="0" max="30" value="{ADULTS}"
-                               class="w-full h-2 bg-gray-200 rounded-lg appearance-none cursor-pointer slider"
-                               oninput="updateChickenDisplay(this.value)">
-                    </div>
-                    <div>
-                        <label class="block text-sm font-medium text-gray-700 mb-2">{FEED_PER_CHICKEN_LABEL}: <span id="feedAmountDisplay">{FEED_AMOUNT}</span>g</label>
-                        <input type="range" id="feedAmount" min="80" max="200" value="{FEED_AMOUNT}"
-                               class="w-full h-2 bg-gray-200 rounded-lg appearance-none cursor-pointer slider"
-                               oninput="updateFeedAmountDisplay(this.value)">
-                    </div>
-                    <div>
-                        <label class="block text-sm font-medium text-gray-700 mb-2">{FEEDINGS_PER_DAY_LABEL}: <span id="feedFrequencyDisplay">{FEED_FREQUENCY}</span></label>
-                        <input type="range" id="feedFrequency" min="1" max="8" value="{FEED_FREQUENCY}"
-                               class="w-full h-2 bg-gray-200 rounded-lg appearance-none cursor-pointer slider"
-                               oninput="updateFeedFrequencyDisplay(this.value)">
-                    </div>
-                    <div>
-                        <label class="block text-sm font-medium text-gray-700 mb-2">{FIRST_FEEDING_LABEL}: <span id="sunriseOffsetDisplay">{SUNRISE_OFFSET}</span>h {AFTER_SUNRISE_TEXT}</label>
-                        <input type="range" id="sunriseOffset" min="1" max="4" value="{SUNRISE_OFFSET}"
-                               class="w-full h-2 bg-gray-200 rounded-lg appearance-none cursor-pointer slider"
-                               oninput="updateSunriseOffsetDisplay(this.value)">
-                    </div>
-                    <div>
-                        <label class="block text-sm font-medium text-gray-700 mb-2">{LAST_FEEDING_LABEL}: <span id="sunsetOffsetDisplay">{SUNSET_OFFSET}</span>h {BEFORE_SUNSET_TEXT}</label>
-                        <input type="range" id="sunsetOffset" min="1" max="4" value="{SUNSET_OFFSET}"
-                               class="w-full h-2 bg-gray-200 rounded-lg appearance-none cursor-pointer slider"
-                               oninput="updateSunsetOffsetDisplay(this.value)">
-                    </div>
-                    <div class="flex justify-center">
-                        <button id="update-config-btn" class="bg-emerald-500 hover:bg-emerald-600 text-white font-medium py-3 px-8 rounded-xl transition-all shadow-lg hover:shadow-xl">
-                            {UPDATE_BUTTON_TEXT}
-                        </button>
-                    </div>
-                </div>
-            </div>
-
-            <!-- Calibration -->
-            <div class="bg-gradient-to-br from-white to-emerald-50 rounded-2xl shadow-xl border border-emerald-200/30 p-6">
-                <h3 class="text-xl font-semibold text-gray-800 mb-4 flex items-center gap-2">
-                    <i data-lucide="scale" class="w-6 h-6 text-gray-500"></i>
-                    {CALIBRATION_TITLE}
-                </h3>
-                <div class="space-y-4">
-                    <p class="text-gray-600 text-sm">F&uuml;hren Sie einen 10-Sekunden-Kalibrierungstest durch, messen Sie dann die tats&auml;chlich ausgegebene Menge und geben Sie diese ein.</p>
-                    <div class="grid md:grid-cols-3 gap-4 items-end">
-                        <div>
-                            <label class="block text-sm font-medium text-gray-700 mb-2">Gemessene Menge (g)</label>
-                            <input type="number" id="calValue" placeholder="Ausgegebene Gramm" step="0.1"
-                                   class="w-full px-4 py-2 border border-gray-300 rounded-lg focus:ring-2 focus:ring-primary focus:border-transparent">
-                        </div>
-                        <button id="calibrate-btn" class="bg-slate-500 hover:bg-slate-600 text-white font-medium py-3 px-6 rounded-xl transition-all shadow-lg hover:shadow-xl">
-                            Test starten
-                        </button>
-                        <button id="set-calibration-btn" class="bg-emerald-500 hover:bg-emerald-600 text-white font-medium py-3 px-6 rounded-xl transition-all shadow-lg hover:shadow-xl">
-                            Kalibrierung speichern
-                        </button>
-                    </div>
-                </div>
-            </div>
-
-            <!-- Timezone Configuration -->
-            <div class="bg-gradient-to-br from-white to-teal-50 rounded-2xl shadow-xl border border-teal-200/30 p-6">
-                <h3 class="text-xl font-semibold text-gray-800 mb-4 flex items-center gap-2">
-                    <i data-lucide="clock" class="w-6 h-6 text-gray-500"></i>
-                    Zeitzone
-                </h3>
-                <div class="space-y-4">
-                    <div class="bg-blue-50 border border-blue-200 rounded-lg p-3">
-                        <div class="text-sm font-medium text-blue-800">Aktuelle Zeit</div>
-                        <div class="text-blue-600">{CURRENT_TIME}</div>
-                    </div>
-                    <div class="grid md:grid-cols-2 gap-4">
-                        <div>
-                            <label class="block text-sm font-medium text-gray-700 mb-2">Zeitzone</label>
-                            <select id="timezone" class="w-full px-4 py-2 border border-gray-300 rounded-lg focus:ring-2 focus:ring-primary focus:border-transparent">
-                                <option value="CET-1CEST,M3.5.0,M10.5.0/3">Europa/Berlin (MEZ/MESZ)</option>
-                                <option value="GMT0BST,M3.5.0/1,M10.5.0">Europa/London (GMT/BST)</option>
-                                <option value="CET-1CEST,M3.5.0/2,M10.5.0/3">Europa/Paris (MEZ/MESZ)</option>
-                                <option value="EET-2EEST,M3.5.0/3,M10.5.0/4">Europa/Helsinki (OEZ/OESZ)</option>
-                                <option value="EST5EDT,M3.2.0,M11.1.0">Amerika/New_York (EST/EDT)</option>
-                                <option value="PST8PDT,M3.2.0,M11.1.0">Amerika/Los_Angeles (PST/PDT)</option>
-                                <option value="JST-9">Asien/Tokio (JST)</option>
-                            </select>
-                        </div>
-                        <div class="flex items-end">
-                            <button id="update-timezone-btn" class="bg-primary hover:bg-secondary text-white font-medium py-2 px-6 rounded-lg transition-colors">
-                                Zeitzone speichern
-                            </button>
-                        </div>
-                    </div>
-                </div>
-            </div>
-
-            <!-- WiFi Configuration -->
-            <div class="bg-gradient-to-br from-white to-blue-50 rounded-2xl shadow-xl border border-blue-200/30 p-6">
-                <h3 class="text-xl font-semibold text-gray-800 mb-4 flex items-center gap-2">
-                    <i data-lucide="wifi" class="w-6 h-6 text-gray-500"></i>
-                    WLAN-Konfiguration
-                </h3>
-                <div class="space-y-4">
-                    <div class="bg-blue-50 border border-blue-200 rounded-lg p-3">
-                        <div class="text-sm font-medium text-blue-800">Aktuelle Verbindung</div>
-                        <div class="text-blue-600">{WIFI_INFO}</div>
-                    </div>
-                    <div class="grid md:grid-cols-2 gap-4">
-                        <div>
-                            <label class="block text-sm font-medium text-gray-700 mb-2">Netzwerkname (SSID)</label>
-                            <input type="text" id="wifiSSID" placeholder="WLAN-Netzwerkname"
-                                   class="w-full px-4 py-2 border border-gray-300 rounded-lg focus:ring-2 focus:ring-primary focus:border-transparent">
-                        </div>
-                        <div>
-                            <label class="block text-sm font-medium text-gray-700 mb-2">Passwort</label>
-                            <input type="password" id="wifiPassword" placeholder="WLAN-Passwort"
-                                   class="w-full px-4 py-2 border border-gray-300 rounded-lg focus:ring-2 focus:ring-primary focus:border-transparent">
-                        </div>
-                    </div>
-                    <button id="update-wifi-btn" class="bg-blue-500 hover:bg-blue-600 text-white font-medium py-2 px-6 rounded-lg transition-colors">
-                        WLAN speichern & neustarten
-                    </button>
-                </div>
-            </div>
-
-            <!-- Firmware Update -->
-            <div class="bg-gradient-to-br from-white to-purple-50 rounded-2xl shadow-xl border border-purple-200/30 p-6">
-                <h3 class="text-xl font-semibold text-gray-800 mb-4 flex items-center gap-2">
-                    <i data-lucide="download" class="w-6 h-6 text-gray-500"></i>
-                    Firmware-Update
-                </h3>
-                <div class="space-y-4">
-                    <div class="bg-purple-50 border border-purple-200 rounded-lg p-3">
-                        <div class="text-sm font-medium text-purple-800">Aktuelle Version</div>
-                        <div class="text-purple-600">Henny v2.0 - Built {BUILD_DATE}</div>
-                    </div>
-                    <div class="bg-yellow-50 border border-yellow-200 rounded-lg p-3">
-                        <div class="text-sm font-medium text-yellow-800">⚠️ Hinweis</div>
-                        <div class="text-yellow-700 text-sm">Laden Sie nur offizielle Firmware-Dateien (.bin) hoch. Während des Updates darf die Stromversorgung nicht unterbrochen werden.</div>
-                    </div>
-                    <a href="/update" class="inline-block bg-purple-500 hover:bg-purple-600 text-white font-medium py-2 px-6 rounded-lg transition-colors">
-                        Firmware aktualisieren
-                    </a>
-                </div>
-            </div>
-        </div>
-    </div>
-
-    <script>
-        // Language definitions
-        const translations = {
-            de: {
-                motorTestStarted: 'Motor-Test gestartet (3 Sekunden)',
-                motorTestFailed: 'Motor-Test fehlgeschlagen',
-                calibrationStarted: 'Kalibrierung gestartet! Messen Sie die ausgegebene Menge und geben Sie diese unten ein.',
-                calibrationFailed: 'Kalibrierung fehlgeschlagen. Bitte erneut versuchen.',
-                calibrationUpdated: 'Kalibrierung aktualisiert!',
-                calibrationUpdateFailed: 'Kalibrierung konnte nicht aktualisiert werden.',
-                validCalibrationValue: 'Bitte geben Sie einen gültigen Kalibrierungswert ein.',
-                configUpdated: 'Konfiguration aktualisiert!',
-                configUpdateFailed: 'Konfiguration konnte nicht aktualisiert werden.',
-                completed: 'Erledigt',
-                pending: 'Ausstehend',
-                scheduled: 'Geplant'
-            },
-            en: {
-                motorTestStarted: 'Motor test started (3 seconds)',
-                motorTestFailed: 'Motor test failed',
-                calibrationStarted: 'Calibration started! Measure the dispensed amount and enter it below.',
-                calibrationFailed: 'Calibration failed. Please try again.',
-                calibrationUpdated: 'Calibration updated!',
-                calibrationUpdateFailed: 'Could not update calibration.',
-                validCalibrationValue: 'Please enter a valid calibration value.',
-                configUpdated: 'Configuration updated!',
-                configUpdateFailed: 'Could not update configuration.',
-                completed: 'Completed',
-                pending: 'Pending',
-                scheduled: 'Scheduled'
-            }
-        };
-        
-        const lang = translations['{LANGUAGE}'] || translations['de'];
-        
-        function toggleSettings() {
-            const panel = document.getElementById('settings-panel');
-            const dashboard = document.getElementById('dashboard-grid');
-            
-            panel.classList.toggle('hidden');
-            dashboard.classList.toggle('hidden');
-        }
-        
-        async function testMotor() {
-            try {
-                await fetch('/test-motor');
-                showNotification(lang.motorTestStarted, 'info');
-            } catch (error) {
-                showNotification(lang.motorTestFailed, 'error');
-            }
-        }
+Config config;
+ConfigStore configStore;
+ConnectionManager connection;
+TimeService timeService;
+ResponseCache statusCache;
 
-        
-        async function calibrate() {
-            try {
-                await fetch('/calibrate');
-                showNotification(lang.calibrationStarted, 'info');
-            } catch (error) {
-                showNotification(lang.calibrationFailed, 'error');
-            }
-        }
-        
-        async function setCalibration() {
-            const value = document.getElementById('calValue').value;
-            if (value && value > 0) {
-                try {
-                    await fetch('/setcal?value=' + value);
-                    showNotification(lang.calibrationUpdated, 'success');
-                    setTimeout(() => location.reload(), 1500);
-                } catch (error) {
-                    showNotification(lang.calibrationUpdateFailed, 'error');
-                }
-            } else {
-                showNotification(lang.validCalibrationValue, 'error');
-            }
-        }
-        
-        async function toggleLanguage() {
-            const currentLang = '{LANGUAGE}';
-            const newLang = currentLang === 'de' ? 'en' : 'de';
-            try {
-                await fetch('/config?language=' + newLang);
-                location.reload();
-            } catch (error) {
-                console.error('Language toggle failed:', error);
-            }
-        }
-        
-        async function updateConfig() {
-            const adults = document.getElementById('adultCount').value;
-            const feedAmount = document.getElementById('feedAmount').value;
-            const feedingFrequency = document.getElementById('feedFrequency').value;
-            const sunriseOffset = document.getElementById('sunriseOffset').value;
-            const sunsetOffset = document.getElementById('sunsetOffset').value;
-            if (adults >= 0 && feedAmount >= 80 && feedAmount <= 200 && feedingFrequency >= 1 && feedingFrequency <= 8 && sunriseOffset >= 1 && sunriseOffset <= 4 && sunsetOffset >= 1 && sunsetOffset <= 4) {
-                try {
-                    await fetch('/config?adults=' + adults + '&feedAmount=' + feedAmount + '&feedFrequency=' + feedingFrequency + '&sunriseOffset=' + sunriseOffset + '&sunsetOffset=' + sunsetOffset);
-                    showNotification(lang.configUpdated, 'success');
-                    setTimeout(() => location.reload(), 1500);
-                } catch (error) {
-                    showNotification(lang.configUpdateFailed, 'error');
-                }
-            }
-        }
-        
-        async function updateTimezone() {
-            const timezone = document.getElementById('timezone').value;
-            
-            if (confirm('Zeitzone ändern? Das Gerät wird neu gestartet.')) {
-                try {
-                    await fetch('/timezone', {
-                        method: 'POST',
-                        headers: {'Content-Type': 'application/x-www-form-urlencoded'},
-                        body: 'timezone=' + encodeURIComponent(timezone)
-                    });
-                    showNotification('Zeitzone gespeichert! Gerät startet neu...', 'success');
-                } catch (error) {
-                    showNotification('Zeitzone konnte nicht gespeichert werden.', 'error');
-                }
-            }
-        }
-        
-        async function updateWiFi() {
-            const ssid = document.getElementById('wifiSSID').value.trim();
-            const password = document.getElementById('wifiPassword').value;
-            
-            if (!ssid) {
-                showNotification('Bitte geben Sie einen Netzwerknamen ein.', 'error');
-                return;
-            }
-            
-            if (confirm('WLAN-Einstellungen speichern und neu starten? Das Gerät wird sich verbinden mit: ' + ssid)) {
-                try {
-                    await fetch('/wifi', {
-                        method: 'POST',
-                        headers: {'Content-Type': 'application/x-www-form-urlencoded'},
-                        body: 'ssid=' + encodeURIComponent(ssid) + '&password=' + encodeURIComponent(password)
-                    });
-                    showNotification('WLAN-Einstellungen gespeichert! Gerät startet neu...', 'success');
-                } catch (error) {
-                    showNotification('WLAN-Einstellungen konnten nicht gespeichert werden.', 'error');
-                }
-            }
-        }
-        
-        function showNotification(message, type) {
-            const colors = {
-                success: 'bg-green-500',
-                error: 'bg-red-500',
-                info: 'bg-blue-500'
-            };
-            
-            const notification = document.createElement('div');
-            notification.className = `fixed top-4 right-4 ${colors[type]} text-white px-6 py-3 rounded-lg shadow-lg z-50 transform translate-x-full transition-transform duration-300`;
-            notification.textContent = message;
-            
-            document.body.appendChild(notification);
-            
-            setTimeout(() => notification.classList.remove('translate-x-full'), 100);
-            setTimeout(() => {
-                notification.classList.add('translate-x-full');
-                setTimeout(() => document.body.removeChild(notification), 300);
-            }, 1000);
-        }
-        
-        function updateChickenDisplay(value) {
-            document.getElementById('chickenCountDisplay').textContent = value;
-        }
-        
-        function updateFeedAmountDisplay(value) {
-            document.getElementById('feedAmountDisplay').textContent = value;
-        }
-        
-        function updateFeedFrequencyDisplay(value) {
-            document.getElementById('feedFrequencyDisplay').textContent = value;
-        }
-        
-        function updateSunriseOffsetDisplay(value) {
-            document.getElementById('sunriseOffsetDisplay').textContent = value;
-        }
-        
-        function updateSunsetOffsetDisplay(value) {
-            document.getElementById('sunsetOffsetDisplay').textContent = value;
-        }
-        
-        function updateFeedingSchedule() {
-            // Get current time
-            const now = new Date();
-            const currentHour = now.getHours();
-            const currentMinute = now.getMinutes();
-            
-            // Generate schedule based on feeding frequency and sunrise/sunset offsets
-            const configuredFrequency = {FEED_FREQUENCY};
-            const sunriseOffsetHours = {SUNRISE_OFFSET};
-            const sunsetOffsetHours = {SUNSET_OFFSET};
-            let currentSchedule = [];
-            
-            // Calculate sunrise and sunset times (simplified for demo)
-            const dayOfYear = Math.floor((now - new Date(now.getFullYear(), 0, 0)) / 86400000);
-            const angle = (dayOfYear - 172) * 2.0 * Math.PI / 365.0;
-            const sunriseHour = Math.floor(7.0 - 1.5 * Math.cos(angle)); // Between 5.5 and 8.5
-            const sunsetHour = Math.floor(19.0 + 2.5 * Math.cos(angle)); // Between 16.5 and 21.5
-            
-            // Generate feeding times based on offsets
-            const startHour = sunriseHour + sunriseOffsetHours;
-            const endHour = sunsetHour - sunsetOffsetHours;
-            const totalHours = Math.max(1, endHour - startHour); // Ensure at least 1 hour window
-            
-            if (configuredFrequency === 1) {
-                currentSchedule.push({hour: startHour + Math.floor(totalHours / 2), minute: 0});
-            } else {
-                for (let i = 0; i < configuredFrequency; i++) {
-                    const position = i / (configuredFrequency - 1);
-                    const hour = startHour + Math.floor(totalHours * position);
-                    currentSchedule.push({hour: hour, minute: 0});
-                }
-            }
-            
-            // Calculate feed amount per feeding
-            const adultChickens = {ADULTS};
-            const feedPerChicken = {FEED_AMOUNT};
-            const dailyTotal = adultChickens * feedPerChicken;
-            const perFeeding = Math.round(dailyTotal / configuredFrequency);
-            
-            // Calculate runtime based on calibration (grams per 10 seconds)
-            const calibration = {CALIBRATION}; // grams per 10 seconds
-            const gramsPerSecond = calibration / 10;
-            const runtimeSeconds = Math.round(perFeeding / gramsPerSecond);
-            
-            // Generate schedule HTML
-            const scheduleContainer = document.getElementById('feeding-schedule');
-            scheduleContainer.innerHTML = '';
-            
-            currentSchedule.forEach(feeding => {
-                const feedingTime = feeding.hour * 100 + feeding.minute;
-                const currentTime = currentHour * 100 + currentMinute;
-                
-                let status, statusClass;
-                if (feedingTime < currentTime - 5) {
-                    status = lang.completed;
-                    statusClass = 'bg-green-100 text-green-800';
-                } else if (feedingTime <= currentTime + 5 && feedingTime >= currentTime - 5) {
-                    status = lang.pending;
-                    statusClass = 'bg-yellow-100 text-yellow-800';
-                } else {
-                    status = lang.scheduled;
-                    statusClass = 'bg-gray-100 text-gray-600';
-                }
-                
-                const timeStr = feeding.hour.toString().padStart(2, '0') + ':' + feeding.minute.toString().padStart(2, '0');
-                
-                const feedingRow = document.createElement('tr');
-                feedingRow.innerHTML = `
-                    <td class="text-gray-600 font-medium text-right py-2 pr-3">${timeStr}</td>
-                    <td class="text-xs text-gray-500 font-medium text-center py-2 px-3">${perFeeding}g</td>
-                    <td class="text-xs text-gray-400 font-medium text-center py-2 px-3">${runtimeSeconds}s</td>
-                    <td class="py-2 pl-3">
-                        <span class="text-sm ${statusClass} px-3 py-1 rounded-full">${status}</span>
-                    </td>
-                `;
-                scheduleContainer.appendChild(feedingRow);
-            });
-        }
-        
-        // Initialize everything when DOM is ready
-        document.addEventListener('DOMContentLoaded', function() {
-            // Initialize Lucide icons
-            lucide.createIcons();
-            
-            // Setup event listeners
-            document.getElementById('test-motor-btn').addEventListener('click', testMotor);
-            document.getElementById('language-btn').addEventListener('click', toggleLanguage);
-            document.getElementById('install-btn').addEventListener('click', showInstallPrompt);
-            document.getElementById('settings-btn').addEventListener('click', toggleSettings);
-            document.getElementById('update-config-btn').addEventListener('click', updateConfig);
-            document.getElementById('calibrate-btn').addEventListener('click', calibrate);
-            document.getElementById('set-calibration-btn').addEventListener('click', setCalibration);
-            document.getElementById('update-timezone-btn').addEventListener('click', updateTimezone);
-            document.getElementById('update-wifi-btn').addEventListener('click', updateWiFi);
-            
-            // Update feeding schedule
-            updateFeedingSchedule();
-        });
-        
-        // PWA Install functionality
-        let deferredPrompt;
-        
-        window.addEventListener('beforeinstallprompt', (e) => {
-            e.preventDefault();
-            deferredPrompt = e;
-            document.getElementById('install-btn').classList.remove('hidden');
-        });
-        
-        function showInstallPrompt() {
-            if (deferredPrompt) {
-                deferredPrompt.prompt();
-                deferredPrompt.userChoice.then((choiceResult) => {
-                    if (choiceResult.outcome === 'accepted') {
-                        showNotification('App installed successfully!', 'success');
-                    } else {
-                        showNotification('App installation declined', 'info');
-                    }
-                    deferredPrompt = null;
-                    document.getElementById('install-btn').classList.add('hidden');
-                });
-            } else {
-                showNotification('App is already installed or not supported', 'info');
-            }
-        }
-        
-        // Register service worker
-        if ('serviceWorker' in navigator) {
-            window.addEventListener('load', () => {
-                navigator.serviceWorker.register('/sw.js')
-                    .then((registration) => {
-                        console.log('SW registered: ', registration);
-                    })
-                    .catch((registrationError) => {
-                        console.log('SW registration failed: ', registrationError);
-                    });
-            });
-        }
-        
-        // Fallback for immediate loading
-        if (document.readyState !== 'loading') {
-            lucide.createIcons();
-            document.getElementById('test-motor-btn')?.addEventListener('click', testMotor);
-            document.getElementById('language-btn')?.addEventListener('click', toggleLanguage);
-            document.getElementById('install-btn')?.addEventListener('click', showInstallPrompt);
-            document.getElementById('settings-btn')?.addEventListener('click', toggleSettings);
-            document.getElementById('update-config-btn')?.addEventListener('click', updateConfig);
-            document.getElementById('calibrate-btn')?.addEventListener('click', calibrate);
-            document.getElementById('set-calibration-btn')?.addEventListener('click', setCalibration);
-            document.getElementById('update-timezone-btn')?.addEventListener('click', updateTimezone);
-            document.getElementById('update-wifi-btn')?.addEventListener('click', updateWiFi);
-            updateFeedingSchedule();
-        }
-    </script>
-</body>
-</html>
-)HTML";
+void handleRoot() {
+    // Same URL for every language, so revalidate instead of caching blindly
+    sendWebAsset(server, DASHBOARD_PAGES[config.language], "text/html", "no-cache");
+}
+
+// Local "HH:MM" of an epoch
+void formatClock(time_t epoch, char* buffer, size_t size) {
+    struct tm local;
+    localtime_r(&epoch, &local);
+    strftime(buffer, size, "%H:%M", &local);
+}
 
-    // Get current time
-    String currentTime = "---";
+void handleStatus() {
+    power.keepAwake(WIFI_WINDOW_MS); // someone is looking at the dashboard
+    
+    // Between settings changes the status only moves with the clock minute
+    // and the WiFi state
+    char etag[40];
+    statusCache.makeETag(etag, sizeof(etag), configGeneration, time(nullptr) / 60,
+                         WiFi.isConnected() | connection.isAccessPoint() << 1);
+    server.sendHeader("ETag", etag);
+    server.sendHeader("Cache-Control", "no-cache");
+    if (strcmp(server.header("If-None-Match"), etag) == 0) {
+        server.send(304);
+        return;
+    }
+    if (statusCache.holds(etag)) {
+        server.send_P(200, "application/json", statusCache.body(), statusCache.length());
+        return;
+    }
+    
+    JsonBuffer<STATUS_CACHE_SIZE> json;
+    
+    char currentTime[6] = "---";
     struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-        char timeStr[6];
-        strftime(timeStr, sizeof(timeStr), "%H:%M", &timeinfo);
-        currentTime = String(timeStr);
-    }
-    
-    // Calculate feed amounts
-    float dailyFeed = scheduler.getDailyFeedAmount(adultChickens, feedAmountPerChicken);
-    float monthlyFeed = dailyFeed * 30.0 / 1000.0; // Convert to kg
-    
-    // Get build date
-    String buildDate = String(__DATE__) + " " + String(__TIME__);
-    
-    // Replace placeholders
-    html.replace("{LANG}", language);
-    html.replace("{LANGUAGE}", language);
-    html.replace("{ADULTS}", String(adultChickens));
-    html.replace("{FEED_AMOUNT}", String(feedAmountPerChicken));
-    html.replace("{FEED_FREQUENCY}", String(feedFrequency));
-    html.replace("{SUNRISE_OFFSET}", String(sunriseOffset));
-    html.replace("{SUNSET_OFFSET}", String(sunsetOffset));
-    html.replace("{CALIBRATION}", String(spreader.getCalibration()));
-    html.replace("{WIFI_NETWORK}", WiFi.isConnected() ? WiFi.SSID() : (language == "en" ? "AP Mode" : "AP-Modus"));
-    html.replace("{WIFI_INFO}", WiFi.isConnected() ? WiFi.SSID() + (language == "en" ? " (Connected)" : " (Verbunden)") : (language == "en" ? "AP Mode: Henny-Setup" : "AP-Modus: Henny-Setup"));
-    html.replace("{SUNRISE}", scheduler.getSunriseTime());
-    html.replace("{SUNSET}", scheduler.getSunsetTime());
-    html.replace("{CURRENT_TIME}", currentTime);
-    html.replace("{DAILY_FEED}", String((int)dailyFeed));
-    html.replace("{MONTHLY_FEED}", String(monthlyFeed, 1));
-    html.replace("{BUILD_DATE}", buildDate);
-    
-    // Replace translation placeholders
-    html.replace("{SUBTITLE}", getTranslation("subtitle", language));
-    html.replace("{FEEDING_SCHEDULE_TITLE}", getTranslation("feeding_schedule_title", language));
-    html.replace("{SUNRISE_TEXT}", getTranslation("sunrise_text", language));
-    html.replace("{SUNSET_TEXT}", getTranslation("sunset_text", language));
-    html.replace("{SYSTEM_STATUS_TITLE}", getTranslation("system_status_title", language));
-    html.replace("{ADULT_CHICKENS_TEXT}", getTranslation("adult_chickens_text", language));
-    html.replace("{CALIBRATION_TEXT}", getTranslation("calibration_text", language));
-    html.replace("{TIME_TEXT}", getTranslation("time_text", language));
-    html.replace("{DAILY_FEED_TEXT}", getTranslation("daily_feed_text", language));
-    html.replace("{MONTHLY_FEED_TEXT}", getTranslation("monthly_feed_text", language));
-    html.replace("{CHICKEN_CONFIG_TITLE}", getTranslation("chicken_config_title", language));
-    html.replace("{ADULT_CHICKENS_LABEL}", getTranslation("adult_chickens_label", language));
-    html.replace("{FEED_PER_CHICKEN_LABEL}", getTranslation("feed_per_chicken_label", language));
-    html.replace("{FEEDINGS_PER_DAY_LABEL}", getTranslation("feedings_per_day_label", language));
-    html.replace("{FIRST_FEEDING_LABEL}", getTranslation("first_feeding_label", language));
-    html.replace("{LAST_FEEDING_LABEL}", getTranslation("last_feeding_label", language));
-    html.replace("{AFTER_SUNRISE_TEXT}", getTranslation("after_sunrise_text", language));
-    html.replace("{BEFORE_SUNSET_TEXT}", getTranslation("before_sunset_text", language));
-    html.replace("{UPDATE_BUTTON_TEXT}", getTranslation("update_button_text", language));
-    html.replace("{CALIBRATION_TITLE}", getTranslation("calibration_title", language));
-    html.replace("{CALIBRATION_INSTRUCTION}", getTranslation("calibration_instruction", language));
-    html.replace("{MEASURED_AMOUNT_LABEL}", getTranslation("measured_amount_label", language));
-    html.replace("{DISPENSED_GRAMS_PLACEHOLDER}", getTranslation("dispensed_grams_placeholder", language));
-    html.replace("{START_TEST_BUTTON}", getTranslation("start_test_button", language));
-    html.replace("{SAVE_CALIBRATION_BUTTON}", getTranslation("save_calibration_button", language));
-    String langDisplay = language;
-    langDisplay.toUpperCase();
-    html.replace("{LANGUAGE_DISPLAY}", langDisplay);
-    
-    return html;
+    if (getLocalTime(&timeinfo, 0)) {
+        strftime(currentTime, sizeof(currentTime), "%H:%M", &timeinfo);
+    }
+    DayPlan today;
+    bool planned = scheduler.planToday(today);
+    char sunrise[6] = "---";
+    char sunset[6] = "---";
+    char nextFeeding[6] = "---";
+    if (planned) {
+        formatClock(today.sunrise, sunrise, sizeof(sunrise));
+        formatClock(today.sunset, sunset, sizeof(sunset));
+    }
+    if (scheduler.getNextFeeding() != 0) {
+        formatClock(scheduler.getNextFeeding(), nextFeeding, sizeof(nextFeeding));
+    }
+    
+    json.add("lang", LANGUAGE_CODES[config.language]);
+    json.add("adults", config.adults);
+    json.add("feedAmount", config.feedAmount);
+    json.add("feedFrequency", config.feedFrequency);
+    json.add("sunriseOffset", config.sunriseOffset);
+    json.add("sunsetOffset", config.sunsetOffset);
+    json.add("calibration", spreader.getCalibration(), 2);
+    const CalibrationModel& model = spreader.getCalibrationModel();
+    json.add("gramsPerSecond", model.getGramsPerSecond(), 3);
+    json.add("deadTimeMs", model.getDeadTimeMs(), 0);
+    json.add("calibrationRuns", (int)model.pointCount());
+    json.add("calibrationResidual", model.getRmsResidual(), 2);
+    float dailyFeed = scheduler.getDailyFeedAmount(config.adults, config.feedAmount);
+    json.add("dailyFeed", dailyFeed, 1);
+    json.add("time", currentTime);
+    json.add("sunrise", sunrise);
+    json.add("sunset", sunset);
+    json.add("nextFeeding", nextFeeding);
+    json.beginArray("feedings");
+    for (int i = 0; planned && i < today.count; i++) {
+        char time[6];
+        formatClock(today.feedings[i], time, sizeof(time));
+        json.beginObject(nullptr);
+        json.add("time", time);
+        json.add("epoch", (unsigned long)today.feedings[i]);
+        json.add("grams", today.perFeeding, 1);
+        json.endObject();
+    }
+    json.endArray();
+    json.add("catchUp", (int)config.catchUp);
+    json.add("catchUpWindow", (int)config.catchUpWindow);
+    json.add("latitude", scheduler.getLatitude(), 4);
+    json.add("longitude", scheduler.getLongitude(), 4);
+    json.beginObject("wifi");
+    bool connected = WiFi.isConnected();
+    json.add("connected", connected);
+    json.add("ssid", connected ? config.ssid : "");
+    json.add("accessPoint", connection.isAccessPoint());
+    json.add("reachableMs", (int)connection.getReachableMs());
+    json.add("fastConnect", connected && connection.usedCache());
+    json.add("staticIp", config.staticIp ? ipToText(config.staticIp).c_str() : "");
+    json.endObject();
+    json.beginObject("clock");
+    json.add("source", timeService.sourceName());
+    json.add("syncAgeS", (int)timeService.getSyncAge());
+    json.add("errorMs", (int)timeService.getErrorMs());
+    json.add("driftPpm", timeService.getDriftPpm(), 1);
+    json.endObject();
+    json.beginObject("power");
+    json.add("mode", (int)config.powerMode);
+    json.add("wifiInterval", (int)config.wifiInterval);
+    json.add("dutyCycle", power.getDutyCycle(), 4);
+    json.add("awakeS", (unsigned long)(power.getAwakeUs() / 1000000));
+    json.add("asleepS", (unsigned long)(power.getAsleepUs() / 1000000));
+    json.endObject();
+    time_t now = time(nullptr);
+    float rate = consumption.trailingDailyGrams(now);
+    float remaining = max((float)config.hopperCapacity - consumption.getSinceRefill(), 0.0f);
+    json.beginObject("consumption");
+    json.add("today", consumption.today(now).grams, 1);
+    json.add("week", consumption.thisWeek(now).grams, 1);
+    json.add("month", consumption.thisMonth(now).grams, 1);
+    json.add("motorTodayS", (unsigned long)(consumption.today(now).motorMs / 1000));
+    json.add("dailyRate", rate, 1);
+    json.add("hopperCapacity", (unsigned long)config.hopperCapacity);
+    json.add("hopperRemaining", remaining, 0);
+    // From the measured trend once there is one, until then from the plan
+    float usePerDay = rate > 0 ? rate : dailyFeed;
+    json.add("daysLeft", config.hopperCapacity && usePerDay > 0 ? remaining / usePerDay : -1.0f, 1);
+    json.endObject();
+    json.add("build", __DATE__ " " __TIME__);
+    const char* body = json.finish();
+    
+    if (json.overflowed()) {
+        server.send(500, "text/plain", "Status too large");
+        return;
+    }
+    statusCache.store(etag, body, json.length());
+    server.send_P(200, "application/json", body, json.length());
 }
 
-void handleRoot() {
-    server.send(200, "text/html", generateHTML());
+// A finite number that is the whole of text: atof() would take "nan",
+// "inf" or "12abc", and NaN passes every range check
+bool parseNumber(const char* text, float& value) {
+    char* end;
+    value = strtof(text, &end);
+    return end != text && *end == '\0' && isfinite(value);
 }
 
+// Answers a queued motor run with its job id, to be polled via /api/job
+void sendJob(uint32_t id) {
+    if (id == 0) {
+        server.send(503, "text/plain", "Motor queue full");
+        return;
+    }
+    JsonBuffer<32> json;
+    json.add("job", (unsigned long)id);
+    const char* body = json.finish();
+    server.send_P(202, "application/json", body, json.length());
+}
+
+// Up to what one run delivers before the motor timeout cuts it off
 void handleFeed() {
     if (server.hasArg("amount")) {
-        float amount = server.arg("amount").toFloat();
-        spreader.spreadFeed(amount);
-        server.send(200, "text/plain", "OK");
+        float amount;
+        float most = spreader.getCalibrationModel().predictGrams(MOTOR_TIMEOUT_MS);
+        if (!parseNumber(server.arg("amount"), amount) || amount <= 0 || amount > most) {
+            server.send(400, "text/plain", "Invalid amount");
+            return;
+        }
+        sendJob(spreader.spreadFeed(amount, HISTORY_WEB));
     } else {
         server.send(400, "text/plain", "Missing amount");
     }
 }
 
 void handleCalibrate() {
-    spreader.calibrationRun();
-    server.send(200, "text/plain", "Calibration started");
+    if (server.hasArg("seconds")) {
+        float seconds;
+        if (!parseNumber(server.arg("seconds"), seconds) || seconds <= 0 || seconds > MOTOR_TIMEOUT_MS / 1000) {
+            server.send(400, "text/plain", "Invalid duration");
+            return;
+        }
+        sendJob(spreader.calibrationRun(seconds * 1000));
+    } else {
+        sendJob(spreader.calibrationRun());
+    }
+}
+
+void handleCalibrationModel() {
+    const CalibrationModel& model = spreader.getCalibrationModel();
+    JsonBuffer<768> json;
+    json.add("gramsPerSecond", model.getGramsPerSecond(), 3);
+    json.add("deadTimeMs", model.getDeadTimeMs(), 0);
+    json.add("rmsResidual", model.getRmsResidual(), 2);
+    json.beginArray("runs");
+    for (uint8_t i = 0; i < model.pointCount(); i++) {
+        json.beginObject(nullptr);
+        json.add("durationMs", (unsigned long)model.point(i).durationMs);
+        json.add("grams", model.point(i).grams, 1);
+        json.add("residual", model.residual(i), 2);
+        json.endObject();
+    }
+    json.endArray();
+    const char* body = json.finish();
+    
+    if (json.overflowed()) {
+        server.send(500, "text/plain", "Calibration too large");
+        return;
+    }
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send_P(200, "application/json", body, json.length());
+}
+
+void handleClearCalibration() {
+    spreader.clearCalibration();
+    configGeneration++;
+    server.send(200, "text/plain", "OK");
+}
+
+void handleHopperRefill() {
+    consumption.refill(preferences, time(nullptr));
+    configGeneration++;
+    server.send(200, "text/plain", "OK");
 }
 
 void handleTestMotor() {
-    spreader.testRun();
-    server.send(200, "text/plain", "Motor test started");
+    sendJob(spreader.testRun());
+}
+
+void handleStop() {
+    if (!spreader.emergencyStop()) {
+        server.send(503, "text/plain", "Motor busy");
+        return;
+    }
+    server.send(200, "text/plain", "OK");
+}
+
+void handleJob() {
+    if (!server.hasArg("id")) {
+        server.send(400, "text/plain", "Missing id");
+        return;
+    }
+    uint32_t id = atol(server.arg("id"));
+    JsonBuffer<96> json;
+    json.add("job", (unsigned long)id);
+    MotorJobResult result = spreader.getJobResult(id);
+    json.add("state", JOB_STATE_NAMES[result.state]);
+    if (result.state == JOB_DONE || result.state == JOB_CANCELLED) {
+        json.add("onTimeUs", (unsigned long)result.onTimeUs);
+    }
+    const char* body = json.finish();
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send_P(200, "application/json", body, json.length());
+}
+
+// Each task's stack headroom and CPU share, and how closely the motor
+// task keeps to the requested dose lengths
+void handleTasks() {
+    JsonBuffer<TASKS_JSON_SIZE> json;
+    taskMonitor.report(json);
+    MotorState state = motorState.read();
+    json.beginObject("motor");
+    json.add("timeoutMs", (unsigned long)MOTOR_TIMEOUT_MS);
+    json.add("longestOnTimeUs", (unsigned long)state.longestOnTimeUs);
+    json.add("maxOverrunUs", (unsigned long)state.maxOverrunUs);
+    json.endObject();
+    const char* body = json.finish();
+    server.sendHeader("Cache-Control", "no-cache");
+    server.send_P(200, "application/json", body, json.length());
+}
+
+// Next piece of the scrape. progress counts the metric items sent so far;
+// a route without samples or the signal while offline still takes its
+// places, so that the items after it keep theirs from piece to piece.
+size_t writeMetrics(void* progress, char* buffer, size_t size) {
+    uint32_t& sent = *(uint32_t*)progress;
+    MetricsWriter metrics(buffer, size, sent);
+    
+    FixedString<48> route;
+    metrics.family("henny_http_handler_seconds", "histogram", "Time spent in each route's handler");
+    for (uint8_t i = 0; i < server.routesAdded(); i++) {
+        if (server.routeLatency(i).count == 0) { // keeps the response small
+            metrics.skip();
+            continue;
+        }
+        route.clear();
+        route.appendf("%s %s", HttpServer::methodName(server.routeMethod(i)), server.routeUri(i));
+        metrics.histogram("henny_http_handler_seconds", server.routeLatency(i), "route", route.c_str());
+    }
+    metrics.family("henny_http_handler_max_seconds", "gauge", "Longest run of each route's handler");
+    for (uint8_t i = 0; i < server.routesAdded(); i++) {
+        if (server.routeLatency(i).count == 0) {
+            metrics.skip();
+            continue;
+        }
+        route.clear();
+        route.appendf("%s %s", HttpServer::methodName(server.routeMethod(i)), server.routeUri(i));
+        metrics.gauge("henny_http_handler_max_seconds", server.routeLatency(i).maxUs / 1e6f, "route", route.c_str());
+    }
+    metrics.family("henny_http_lock_wait_seconds", "histogram", "Time handlers waited for loop() to release the state");
+    metrics.histogram("henny_http_lock_wait_seconds", server.lockWaits());
+    metrics.family("henny_http_lock_wait_max_seconds", "gauge", "Longest wait of a handler for the state");
+    metrics.gauge("henny_http_lock_wait_max_seconds", server.lockWaits().maxUs / 1e6f);
+    metrics.family("henny_http_arena_bytes", "gauge", "Size of each connection's request arena");
+    metrics.gauge("henny_http_arena_bytes", (unsigned long)server.arenaSize());
+    metrics.family("henny_http_arena_high_water_bytes", "gauge", "Most of its arena one request has used");
+    metrics.gauge("henny_http_arena_high_water_bytes", (unsigned long)server.arenaHighWater());
+    metrics.family("henny_http_heap_bodies_total", "counter", "Response bodies too large for the arena, built on the heap");
+    metrics.gauge("henny_http_heap_bodies_total", (unsigned long)server.heapBodyCount());
+    
+    metrics.family("henny_loop_phase_seconds", "histogram", "Time spent in each phase of loop()");
+    for (uint8_t i = 0; i < LOOP_PHASE_COUNT; i++) {
+        metrics.histogram("henny_loop_phase_seconds", loopPhases[i], "phase", LOOP_PHASE_NAMES[i]);
+    }
+    metrics.family("henny_loop_phase_max_seconds", "gauge", "Longest run of each phase of loop()");
+    for (uint8_t i = 0; i < LOOP_PHASE_COUNT; i++) {
+        metrics.gauge("henny_loop_phase_max_seconds", loopPhases[i].maxUs / 1e6f, "phase", LOOP_PHASE_NAMES[i]);
+    }
+    metrics.family("henny_loop_pass_seconds", "histogram", "Passes of loop(), for which it holds the state");
+    metrics.histogram("henny_loop_pass_seconds", loopPasses);
+    metrics.family("henny_loop_pass_max_seconds", "gauge", "Longest pass of loop()");
+    metrics.gauge("henny_loop_pass_max_seconds", loopPasses.maxUs / 1e6f);
+    
+    const LatencyHistogram& journal = motor.journalWriteTimes();
+    metrics.family("henny_nvs_journal_write_seconds", "histogram", "NVS writes of the motor job journal");
+    metrics.histogram("henny_nvs_journal_write_seconds", journal);
+    metrics.family("henny_nvs_journal_write_max_seconds", "gauge", "Longest NVS write of the motor job journal");
+    metrics.gauge("henny_nvs_journal_write_max_seconds", journal.maxUs / 1e6f);
+    
+    MotorState state = motorState.read();
+    metrics.family("henny_motor_longest_on_seconds", "gauge", "Longest relay on-time since boot, against a 30 s timeout");
+    metrics.gauge("henny_motor_longest_on_seconds", state.longestOnTimeUs / 1e6f);
+    metrics.family("henny_motor_max_overrun_seconds", "gauge", "Most a finished dose ran past its requested length");
+    metrics.gauge("henny_motor_max_overrun_seconds", state.maxOverrunUs / 1e6f);
+    
+    taskMonitor.report(metrics);
+    
+    metrics.family("henny_heap_free_bytes", "gauge", "Free heap");
+    metrics.gauge("henny_heap_free_bytes", (unsigned long)ESP.getFreeHeap());
+    metrics.family("henny_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    metrics.gauge("henny_heap_min_free_bytes", (unsigned long)ESP.getMinFreeHeap());
+    metrics.family("henny_heap_largest_block_bytes", "gauge", "Largest block that can be allocated");
+    metrics.gauge("henny_heap_largest_block_bytes", (unsigned long)ESP.getMaxAllocHeap());
+    if (WiFi.status() == WL_CONNECTED) {
+        metrics.family("henny_wifi_rssi_dbm", "gauge", "Signal strength of the access point");
+        metrics.gauge("henny_wifi_rssi_dbm", (float)WiFi.RSSI());
+    } else {
+        metrics.skip(2);
+    }
+    metrics.family("henny_uptime_seconds", "counter", "Time since boot");
+    metrics.gauge("henny_uptime_seconds", (unsigned long)(esp_timer_get_time() / 1000000));
+    
+    sent = metrics.items();
+    return metrics.length();
+}
+
+// Prometheus text format for a local scraper: latency histograms of each
+// route served so far, of loop()'s phases and of NVS journal writes, each
+// with its longest sample, plus heap, WiFi signal and the task stats.
+// Written piece by piece as the scraper reads it.
+void handleMetrics() {
+    uint32_t* sent = (uint32_t*)server.requestMemory(sizeof(uint32_t));
+    if (!sent) {
+        server.send(503, "text/plain", "No memory for the metrics");
+        return;
+    }
+    *sent = 0;
+    server.sendHeader("Cache-Control", "no-cache");
+    server.sendStream(200, "text/plain; version=0.0.4", writeMetrics, sent);
+}
+
+// Where a /api/history response has got to, kept in the request arena
+struct HistoryStream {
+    HistoryLog::Cursor cursor;
+    uint32_t from;
+    uint32_t to;
+    bool opened;  // "[" sent
+    bool records; // at least one record sent
+    bool closed;  // "]" sent
+
+    HistoryStream(const HistoryLog::Cursor& start, uint32_t fromTime, uint32_t toTime)
+        : cursor(start), from(fromTime), to(toTime), opened(false), records(false), closed(false) {}
+};
+
+// Next piece of the JSON array, as many records as fit
+size_t writeHistory(void* state, char* buffer, size_t size) {
+    HistoryStream& stream = *(HistoryStream*)state;
+    if (stream.closed) return 0;
+    size_t used = 0;
+    if (!stream.opened) {
+        buffer[used++] = '[';
+        stream.opened = true;
+    }
+    HistoryRecord record;
+    while (used + HISTORY_RECORD_JSON_MAX < size) {
+        if (!stream.cursor.next(record)) {
+            buffer[used++] = ']';
+            stream.closed = true;
+            break;
+        }
+        if (record.timestamp < stream.from || record.timestamp > stream.to) continue;
+        used += snprintf(buffer + used, size - used,
+                         "%s{\"t\":%lu,\"slot\":%d,\"grams\":%.1f,\"onTimeUs\":%lu,\"source\":\"%s\",\"completed\":%s}",
+                         stream.records ? "," : "", (unsigned long)record.timestamp,
+                         record.slot == HISTORY_NO_SLOT ? -1 : record.slot, record.requestedGrams,
+                         (unsigned long)record.onTimeUs,
+                         record.source < HISTORY_SOURCE_COUNT ? HISTORY_SOURCE_NAMES[record.source] : "unknown",
+                         record.completed ? "true" : "false");
+        stream.records = true;
+    }
+    return used;
+}
+
+// Streams the recorded motor runs with timestamps in [from, to], oldest
+// first, as a chunked JSON array written a piece at a time as the client
+// takes it, so neither the array nor the wait for a slow client holds RAM
+// or the state. Records written while it streams may or may not be in it.
+void handleHistory() {
+    if (!history.available()) {
+        server.send(503, "text/plain", "No history partition");
+        return;
+    }
+    uint32_t from = server.hasArg("from") ? strtoul(server.arg("from"), nullptr, 10) : 0;
+    uint32_t to = server.hasArg("to") ? strtoul(server.arg("to"), nullptr, 10) : UINT32_MAX;
+    
+    void* memory = server.requestMemory(sizeof(HistoryStream));
+    if (!memory) {
+        server.send(503, "text/plain", "No memory for the history");
+        return;
+    }
+    server.sendHeader("Cache-Control", "no-cache");
+    server.sendStream(200, "application/json", writeHistory, new (memory) HistoryStream(history.records(), from, to));
 }
 
 void handleSetCalibration() {
     if (server.hasArg("value")) {
-        float value = server.arg("value").toFloat();
-        spreader.setCalibration(value);
+        float value = atof(server.arg("value"));
+        if (value <= 0) {
+            server.send(400, "text/plain", "Invalid value");
+            return;
+        }
+        spreader.addCalibrationMeasurement(value);
+        configGeneration++;
         server.send(200, "text/plain", "OK");
     } else {
         server.send(400, "text/plain", "Missing value");
     }
 }
 
+// Applies all given settings or, if any is invalid, none of them
 void handleConfig() {
+    Config next = config;
     bool updated = false;
     
+    if (server.hasArg("language")) {
+        if (!parseLanguage(server.arg("language"), next.language)) {
+            server.send(400, "text/plain", "Unknown language");
+            return;
+        }
+        updated = true;
+    }
+    
+    if (server.hasArg("latitude") && server.hasArg("longitude")) {
+        if (!parseNumber(server.arg("latitude"), next.latitude) ||
+            !parseNumber(server.arg("longitude"), next.longitude) ||
+            next.latitude < -90 || next.latitude > 90 || next.longitude < -180 || next.longitude > 180) {
+            server.send(400, "text/plain", "Invalid location");
+            return;
+        }
+        updated = true;
+    }
+    
+    if (server.hasArg("catchUp")) {
+        int policy = atol(server.arg("catchUp"));
+        if (policy < CATCHUP_SKIP || policy > CATCHUP_ALL) {
+            server.send(400, "text/plain", "Invalid catch-up rule");
+            return;
+        }
+        next.catchUp = (CatchUpPolicy)policy;
+        updated = true;
+    }
+    
+    if (server.hasArg("catchUpWindow")) {
+        int minutes = atol(server.arg("catchUpWindow"));
+        if (minutes < FEEDING_GRACE_S / 60 || minutes > MAX_CATCHUP_S / 60) {
+            server.send(400, "text/plain", "Invalid catch-up window");
+            return;
+        }
+        next.catchUpWindow = minutes;
+        updated = true;
+    }
+    
+    if (server.hasArg("powerMode")) {
+        int mode = atol(server.arg("powerMode"));
+        if (mode < POWER_ALWAYS_ON || mode > POWER_DEEP_SLEEP) {
+            server.send(400, "text/plain", "Invalid power mode");
+            return;
+        }
+        next.powerMode = (PowerMode)mode;
+        updated = true;
+    }
+    
+    if (server.hasArg("wifiInterval")) {
+        int minutes = atol(server.arg("wifiInterval"));
+        if (minutes < 5 || minutes > 1440) {
+            server.send(400, "text/plain", "Invalid WiFi interval");
+            return;
+        }
+        next.wifiInterval = minutes;
+        updated = true;
+    }
+    
+    if (server.hasArg("hopperCapacity")) {
+        long grams = atol(server.arg("hopperCapacity"));
+        if (grams < 0 || grams > 100000) {
+            server.send(400, "text/plain", "Invalid hopper capacity");
+            return;
+        }
+        next.hopperCapacity = grams;
+        updated = true;
+    }
+    
     if (server.hasArg("adults")) {
-        adultChickens = server.arg("adults").toInt();
-        preferences.putInt("adults", adultChickens);
+        long adults = atol(server.arg("adults"));
+        if (adults < 0 || adults > 100) {
+            server.send(400, "text/plain", "Invalid number of chickens");
+            return;
+        }
+        next.adults = adults;
         updated = true;
     }
     
     if (server.hasArg("feedAmount")) {
-        feedAmountPerChicken = server.arg("feedAmount").toInt();
-        preferences.putInt("feedAmount", feedAmountPerChicken);
+        long grams = atol(server.arg("feedAmount"));
+        if (grams < 0 || grams > 500) {
+            server.send(400, "text/plain", "Invalid feed amount");
+            return;
+        }
+        next.feedAmount = grams;
         updated = true;
     }
     
     if (server.hasArg("feedFrequency")) {
-        feedFrequency = server.arg("feedFrequency").toInt();
-        preferences.putInt("feedFreq", feedFrequency);
+        long feedings = atol(server.arg("feedFrequency"));
+        if (feedings < 1 || feedings > MAX_FEEDINGS_PER_DAY) {
+            server.send(400, "text/plain", "Invalid feeding frequency");
+            return;
+        }
+        next.feedFrequency = feedings;
         updated = true;
     }
     
     if (server.hasArg("sunriseOffset")) {
-        sunriseOffset = server.arg("sunriseOffset").toInt();
-        preferences.putInt("sunriseOff", sunriseOffset);
+        long hours = atol(server.arg("sunriseOffset"));
+        if (hours < 0 || hours > 12) {
+            server.send(400, "text/plain", "Invalid sunrise offset");
+            return;
+        }
+        next.sunriseOffset = hours;
         updated = true;
     }
     
     if (server.hasArg("sunsetOffset")) {
-        sunsetOffset = server.arg("sunsetOffset").toInt();
-        preferences.putInt("sunsetOff", sunsetOffset);
+        long hours = atol(server.arg("sunsetOffset"));
+        if (hours < 0 || hours > 12) {
+            server.send(400, "text/plain", "Invalid sunset offset");
+            return;
+        }
+        next.sunsetOffset = hours;
         updated = true;
     }
     
-    if (server.hasArg("language")) {
-        language = server.arg("language");
-        preferences.putString("lang", language);
-        updated = true;
+    if (!updated) {
+        server.send(400, "text/plain", "Missing parameters");
+        return;
     }
     
-    if (updated) {
-        server.send(200, "text/plain", "OK");
-    } else {
-        server.send(400, "text/plain", "Missing parameters");
+    if (memcmp(&next, &config, sizeof(Config)) != 0) {
+        if (next.latitude != config.latitude || next.longitude != config.longitude) {
+            scheduler.setLocation(preferences, next.latitude, next.longitude);
+        }
+        config = next;
+        configGeneration++;
+        configStore.requestCommit(); // written from loop(), after this response
+        scheduler.setCatchUp(config.catchUp, config.catchUpWindow);
+        scheduler.configure(config.adults, config.feedAmount, config.feedFrequency, config.sunriseOffset, config.sunsetOffset);
+        power.configure(config.powerMode, config.wifiInterval);
+    }
+    server.send(200, "text/plain", "OK");
+}
+
+void publishTimeSynced() {
+    JsonBuffer<96> json;
+    json.add("source", timeService.sourceName());
+    json.add("errorMs", (int)timeService.getErrorMs());
+    events.publish("time", json.finish());
+}
+
+// The dashboard sends the browser's clock while the feeder has no NTP time
+void handleTime() {
+    if (!server.hasArg("epoch")) {
+        server.send(400, "text/plain", "Missing epoch");
+        return;
     }
+    if (!timeService.setFromBrowser(strtoll(server.arg("epoch"), nullptr, 10))) {
+        server.send(409, "text/plain", "Clock already synced");
+        return;
+    }
+    configGeneration++;
+    scheduler.checkNow();
+    publishTimeSynced();
+    server.send(200, "text/plain", "OK");
+}
+
+// Hands the connection to the event stream; the web server sends nothing
+void handleEvents() {
+    if (events.full()) {
+        server.send(503, "text/plain", "Too many event subscribers");
+        return;
+    }
+    events.subscribe(server.takeConnection());
+}
+
+// Restarting from a handler would cut off its own response, so loop()
+// restarts once it had time to go out
+void scheduleRestart() {
+    restartAt = max(millis() + RESTART_DELAY_MS, 1UL);
 }
 
 void handleTimezoneConfig() {
     if (server.hasArg("timezone")) {
-        String timezone = server.arg("timezone");
+        const char* timezone = server.arg("timezone");
+        if (strlen(timezone) >= sizeof(config.timezone)) {
+            server.send(400, "text/plain", "Timezone too long");
+            return;
+        }
         
-        preferences.putString("timezone", timezone);
+        strcpy(config.timezone, timezone);
+        configStore.requestCommit(); // written from loop(), well before the restart
         
         server.send(200, "text/plain", "Timezone settings saved! Restarting...");
         
-        Serial.println("Timezone updated: " + timezone);
+        Serial.printf("Timezone updated: %s\n", config.timezone);
         Serial.println("Restarting in 2 seconds...");
-        
-        delay(2000);
-        ESP.restart();
+        scheduleRestart();
     } else {
         server.send(400, "text/plain", "Missing timezone");
     }
@@ -1150,75 +1407,46 @@ void handleTimezoneConfig() {
 
 void handleWiFiConfig() {
     if (server.hasArg("ssid")) {
-        String ssid = server.arg("ssid");
-        String password = server.arg("password");
+        const char* ssid = server.arg("ssid");
+        const char* password = server.arg("password");
+        if (strlen(ssid) >= sizeof(config.ssid) || strlen(password) >= sizeof(config.password)) {
+            server.send(400, "text/plain", "SSID or password too long");
+            return;
+        }
         
-        preferences.putString("ssid", ssid);
-        preferences.putString("pass", password);
+        // An empty ip goes back to DHCP
+        IPAddress ip, gateway, subnet, dns;
+        const char* address = server.arg("ip");
+        if (*address) {
+            if (!ip.fromString(address) || !gateway.fromString(server.arg("gateway")) ||
+                !subnet.fromString(server.arg("subnet")) ||
+                (*server.arg("dns") && !dns.fromString(server.arg("dns")))) {
+                server.send(400, "text/plain", "Invalid static IP settings");
+                return;
+            }
+        }
+        
+        strcpy(config.ssid, ssid);
+        strcpy(config.password, password);
+        config.staticIp = ip;
+        config.gateway = gateway;
+        config.subnet = subnet;
+        config.dns = dns;
+        configStore.requestCommit(); // written from loop(), well before the restart
         
         server.send(200, "text/plain", "WiFi settings saved! Restarting...");
         
         Serial.println("WiFi settings updated:");
-        Serial.println("SSID: " + ssid);
+        Serial.printf("SSID: %s\n", config.ssid);
         Serial.println("Restarting in 2 seconds...");
-        
-        delay(2000);
-        ESP.restart();
+        scheduleRestart();
     } else {
         server.send(400, "text/plain", "Missing SSID");
     }
 }
 
 void handleOTAUpload() {
-    String html = R"HTML(
-<!DOCTYPE html>
-<html>
-<head>
-    <title>Henny - Firmware Update</title>
-    <meta charset="UTF-8">
-    <meta name="viewport" content="width=device-width, initial-scale=1.0">
-    <script src="https://cdn.tailwindcss.com"></script>
-</head>
-<body class="min-h-screen" style="background: #415554;">
-    <div class="container mx-auto px-4 py-8 max-w-2xl">
-        <div class="bg-gradient-to-br from-emerald-600 to-teal-700 rounded-2xl shadow-xl p-6 mb-6">
-            <h1 class="text-3xl font-bold text-white text-center">Firmware Update</h1>
-            <p class="text-emerald-100 text-center mt-2">Henny Chicken Feeder</p>
-        </div>
-        
-        <div class="bg-white rounded-2xl shadow-xl p-6">
-            <form method="POST" action="/update" enctype="multipart/form-data">
-                <div class="mb-6">
-                    <label class="block text-sm font-medium text-gray-700 mb-2">Firmware-Datei (.bin)</label>
-                    <input type="file" name="update" accept=".bin" required
-                           class="w-full px-4 py-2 border border-gray-300 rounded-lg focus:ring-2 focus:ring-emerald-500 focus:border-transparent">
-                </div>
-                
-                <div class="bg-yellow-50 border border-yellow-200 rounded-lg p-4 mb-6">
-                    <h3 class="text-yellow-800 font-medium mb-2">⚠️ Wichtige Hinweise:</h3>
-                    <ul class="text-yellow-700 text-sm space-y-1">
-                        <li>• Laden Sie nur offizielle .bin Dateien hoch</li>
-                        <li>• Unterbrechen Sie während des Updates nicht die Stromversorgung</li>
-                        <li>• Das Gerät startet nach dem Update automatisch neu</li>
-                        <li>• Der Vorgang dauert etwa 30-60 Sekunden</li>
-                    </ul>
-                </div>
-                
-                <button type="submit" class="w-full bg-emerald-500 hover:bg-emerald-600 text-white font-medium py-3 px-6 rounded-lg transition-colors">
-                    Firmware aktualisieren
-                </button>
-            </form>
-            
-            <div class="mt-6 text-center">
-                <a href="/" class="text-emerald-600 hover:text-emerald-700 font-medium">← Zurück zum Dashboard</a>
-            </div>
-        </div>
-    </div>
-</body>
-</html>
-)HTML";
-    
-    server.send(200, "text/html", html);
+    sendWebAsset(server, UPDATE_PAGES[config.language], "text/html", "no-cache");
 }
 
 void handleOTAUpdate() {
@@ -1235,7 +1463,7 @@ void handleOTAUpdate() {
         }
     } else if (upload.status == UPLOAD_FILE_END) {
         if (Update.end(true)) {
-            Serial.printf("Update Success: %uB\n", upload.totalSize);
+            Serial.printf("Update Success: %uB\n", (unsigned)upload.totalSize);
         } else {
             Update.printError(Serial);
         }
@@ -1243,227 +1471,219 @@ void handleOTAUpdate() {
 }
 
 void handleOTAUpdatePost() {
+    char page[384];
     server.sendHeader("Connection", "close");
     if (Update.hasError()) {
-        server.send(500, "text/html", "<h1>Update Failed!</h1><p>Check serial output for details.</p><a href='/update'>Try Again</a>");
+        snprintf(page, sizeof(page), "<h1>%s</h1><p>%s</p><a href='/update'>%s</a>",
+                 tr(TEXT_UPDATE_FAILED, config.language), tr(TEXT_UPDATE_FAILED_HINT, config.language), tr(TEXT_TRY_AGAIN, config.language));
+        server.send(500, "text/html; charset=utf-8", page);
     } else {
-        server.send(200, "text/html", "<h1>Update Success!</h1><p>Device will restart in 3 seconds...</p><script>setTimeout(() => window.location.href='/', 5000);</script>");
-        delay(3000);
-        ESP.restart();
+        snprintf(page, sizeof(page), "<h1>%s</h1><p>%s</p><script>setTimeout(() => window.location.href='/', 5000);</script>",
+                 tr(TEXT_UPDATE_SUCCESS, config.language), tr(TEXT_UPDATE_RESTARTING, config.language));
+        server.send(200, "text/html; charset=utf-8", page);
+        scheduleRestart();
     }
 }
 
+void handleStylesheet() {
+    // The URL carries the content hash, so browsers never need to ask again
+    sendWebAsset(server, STYLESHEET_ASSET, "text/css", "public, max-age=31536000, immutable");
+}
+
 void handleManifest() {
-    String manifest = R"JSON({
-  "name": "Henny Smart Chicken Feeder",
-  "short_name": "Henny",
-  "description": "Intelligent chicken feeding system with configurable schedules and remote monitoring",
-  "start_url": "/",
-  "display": "standalone",
-  "background_color": "#415554",
-  "theme_color": "#059669",
-  "orientation": "portrait-primary",
-  "scope": "/",
-  "icons": [
-    {
-      "src": "/icon-192.png",
-      "sizes": "192x192",
-      "type": "image/png",
-      "purpose": "maskable any"
-    },
-    {
-      "src": "/icon-512.png", 
-      "sizes": "512x512",
-      "type": "image/png",
-      "purpose": "maskable any"
-    }
-  ],
-  "categories": ["utilities", "productivity"]
-})JSON";
-    
-    server.send(200, "application/manifest+json", manifest);
+    sendWebAsset(server, MANIFEST_ASSET, "application/manifest+json", "no-cache");
 }
 
 void handleServiceWorker() {
-    String sw = R"JS(const CACHE_NAME = 'henny-v1';
-const urlsToCache = [
-  '/',
-  '/manifest.json',
-  '/icon-192.png',
-  '/icon-512.png',
-  'https://cdn.tailwindcss.com',
-  'https://unpkg.com/lucide@latest/dist/umd/lucide.js'
-];
-
-self.addEventListener('install', event => {
-  event.waitUntil(
-    caches.open(CACHE_NAME)
-      .then(cache => {
-        console.log('Opened cache');
-        return cache.addAll(urlsToCache);
-      })
-  );
-});
-
-self.addEventListener('fetch', event => {
-  event.respondWith(
-    caches.match(event.request)
-      .then(response => {
-        return response || fetch(event.request);
-      }
-    )
-  );
-});
-
-self.addEventListener('activate', event => {
-  event.waitUntil(
-    caches.keys().then(cacheNames => {
-      return Promise.all(
-        cacheNames.map(cacheName => {
-          if (cacheName !== CACHE_NAME) {
-            console.log('Deleting old cache:', cacheName);
-            return caches.delete(cacheName);
-          }
-        })
-      );
-    })
-  );
-});)JS";
-    
-    server.send(200, "application/javascript", sw);
+    sendWebAsset(server, SERVICE_WORKER_ASSET, "application/javascript", "no-cache");
+}
+
+void startWiFi() {
+    connection.start();
+    power.wifiStarted();
+}
+
+void stopWiFi() {
+    connection.stop();
+}
+
+// Low-power modes: once nothing is running and nobody is using the web
+// UI, sleep until the next feeding or WiFi window
+void sleepWhenIdle() {
+    if (!power.maySleep() || spreader.isBusy() || Update.isRunning()) return;
+    time_t nextFeeding = scheduler.getNextFeeding();
+    if (nextFeeding == 0) return; // clock not set yet
+    time_t wakeAt = min(nextFeeding, power.getNextWifiWindow());
+    if (wakeAt - time(nullptr) < MIN_SLEEP_S) return;
+    
+    stopWiFi();
+    if (power.getMode() == POWER_DEEP_SLEEP) {
+        gpio_hold_en((gpio_num_t)RELAY_PIN);
+        gpio_deep_sleep_hold_en();
+    }
+    WakeReason reason = power.sleepUntil(wakeAt);
+    
+    scheduler.checkNow();
+    if (reason == WAKE_BUTTON) {
+        spreader.ignoreButtonPress(); // the wake press only brings WiFi up
+    }
+    motor.armButton();
+    if (reason == WAKE_BUTTON || power.wifiWanted()) {
+        startWiFi();
+    }
+}
+
+// ArduinoOTA only polls for an upload, so it gets a task of its own on
+// the network core instead of a turn in every pass of loop()
+void otaTask(void* arg) {
+    for (;;) {
+        otaStats->begin();
+        ArduinoOTA.handle();
+        otaStats->end();
+        delay(OTA_POLL_MS);
+    }
 }
 
 void setup() {
+    // No waiting for USB-CDC: a monitor attached later misses the first
+    // lines, but the feeder is up seconds sooner after every reset
     Serial.begin(115200);
-    delay(2000); // Wait for USB-CDC to be ready
     Serial.println("\nHenny Feeder v2.0 (C++)");
     Serial.println("Serial output working!");
     
-    spreader.begin();
-    
-    pinMode(BUTTON_PIN, INPUT_PULLUP);
+    motor.begin();
     
     preferences.begin("henny", false);
-    adultChickens = preferences.getInt("adults", 6);
-    feedAmountPerChicken = preferences.getInt("feedAmount", 120);
-    feedFrequency = preferences.getInt("feedFreq", 3);
-    sunriseOffset = preferences.getInt("sunriseOff", 2);
-    sunsetOffset = preferences.getInt("sunsetOff", 2);
-    language = preferences.getString("lang", "de");
-    spreader.setCalibration(preferences.getFloat("cal", 50.0));
-    
-    // Set hostname before WiFi connection
-    WiFi.setHostname("henny");
-    WiFi.begin(preferences.getString("ssid", "").c_str(), 
-               preferences.getString("pass", "").c_str());
-    
-    Serial.print("Connecting to WiFi");
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
+    configStore.load(preferences, config);
+    setenv("TZ", config.timezone, 1);
+    tzset();
+    timeService.begin(preferences, timeState);
+    connection.begin(preferences, config);
+    spreader.loadCalibration();
+    scheduler.begin(preferences, feedingCursor);
+    scheduler.setCatchUp(config.catchUp, config.catchUpWindow);
+    scheduler.setLocation(preferences, config.latitude, config.longitude);
+    scheduler.configure(config.adults, config.feedAmount, config.feedFrequency, config.sunriseOffset, config.sunsetOffset);
+    history.begin();
+    consumption.load(preferences);
+    spreader.recoverJournal();
+    
+    power.begin(powerState, BUTTON_PIN);
+    power.configure(config.powerMode, config.wifiInterval);
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+        motor.ignorePress(); // the wake press only brings WiFi up
     }
     
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("\nConnected!");
-        Serial.print("IP: ");
-        Serial.println(WiFi.localIP());
-        
-        // Set up mDNS hostname
-        if (MDNS.begin("henny")) {
-            Serial.println("mDNS responder started");
-            Serial.println("You can now access the device at: http://henny.local");
-            
-            // Add service to mDNS-SD
-            MDNS.addService("http", "tcp", 80);
-            MDNS.addServiceTxt("http", "tcp", "model", "Henny Smart Chicken Feeder");
-            MDNS.addServiceTxt("http", "tcp", "version", "v2.0");
-        } else {
-            Serial.println("Error setting up mDNS responder!");
-        }
+    if (power.wifiWanted()) {
+        startWiFi();
     } else {
-        Serial.println("\nFailed to connect. Starting AP mode...");
-        WiFi.softAP("Henny-Setup", "hennyfeeder");
-        WiFi.softAPsetHostname("henny");
-        Serial.print("AP IP: ");
-        Serial.println(WiFi.softAPIP());
-        
-        // Set up mDNS in AP mode too
-        if (MDNS.begin("henny")) {
-            Serial.println("mDNS responder started in AP mode");
-            Serial.println("You can access the device at: http://henny.local");
-            MDNS.addService("http", "tcp", 80);
-        }
+        Serial.println("WiFi stays off until the next window");
     }
     
+    // configTime() resets TZ, so set it again
     configTime(0, 0, "pool.ntp.org");
-    String savedTimezone = preferences.getString("timezone", "CET-1CEST,M3.5.0,M10.5.0/3");
-    setenv("TZ", savedTimezone.c_str(), 1);
+    setenv("TZ", config.timezone, 1);
     tzset();
-    Serial.println("Timezone set to: " + savedTimezone);
+    Serial.printf("Timezone set to: %s\n", config.timezone);
+    
+    if (!statusCache.begin(STATUS_CACHE_SIZE)) {
+        Serial.println("No memory for the status cache, rendering every request");
+    }
+    
+    const char* headerKeys[] = {"If-None-Match"};
+    server.collectHeaders(headerKeys, 1);
     
     server.on("/", handleRoot);
+    server.on("/api/status", HTTP_GET, handleStatus);
+    server.on("/events", HTTP_GET, handleEvents);
     server.on("/feed", handleFeed);
     server.on("/calibrate", handleCalibrate);
     server.on("/test-motor", handleTestMotor);
+    server.on("/stop", handleStop);
+    server.on("/api/job", HTTP_GET, handleJob);
+    server.on("/api/tasks", HTTP_GET, handleTasks);
+    server.on("/metrics", HTTP_GET, handleMetrics);
     server.on("/setcal", handleSetCalibration);
+    server.on("/api/calibration", HTTP_GET, handleCalibrationModel);
+    server.on("/calibration/clear", handleClearCalibration);
+    server.on("/api/history", HTTP_GET, handleHistory, nullptr, HISTORY_TIMEOUT_MS);
+    server.on("/hopper/refill", handleHopperRefill);
     server.on("/config", handleConfig);
+    server.on("/time", HTTP_POST, handleTime);
     server.on("/timezone", HTTP_POST, handleTimezoneConfig);
     server.on("/wifi", HTTP_POST, handleWiFiConfig);
     server.on("/update", HTTP_GET, handleOTAUpload);
-    server.on("/update", HTTP_POST, handleOTAUpdatePost, handleOTAUpdate);
+    server.on("/update", HTTP_POST, handleOTAUpdatePost, handleOTAUpdate, UPDATE_TIMEOUT_MS);
+    server.on(STYLESHEET_PATH, HTTP_GET, handleStylesheet);
     server.on("/manifest.json", handleManifest);
     server.on("/sw.js", handleServiceWorker);
     server.begin();
+    stateLock = xSemaphoreCreateMutex();
+    if (!motor.startTask()) {
+        Serial.println("Motor task not started");
+    }
+    loopStats = taskMonitor.add("loop", xTaskGetCurrentTaskHandle(), xPortGetCoreID());
+    server.startTask(stateLock, HTTP_TASK_CORE, taskMonitor.add("http", nullptr, HTTP_TASK_CORE));
     
     // Setup Arduino OTA
     ArduinoOTA.setHostname("henny-feeder");
     ArduinoOTA.setPassword("hennyfeeder");
     ArduinoOTA.begin();
+    otaStats = taskMonitor.add("ota", nullptr, OTA_TASK_CORE);
+    xTaskCreatePinnedToCore(otaTask, "ota", OTA_TASK_STACK, nullptr, OTA_TASK_PRIORITY, &otaStats->handle, OTA_TASK_CORE);
     Serial.println("OTA Ready");
     
     Serial.println("Web server started");
 }
 
-void handleButton() {
-    bool currentState = digitalRead(BUTTON_PIN);
+// Replaces the SNTP client's weak default, so each reply goes through the
+// time service instead of straight to settimeofday()
+extern "C" void sntp_sync_time(struct timeval* tv) {
+    timeService.ntpSynced(*tv);
+    sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+}
+
+void loop() {
+    xSemaphoreTake(stateLock, portMAX_DELAY);
+    loopStats->begin();
+    uint32_t passStarted = ESP.getCycleCount();
+    spreader.handleMotorEvents();
+    uint32_t phaseStarted = loopPhases[PHASE_MOTOR_EVENTS].recordSince(passStarted);
+    connection.update();
+    phaseStarted = loopPhases[PHASE_CONNECTION].recordSince(phaseStarted);
+    configStore.commitPending(preferences, config);
+    phaseStarted = loopPhases[PHASE_CONFIG_COMMIT].recordSince(phaseStarted);
+    if (timeService.update()) {
+        configGeneration++;
+        scheduler.checkNow();
+        publishTimeSynced();
+    }
+    phaseStarted = loopPhases[PHASE_TIME].recordSince(phaseStarted);
+    events.update();
     
-    if (currentState == LOW && lastButtonState == HIGH) {
-        buttonPressStart = millis();
-        buttonPressed = true;
+    // Anything /api/status shows changed, e.g. a setting
+    static uint32_t publishedGeneration = 0;
+    if (configGeneration != publishedGeneration) {
+        publishedGeneration = configGeneration;
+        JsonBuffer<48> json;
+        json.add("generation", (unsigned long)configGeneration);
+        events.publish("status", json.finish());
     }
+    phaseStarted = loopPhases[PHASE_EVENTS].recordSince(phaseStarted);
     
-    if (currentState == HIGH && lastButtonState == LOW && buttonPressed) {
-        unsigned long pressDuration = millis() - buttonPressStart;
-        
-        if (pressDuration > BUTTON_LONG_PRESS_MS) {
-            spreader.calibrationRun();
-        } else {
-            spreader.spreadFeed(25.0);
-        }
-        
-        buttonPressed = false;
+    float feedAmount;
+    if (scheduler.poll(feedAmount)) {
+        spreader.spreadFeed(feedAmount, HISTORY_SCHEDULE, scheduler.getDeliveredSlot());
     }
+    loopPhases[PHASE_SCHEDULER].recordSince(phaseStarted);
     
-    lastButtonState = currentState;
-}
-
-void loop() {
-    spreader.update();
-    handleButton();
-    server.handleClient();
-    ArduinoOTA.handle();
-    
-    static unsigned long lastCheck = 0;
-    if (millis() - lastCheck > 30000) {
-        lastCheck = millis();
-        
-        float feedAmount;
-        if (scheduler.shouldFeedNow(feedAmount, adultChickens, feedAmountPerChicken, feedFrequency, sunriseOffset, sunsetOffset)) {
-            spreader.spreadFeed(feedAmount);
-        }
+    if (restartAt != 0 && (long)(millis() - restartAt) >= 0) {
+        ESP.restart();
     }
+    loopPasses.recordSince(passStarted);
+    loopStats->end();
     
+    sleepWhenIdle();
+    xSemaphoreGive(stateLock);
     delay(10);
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+#define LATENCY_BUCKETS 12
+
+// Upper bounds of the histogram buckets, 50 us to 250 ms; slower samples
+// only count towards +Inf
+static const uint32_t LATENCY_BOUNDS_US[LATENCY_BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+
+// Durations from the CPU's cycle counter, which costs a register read.
+// It wraps after 2^32 cycles, 17 s at 240 MHz, so only time shorter
+// spans with it, and only within one task: each core has its own.
+inline uint32_t cyclesToUs(uint32_t cycles) {
+    return cycles / ESP.getCpuFreqMHz();
+}
+
+// Fixed-bucket latency histogram with the longest sample seen. Written by
+// one task only; a reader on the other core may see one sample half
+// recorded.
+struct LatencyHistogram {
+    uint32_t buckets[LATENCY_BUCKETS + 1] = {}; // the last one is +Inf
+    uint32_t count = 0;
+    uint64_t sumUs = 0;
+    uint32_t maxUs = 0;
+
+    void record(uint32_t us) {
+        uint8_t bucket = 0;
+        while (bucket < LATENCY_BUCKETS && us > LATENCY_BOUNDS_US[bucket]) bucket++;
+        buckets[bucket]++;
+        count++;
+        sumUs += us;
+        maxUs = max(maxUs, us);
+    }
+
+    // Records the time since startedCycles and returns the cycle count
+    // now, to start the next span from
+    uint32_t recordSince(uint32_t startedCycles) {
+        uint32_t now = ESP.getCycleCount();
+        record(cyclesToUs(now - startedCycles));
+        return now;
+    }
+};
+
+// Prometheus text exposition format, written a piece at a time into the
+// buffer of a streamed response. Each family(), gauge(), histogram() and
+// skip() call is one item. An item that does not fit waits for the next
+// piece, and the items earlier pieces hold are skipped, so every piece has
+// to make the same calls in the same order. Durations are exported in
+// seconds, as Prometheus expects.
+class MetricsWriter {
+private:
+    char* buffer;
+    size_t size;
+    size_t used = 0;
+    size_t itemStart = 0;
+    uint32_t sent;      // items in earlier pieces
+    uint32_t item = 0;
+    bool full = false;
+    bool overflow = false;
+
+    // False if the item is in an earlier piece or waits for a later one
+    bool beginItem() {
+        if (full) return false;
+        if (item < sent) {
+            item++;
+            return false;
+        }
+        itemStart = used;
+        overflow = false;
+        return true;
+    }
+
+    void endItem() {
+        if (overflow) {
+            used = itemStart;
+            if (itemStart > 0) {
+                full = true;
+                return;
+            }
+            // Would not fit even an empty piece, so it never will
+            Serial.printf("Metrics item %lu exceeds %u bytes, dropped\n", (unsigned long)item, (unsigned)size);
+        }
+        item++;
+    }
+
+    void appendf(const char* format, ...) {
+        if (overflow) return;
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer + used, size - used, format, args);
+        va_end(args);
+        if (length < 0 || (size_t)length >= size - used) overflow = true;
+        else used += length;
+    }
+
+    // name and suffix with the label and the bucket bound in extra, if any
+    void series(const char* name, const char* suffix, const char* label, const char* value, const char* extra) {
+        if (label) appendf("%s%s{%s=\"%s\"%s} ", name, suffix, label, value, extra);
+        else if (*extra) appendf("%s%s{%s} ", name, suffix, extra + 1);
+        else appendf("%s%s ", name, suffix);
+    }
+
+public:
+    // itemsSent is items() of the piece before, 0 for the first
+    MetricsWriter(char* piece, size_t pieceSize, uint32_t itemsSent)
+        : buffer(piece), size(pieceSize), sent(itemsSent) {}
+
+    // Starts a metric family; type is "gauge", "counter" or "histogram"
+    void family(const char* name, const char* type, const char* help) {
+        if (!beginItem()) return;
+        appendf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+        endItem();
+    }
+
+    // label may be null for a series without labels
+    void gauge(const char* name, float value, const char* label = nullptr, const char* labelValue = nullptr) {
+        if (!beginItem()) return;
+        series(name, "", label, labelValue, "");
+        appendf("%.6g\n", value);
+        endItem();
+    }
+
+    void gauge(const char* name, unsigned long value, const char* label = nullptr, const char* labelValue = nullptr) {
+        if (!beginItem()) return;
+        series(name, "", label, labelValue, "");
+        appendf("%lu\n", value);
+        endItem();
+    }
+
+    void histogram(const char* name, const LatencyHistogram& histogram,
+                   const char* label = nullptr, const char* labelValue = nullptr) {
+        if (!beginItem()) return;
+        char le[24];
+        uint32_t cumulative = 0;
+        for (uint8_t i = 0; i <= LATENCY_BUCKETS; i++) {
+            cumulative += histogram.buckets[i];
+            if (i < LATENCY_BUCKETS) snprintf(le, sizeof(le), ",le=\"%g\"", LATENCY_BOUNDS_US[i] / 1e6);
+            else strcpy(le, ",le=\"+Inf\"");
+            series(name, "_bucket", label, labelValue, le);
+            appendf("%lu\n", (unsigned long)cumulative);
+        }
+        series(name, "_sum", label, labelValue, "");
+        appendf("%.6f\n", histogram.sumUs / 1e6);
+        series(name, "_count", label, labelValue, "");
+        appendf("%lu\n", (unsigned long)histogram.count);
+        endItem();
+    }
+
+    // Stands in for an item left out this time, e.g. a series with no
+    // samples yet, so that the items after it keep their place
+    void skip(uint8_t items = 1) {
+        for (; items > 0; items--) {
+            if (beginItem()) item++;
+        }
+    }
+
+    uint32_t items() const { return item; }
+    size_t length() const { return used; }
+};
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+#include <sys/time.h>
+
+#define MIN_SLEEP_S 30
+#define DEFAULT_WIFI_INTERVAL_MIN 60
+#define WIFI_WINDOW_MS 180000UL
+
+enum PowerMode : uint8_t {
+    POWER_ALWAYS_ON,
+    POWER_LIGHT_SLEEP,
+    POWER_DEEP_SLEEP
+};
+
+enum WakeReason : uint8_t {
+    WAKE_TIMER,
+    WAKE_BUTTON
+};
+
+// Survives deep sleep in RTC memory; zeroed on power-up
+struct PowerState {
+    uint64_t awakeUs;
+    uint64_t asleepUs;
+    int64_t deepSleepStartUs; // wall clock, 0 unless a deep sleep is in progress
+    time_t nextWifiWindow;
+};
+
+// Optional low-power operation: between feedings the device sleeps with an
+// RTC timer wake (and a wake on the button), and WiFi only comes up for a
+// short window every wifiIntervalMin minutes or after a button press.
+class PowerManager {
+private:
+    PowerMode mode = POWER_ALWAYS_ON;
+    uint32_t wifiIntervalMin = DEFAULT_WIFI_INTERVAL_MIN;
+    int buttonPin = -1;
+    PowerState* state = nullptr;
+
+    int64_t awakeSinceUs = 0;
+    unsigned long awakeUntil = 0; // millis() before which the device stays up
+
+    static int64_t wallClockUs() {
+        struct timeval now;
+        gettimeofday(&now, nullptr);
+        return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+    }
+
+public:
+    // rtcState lives in RTC memory so the duty cycle and WiFi cadence
+    // carry across deep sleeps
+    void begin(PowerState& rtcState, int wakePin) {
+        state = &rtcState;
+        buttonPin = wakePin;
+        awakeSinceUs = esp_timer_get_time();
+
+        esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+        if (state->deepSleepStartUs != 0 &&
+            (cause == ESP_SLEEP_WAKEUP_TIMER || cause == ESP_SLEEP_WAKEUP_EXT0)) {
+            state->asleepUs += wallClockUs() - state->deepSleepStartUs;
+        }
+        state->deepSleepStartUs = 0;
+    }
+
+    void configure(PowerMode newMode, uint32_t intervalMin) {
+        mode = newMode;
+        wifiIntervalMin = max(intervalMin, (uint32_t)1);
+        time_t latest = time(nullptr) + wifiIntervalMin * 60;
+        if (state->nextWifiWindow > latest) state->nextWifiWindow = latest;
+    }
+
+    // True when this boot should bring WiFi up: always-on, first power-up,
+    // a button wake, or a WiFi window falling due
+    bool wifiWanted() {
+        if (mode == POWER_ALWAYS_ON) return true;
+        esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+        if (cause != ESP_SLEEP_WAKEUP_TIMER) return true;
+        return time(nullptr) >= state->nextWifiWindow;
+    }
+
+    // Marks the start of a WiFi window: stay up for a while, then not
+    // again until the next interval
+    void wifiStarted() {
+        keepAwake(WIFI_WINDOW_MS);
+        state->nextWifiWindow = time(nullptr) + wifiIntervalMin * 60;
+    }
+
+    // Postpones sleep, e.g. while someone is using the web UI
+    void keepAwake(unsigned long ms) {
+        if (mode == POWER_ALWAYS_ON) return;
+        unsigned long until = millis() + ms;
+        if ((long)(until - awakeUntil) > 0) awakeUntil = until;
+    }
+
+    PowerMode getMode() { return mode; }
+    uint32_t getWifiInterval() { return wifiIntervalMin; }
+    time_t getNextWifiWindow() { return state->nextWifiWindow; }
+
+    bool maySleep() {
+        return mode != POWER_ALWAYS_ON && (long)(millis() - awakeUntil) >= 0;
+    }
+
+    // Sleeps until wakeAt or a button press. Light sleep returns the
+    // reason; deep sleep restarts through setup() instead of returning.
+    // Returns WAKE_TIMER straight away if the time left is too short.
+    WakeReason sleepUntil(time_t wakeAt) {
+        time_t now = time(nullptr);
+        if (wakeAt - now < MIN_SLEEP_S) return WAKE_TIMER;
+
+        uint64_t sleepUs = (uint64_t)(wakeAt - now) * 1000000;
+        state->awakeUs += esp_timer_get_time() - awakeSinceUs;
+        Serial.printf("Sleeping %lds (%s)\n", (long)(wakeAt - now), mode == POWER_DEEP_SLEEP ? "deep" : "light");
+        Serial.flush();
+
+        esp_sleep_enable_timer_wakeup(sleepUs);
+        if (mode == POWER_DEEP_SLEEP) {
+            esp_sleep_enable_ext0_wakeup((gpio_num_t)buttonPin, 0);
+            state->deepSleepStartUs = wallClockUs();
+            esp_deep_sleep_start();
+        }
+
+        gpio_wakeup_enable((gpio_num_t)buttonPin, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+        int64_t sleepStart = esp_timer_get_time();
+        esp_light_sleep_start();
+        awakeSinceUs = esp_timer_get_time();
+        state->asleepUs += awakeSinceUs - sleepStart;
+        gpio_wakeup_disable((gpio_num_t)buttonPin);
+
+        return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO ? WAKE_BUTTON : WAKE_TIMER;
+    }
+
+    uint64_t getAwakeUs() {
+        return state->awakeUs + (esp_timer_get_time() - awakeSinceUs);
+    }
+
+    uint64_t getAsleepUs() {
+        return state->asleepUs;
+    }
+
+    // Fraction of time spent awake since power-up
+    float getDutyCycle() {
+        uint64_t awake = getAwakeUs();
+        uint64_t total = awake + state->asleepUs;
+        return total ? (float)awake / total : 1.0;
+    }
+};
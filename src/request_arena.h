@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define ARENA_ALIGN 4
+
+// Bump allocator for what one request needs until its response is out:
+// allocate() only moves a pointer and reset() gives everything back at
+// once, so request after request leaves no holes in the heap. The block
+// is taken once, preferably from PSRAM, and kept for good.
+class RequestArena {
+private:
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    size_t last = 0;      // offset of the latest allocation, for extend()
+    size_t peak = 0;
+
+public:
+    bool begin(size_t size) {
+#ifdef BOARD_HAS_PSRAM
+        if (psramFound()) data = (char*)ps_malloc(size);
+#endif
+        if (!data) data = (char*)malloc(size);
+        capacity = data ? size : 0;
+        return data != nullptr;
+    }
+
+    // Null once the arena is full; the caller falls back to the heap
+    void* allocate(size_t size) {
+        size_t start = (used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (!data || start + size > capacity) return nullptr;
+        last = start;
+        used = start + size;
+        peak = max(peak, used);
+        return data + start;
+    }
+
+    // Grows the latest allocation in place to size bytes, if there is room
+    bool extend(const void* block, size_t size) {
+        if (!data || block != data + last || last + size > capacity) return false;
+        used = max(used, last + size);
+        peak = max(peak, used);
+        return true;
+    }
+
+    void reset() {
+        used = 0;
+        last = 0;
+    }
+
+    bool owns(const void* block) const {
+        return data && block >= data && block < data + capacity;
+    }
+
+    size_t size() const { return capacity; }
+    size_t highWater() const { return peak; }
+};
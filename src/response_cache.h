@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Keeps the last rendered body of a dynamic response, preferably in PSRAM.
+// The caller names what the body depends on (config generation, clock
+// minute, a state flag); that key doubles as the ETag, so an unchanged
+// response is neither re-rendered nor, for revalidating clients, re-sent.
+class ResponseCache {
+private:
+    char* data = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    uint32_t bootId = 0;
+    char etag[40] = "";
+
+public:
+    bool begin(size_t size) {
+#ifdef BOARD_HAS_PSRAM
+        if (psramFound()) data = (char*)ps_malloc(size);
+#endif
+        if (!data) data = (char*)malloc(size);
+        capacity = data ? size : 0;
+        // Counters restart at boot, so keep tags from one boot (or build)
+        // from matching those of another
+        bootId = esp_random();
+        return data != nullptr;
+    }
+
+    void makeETag(char* buffer, size_t size, uint32_t generation, uint32_t minute, uint8_t state) {
+        snprintf(buffer, size, "\"%08lx-%lx-%lx-%x\"",
+                 (unsigned long)bootId, (unsigned long)generation, (unsigned long)minute, state);
+    }
+
+    bool holds(const char* tag) const {
+        return used > 0 && strcmp(etag, tag) == 0;
+    }
+
+    void store(const char* tag, const char* body, size_t length) {
+        if (length > capacity || strlen(tag) >= sizeof(etag)) {
+            used = 0;
+            return;
+        }
+        memcpy(data, body, length);
+        used = length;
+        strcpy(etag, tag);
+    }
+
+    const char* body() const { return data; }
+    size_t length() const { return used; }
+};
@@ -0,0 +1,374 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <time.h>
+
+#include "solar.h"
+
+#define MAX_FEEDINGS_PER_DAY 8
+#define CLOCK_CHECK_INTERVAL_MS 60000
+#define CLOCK_JUMP_TOLERANCE_S 5
+#define MIN_VALID_EPOCH 1700000000 // clock counts as set once it is past 2023
+#define MIN_FEEDING_WINDOW_S 3600
+#define FEEDING_GRACE_S 300 // a slot this late still counts as on time
+#define MAX_CATCHUP_S 86400
+#define DEFAULT_CATCHUP_WINDOW_MIN 120
+#define FEEDING_CURSOR_MAGIC 0x46454544
+
+// What to do with feedings that fell due while the device was off or
+// asleep for longer than FEEDING_GRACE_S
+enum CatchUpPolicy : uint8_t {
+    CATCHUP_SKIP,   // drop them
+    CATCHUP_LATEST, // deliver the most recent one within the window
+    CATCHUP_ALL     // deliver every one within the window as a single dose
+};
+
+// Everything up to lastHandled has been delivered or skipped. Kept in RTC
+// memory, which survives resets, OTA restarts and deep sleep; NVS holds a
+// copy for after a power loss.
+struct FeedingCursor {
+    uint32_t magic;
+    uint32_t lastHandled;
+    uint32_t check;
+};
+
+// One day's feedings, as absolute times
+struct DayPlan {
+    time_t sunrise;
+    time_t sunset;
+    int count;
+    time_t feedings[MAX_FEEDINGS_PER_DAY];
+    float perFeeding; // grams
+};
+
+// Works out the absolute time of the next feeding once and arms a one-shot
+// timer for it, instead of rebuilding the day's schedule on every poll.
+// The schedule is recomputed only when the settings change, a feeding has
+// fired, or the clock jumps (NTP sync, DST edits). Slots are settled
+// against a persisted cursor, so a reboot neither repeats nor silently
+// loses a feeding.
+class Scheduler {
+private:
+    int adultChickens = 0;
+    int gramsPerChicken = 0;
+    int frequency = 1;
+    int sunriseOffset = 0;
+    int sunsetOffset = 0;
+    SolarTable solar;
+    CatchUpPolicy catchUp = CATCHUP_LATEST;
+    uint32_t catchUpWindowS = DEFAULT_CATCHUP_WINDOW_MIN * 60;
+    bool configured = false;
+
+    Preferences* store = nullptr;
+    FeedingCursor* cursor = nullptr;
+    time_t lastHandled = 0;
+    uint8_t deliveredSlot = 0; // index in its day of the last slot poll() delivered
+
+    esp_timer_handle_t eventTimer = nullptr;
+    volatile bool eventDue = false;
+    bool dirty = true;
+    time_t nextEvent = 0;
+    float nextAmount = 0;
+
+    unsigned long lastClockCheck = 0;
+    time_t lastClockEpoch = 0;
+    unsigned long lastClockMillis = 0;
+
+    // month is 1-12, or 0 when unknown
+    static float dailyFeedAmount(int adults, int grams, int month) {
+        float total = adults * grams;
+
+        if (month == 12 || month <= 2) total *= 1.15;
+        else if (month >= 3 && month <= 5) total *= 1.05;
+        else if (month >= 6 && month <= 8) total *= 0.95;
+
+        return total;
+    }
+
+    // Epoch of 00:00 UTC on a calendar date (days-from-civil algorithm)
+    static time_t utcMidnight(int year, int month, int day) {
+        year -= month <= 2;
+        int era = (year >= 0 ? year : year - 399) / 400;
+        int yearOfEra = year - era * 400;
+        int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return (time_t)(era * 146097 + dayOfEra - 719468) * 86400;
+    }
+
+    // Feeding times between sunrise+offset and sunset-offset on the local
+    // calendar date `date`
+    void planDay(const struct tm& date, DayPlan& plan) {
+        time_t midnight = utcMidnight(date.tm_year + 1900, date.tm_mon + 1, date.tm_mday);
+        const SolarDay& sun = solar.day(date.tm_yday);
+        plan.sunrise = midnight + sun.sunrise * 60;
+        plan.sunset = midnight + sun.sunset * 60;
+        plan.count = constrain(frequency, 1, MAX_FEEDINGS_PER_DAY);
+        plan.perFeeding = dailyFeedAmount(adultChickens, gramsPerChicken, date.tm_mon + 1) / plan.count;
+
+        time_t start = plan.sunrise + sunriseOffset * 3600;
+        time_t end = plan.sunset - sunsetOffset * 3600;
+
+        // Ensure we have at least 1 hour window, even in polar winter
+        if (end - start < MIN_FEEDING_WINDOW_S) {
+            start = plan.sunrise + 3600;
+            end = plan.sunset - 3600;
+        }
+        if (end - start < MIN_FEEDING_WINDOW_S) {
+            time_t noon = (plan.sunrise + plan.sunset) / 2;
+            start = noon - 2 * 3600;
+            end = noon + 2 * 3600;
+        }
+
+        for (int i = 0; i < plan.count; i++) {
+            time_t slot = plan.count == 1 ? (start + end) / 2 : start + (end - start) * i / (plan.count - 1);
+            plan.feedings[i] = slot - slot % 60; // on the minute
+        }
+    }
+
+    // Plan for the local date `dayOffset` days after the one holding `t`
+    void planDate(time_t t, int dayOffset, DayPlan& plan) {
+        struct tm date;
+        localtime_r(&t, &date);
+        date.tm_mday += dayOffset;
+        date.tm_hour = 12;
+        date.tm_min = 0;
+        date.tm_sec = 0;
+        date.tm_isdst = -1;
+        mktime(&date); // normalizes the date and fills tm_yday
+        planDay(date, plan);
+    }
+
+    void markHandled(time_t until) {
+        lastHandled = until;
+        cursor->magic = FEEDING_CURSOR_MAGIC;
+        cursor->lastHandled = (uint32_t)until;
+        cursor->check = FEEDING_CURSOR_MAGIC ^ cursor->lastHandled;
+        store->putUInt("fedUntil", (uint32_t)until);
+    }
+
+    static void logSlot(time_t slot, float grams, const char* decision, long lateS) {
+        struct tm local;
+        localtime_r(&slot, &local);
+        Serial.printf("Feeding %02d:%02d (%.1fg): %s, %ld min late\n",
+                      local.tm_hour, local.tm_min, grams, decision, lateS / 60);
+    }
+
+    // Delivers or skips every slot in (lastHandled, now] by the catch-up
+    // rule, logging each decision, and moves the cursor to now before
+    // anything is dispensed. Returns the grams to dispense.
+    float settle(time_t now) {
+        if (lastHandled == 0 || lastHandled > now + MAX_CATCHUP_S) {
+            Serial.println("No usable feeding history, counting from now");
+            markHandled(now);
+            return 0;
+        }
+
+        time_t start = max(lastHandled, now - (time_t)MAX_CATCHUP_S);
+        if (start > lastHandled) {
+            Serial.printf("Feedings more than %d h ago skipped\n", MAX_CATCHUP_S / 3600);
+        }
+
+        float grams = 0;
+        bool settled = false;
+        time_t pending = 0;
+        float pendingGrams = 0;
+        for (int dayOffset = 0; dayOffset <= 2; dayOffset++) {
+            DayPlan plan;
+            planDate(start, dayOffset, plan);
+            for (int i = 0; i < plan.count; i++) {
+                time_t slot = plan.feedings[i];
+                if (slot <= start || slot > now) continue;
+                settled = true;
+
+                long late = now - slot;
+                if (late > FEEDING_GRACE_S && catchUp == CATCHUP_SKIP) {
+                    logSlot(slot, plan.perFeeding, "skipped by catch-up rule", late);
+                } else if (late > FEEDING_GRACE_S && late > (long)catchUpWindowS) {
+                    logSlot(slot, plan.perFeeding, "skipped, past catch-up window", late);
+                } else if (catchUp == CATCHUP_ALL) {
+                    logSlot(slot, plan.perFeeding, "delivered", late);
+                    grams += plan.perFeeding;
+                    deliveredSlot = i;
+                } else {
+                    if (pending != 0) logSlot(pending, pendingGrams, "skipped, a later one is due", now - pending);
+                    pending = slot;
+                    pendingGrams = plan.perFeeding;
+                    deliveredSlot = i;
+                }
+            }
+        }
+        if (pending != 0) {
+            logSlot(pending, pendingGrams, "delivered", now - pending);
+            grams += pendingGrams;
+        }
+
+        if (settled || start > lastHandled) markHandled(now);
+        return grams;
+    }
+
+    // Finds the first feeding strictly after `after`, today or tomorrow
+    void recompute(time_t after) {
+        after = max(after, lastHandled); // after the clock went back
+        nextEvent = 0;
+        for (int dayOffset = 0; dayOffset <= 1 && nextEvent == 0; dayOffset++) {
+            DayPlan plan;
+            planDate(after, dayOffset, plan);
+            for (int i = 0; i < plan.count; i++) {
+                if (plan.feedings[i] > after) {
+                    nextEvent = plan.feedings[i];
+                    nextAmount = plan.perFeeding;
+                    break;
+                }
+            }
+        }
+        dirty = false;
+        arm(time(nullptr));
+        if (nextEvent == 0) return;
+
+        struct tm next;
+        localtime_r(&nextEvent, &next);
+        Serial.printf("Next feeding %02d:%02d, %.1fg\n", next.tm_hour, next.tm_min, nextAmount);
+    }
+
+    void arm(time_t now) {
+        esp_timer_stop(eventTimer);
+        eventDue = false;
+        if (nextEvent > now) {
+            esp_timer_start_once(eventTimer, (uint64_t)(nextEvent - now) * 1000000);
+        } else {
+            eventDue = true;
+        }
+    }
+
+    static void onEventTimer(void* arg) {
+        ((Scheduler*)arg)->eventDue = true;
+    }
+
+    // True if wall time moved differently from millis() since the last check
+    bool clockJumped(time_t now) {
+        unsigned long nowMillis = millis();
+        time_t expected = lastClockEpoch + (time_t)((nowMillis - lastClockMillis) / 1000);
+        bool jumped = lastClockEpoch == 0 || llabs((long long)(now - expected)) > CLOCK_JUMP_TOLERANCE_S;
+        lastClockEpoch = now;
+        lastClockMillis = nowMillis;
+        return jumped;
+    }
+
+public:
+    ~Scheduler() {
+        if (eventTimer) {
+            esp_timer_stop(eventTimer);
+            esp_timer_delete(eventTimer);
+        }
+    }
+
+    // rtcCursor must live in RTC_NOINIT memory; preferences must stay open
+    void begin(Preferences& preferences, FeedingCursor& rtcCursor) {
+        store = &preferences;
+        cursor = &rtcCursor;
+        if (cursor->magic == FEEDING_CURSOR_MAGIC && cursor->check == (FEEDING_CURSOR_MAGIC ^ cursor->lastHandled)) {
+            lastHandled = cursor->lastHandled;
+            Serial.printf("Feedings handled up to %lu (RTC)\n", (unsigned long)lastHandled);
+        } else {
+            lastHandled = preferences.getUInt("fedUntil", 0);
+            Serial.printf("Feedings handled up to %lu (NVS)\n", (unsigned long)lastHandled);
+        }
+
+        esp_timer_create_args_t timerArgs = {};
+        timerArgs.callback = onEventTimer;
+        timerArgs.arg = this;
+        timerArgs.dispatch_method = ESP_TIMER_TASK;
+        timerArgs.name = "feeding";
+        esp_timer_create(&timerArgs, &eventTimer);
+    }
+
+    // Loads or computes the sunrise/sunset table for a location
+    void setLocation(Preferences& preferences, float latitude, float longitude) {
+        solar.load(preferences, latitude, longitude);
+        dirty = true;
+    }
+
+    // Makes the next poll() look at the clock, e.g. after a light sleep
+    void checkNow() {
+        lastClockCheck = millis() - CLOCK_CHECK_INTERVAL_MS;
+    }
+
+    // Call whenever one of the feeding settings changes
+    void configure(int adults, int grams, int feedings, int sunriseOff, int sunsetOff) {
+        adultChickens = adults;
+        gramsPerChicken = grams;
+        frequency = feedings;
+        sunriseOffset = sunriseOff;
+        sunsetOffset = sunsetOff;
+        dirty = true;
+
+        // Slots that a settings change moves into the past are not missed
+        // feedings; only the boot-time call may catch up
+        time_t now = time(nullptr);
+        if (configured && now >= MIN_VALID_EPOCH && now > lastHandled) {
+            markHandled(now);
+        }
+        configured = true;
+    }
+
+    void setCatchUp(CatchUpPolicy policy, uint32_t windowMin) {
+        catchUp = policy;
+        catchUpWindowS = min(windowMin * 60, (uint32_t)MAX_CATCHUP_S);
+    }
+
+    // Call from loop(); cheap unless something is due. Returns true with the
+    // amount to dispense when a feeding time has been reached.
+    bool poll(float& feedAmount) {
+        if (!eventDue && !dirty && millis() - lastClockCheck < CLOCK_CHECK_INTERVAL_MS) {
+            return false;
+        }
+        lastClockCheck = millis();
+
+        time_t now = time(nullptr);
+        if (now < MIN_VALID_EPOCH) return false;
+        if (clockJumped(now)) dirty = true;
+        if (!dirty && (nextEvent == 0 || now < nextEvent)) return false;
+
+        feedAmount = settle(now);
+        recompute(now);
+        return feedAmount > 0;
+    }
+
+    // Which of its day's feedings the last dose from poll() was; the latest
+    // one when several were caught up at once
+    uint8_t getDeliveredSlot() const {
+        return deliveredSlot;
+    }
+
+    // Epoch of the next feeding, 0 until the clock is set
+    time_t getNextFeeding() {
+        return dirty ? 0 : nextEvent;
+    }
+
+    float getDailyFeedAmount(int adults, int grams) {
+        int month = 0;
+        struct tm timeinfo;
+        if (getLocalTime(&timeinfo, 0)) {
+            month = timeinfo.tm_mon + 1;
+        }
+
+        return dailyFeedAmount(adults, grams, month);
+    }
+
+    // Today's sunrise, sunset and feedings; false until the clock is set
+    bool planToday(DayPlan& plan) {
+        time_t now = time(nullptr);
+        if (now < MIN_VALID_EPOCH) return false;
+        struct tm date;
+        localtime_r(&now, &date);
+        planDay(date, plan);
+        return true;
+    }
+
+    CatchUpPolicy getCatchUp() const { return catchUp; }
+    uint32_t getCatchUpWindow() const { return catchUpWindowS / 60; }
+    float getLatitude() const { return solar.getLatitude(); }
+    float getLongitude() const { return solar.getLongitude(); }
+};
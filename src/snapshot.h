@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// State one task publishes for others to read, as a sequence lock: the
+// writer makes the sequence odd while it copies a new value in, and a
+// reader retries when the sequence was odd or moved during its copy. The
+// writer never waits for readers, so a busy web server cannot hold up the
+// task publishing. Readers spin while a write is under way, so the writer
+// must outrank every reader on its own core. T must be trivially copyable
+// and small, since readers copy all of it.
+template <typename T>
+class Snapshot {
+private:
+    std::atomic<uint32_t> sequence{0};
+    T value;
+
+public:
+    Snapshot() : value() {}
+
+    // Only ever from the one writing task
+    void publish(const T& next) {
+        uint32_t at = sequence.load(std::memory_order_relaxed);
+        sequence.store(at + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy((void*)&value, &next, sizeof(T));
+        sequence.store(at + 2, std::memory_order_release);
+    }
+
+    T read() const {
+        T copy;
+        for (;;) {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) continue; // being written on the other core
+            memcpy((void*)&copy, (const void*)&value, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) return copy;
+        }
+    }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <math.h>
+
+#define SOLAR_TABLE_DAYS 366
+#define DEFAULT_LATITUDE 50.0
+#define DEFAULT_LONGITUDE 8.5
+
+// Sunrise and sunset in minutes after UTC midnight. May fall outside
+// 0..1439 far from the prime meridian; during polar day or night both
+// collapse to the limits of the hour angle.
+struct SolarDay {
+    int16_t sunrise;
+    int16_t sunset;
+};
+
+// Sunrise/sunset for every day of the year at one location, computed with
+// NOAA's general solar position equations when the location changes and
+// kept in NVS, so a daily lookup is a single array index.
+class SolarTable {
+private:
+    struct Location {
+        float latitude;
+        float longitude;
+    };
+
+    SolarDay days[SOLAR_TABLE_DAYS];
+    Location location = {DEFAULT_LATITUDE, DEFAULT_LONGITUDE};
+
+public:
+    // dayOfYear is 0-based like tm_yday; longitude is positive east
+    static SolarDay compute(int dayOfYear, float latitude, float longitude) {
+        double gamma = 2.0 * M_PI / 365.0 * dayOfYear; // fractional year at noon
+        double eqTime = 229.18 * (0.000075 + 0.001868 * cos(gamma) - 0.032077 * sin(gamma)
+                                  - 0.014615 * cos(2 * gamma) - 0.040849 * sin(2 * gamma));
+        double decl = 0.006918 - 0.399912 * cos(gamma) + 0.070257 * sin(gamma)
+                      - 0.006758 * cos(2 * gamma) + 0.000907 * sin(2 * gamma)
+                      - 0.002697 * cos(3 * gamma) + 0.00148 * sin(3 * gamma);
+
+        // Hour angle at which the sun's upper limb touches the horizon,
+        // including atmospheric refraction (90.833 degrees zenith)
+        double lat = latitude * M_PI / 180.0;
+        double cosHourAngle = cos(90.833 * M_PI / 180.0) / (cos(lat) * cos(decl)) - tan(lat) * tan(decl);
+        double hourAngle = acos(constrain(cosHourAngle, -1.0, 1.0)) * 180.0 / M_PI;
+
+        double noon = 720 - 4 * longitude - eqTime;
+        SolarDay day;
+        day.sunrise = (int16_t)lround(noon - 4 * hourAngle);
+        day.sunset = (int16_t)lround(noon + 4 * hourAngle);
+        return day;
+    }
+
+    // Uses the copy in NVS if it was computed for this location, otherwise
+    // computes the table and stores it
+    void load(Preferences& preferences, float latitude, float longitude) {
+        Location stored;
+        if (preferences.getBytes("solarLoc", &stored, sizeof(stored)) == sizeof(stored) &&
+            stored.latitude == latitude && stored.longitude == longitude &&
+            preferences.getBytes("solarTable", days, sizeof(days)) == sizeof(days)) {
+            location = stored;
+            return;
+        }
+
+        location = {latitude, longitude};
+        for (int i = 0; i < SOLAR_TABLE_DAYS; i++) {
+            days[i] = compute(i, latitude, longitude);
+        }
+        preferences.putBytes("solarTable", days, sizeof(days));
+        preferences.putBytes("solarLoc", &location, sizeof(location));
+        Serial.printf("Solar table computed for %.4f, %.4f\n", latitude, longitude);
+    }
+
+    const SolarDay& day(int dayOfYear) const {
+        return days[constrain(dayOfYear, 0, SOLAR_TABLE_DAYS - 1)];
+    }
+
+    float getLatitude() const { return location.latitude; }
+    float getLongitude() const { return location.longitude; }
+};
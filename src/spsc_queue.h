@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+// Fixed-size ring between exactly one producer task and one consumer task,
+// without locks: each side only writes its own index, and the release
+// store of that index publishes the slot it filled or emptied. Neither
+// side ever waits; push() on a full queue fails. Size must be a power of
+// two.
+template <typename T, uint8_t Size>
+class SpscQueue {
+private:
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "SpscQueue size must be a power of two");
+
+    T items[Size];
+    std::atomic<uint32_t> head{0}; // next to pop, written by the consumer
+    std::atomic<uint32_t> tail{0}; // next to push, written by the producer
+
+public:
+    // Producer side
+    bool push(const T& item) {
+        uint32_t at = tail.load(std::memory_order_relaxed);
+        if (at - head.load(std::memory_order_acquire) == Size) return false;
+        items[at & (Size - 1)] = item;
+        tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item) {
+        uint32_t at = head.load(std::memory_order_relaxed);
+        if (at == tail.load(std::memory_order_acquire)) return false;
+        item = items[at & (Size - 1)];
+        head.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; only a hint while the other side is active
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "json_buffer.h"
+#include "metrics.h"
+
+#define TASK_STATS_MAX 6
+
+// Time a task spends working, as opposed to waiting: each pass of its work
+// is bracketed by begin() and end(). Only the task itself writes; readers
+// on the other core may see a count from mid-update, which skews one
+// sample at most.
+struct TaskStats {
+    const char* name = nullptr;
+    TaskHandle_t handle = nullptr;
+    int8_t core = -1;
+    uint64_t busyUs = 0;
+    uint32_t maxBusyUs = 0; // longest single pass
+    uint32_t passes = 0;
+    int64_t startedUs = 0;
+
+    void begin() {
+        startedUs = esp_timer_get_time();
+    }
+
+    void end() {
+        uint32_t us = esp_timer_get_time() - startedUs;
+        busyUs += us;
+        maxBusyUs = max(maxBusyUs, us);
+        passes++;
+    }
+};
+
+// The firmware's tasks with their stack high-water marks and CPU share:
+// busy time over time since boot, on the core each is pinned to
+class TaskMonitor {
+private:
+    TaskStats tasks[TASK_STATS_MAX];
+    uint8_t count = 0;
+
+public:
+    // handle may be set later, e.g. from the task itself; null if full
+    TaskStats* add(const char* name, TaskHandle_t handle, int8_t core) {
+        if (count == TASK_STATS_MAX) return nullptr;
+        TaskStats& stats = tasks[count++];
+        stats.name = name;
+        stats.handle = handle;
+        stats.core = core;
+        return &stats;
+    }
+
+    // As a "tasks" array of the object being built
+    template <size_t Capacity>
+    void report(JsonBuffer<Capacity>& json) const {
+        float uptimeUs = max((float)esp_timer_get_time(), 1.0f);
+        json.beginArray("tasks");
+        for (uint8_t i = 0; i < count; i++) {
+            const TaskStats& stats = tasks[i];
+            json.beginObject(nullptr);
+            json.add("name", stats.name);
+            json.add("core", (int)stats.core);
+            json.add("stackFree", stats.handle ? (unsigned long)uxTaskGetStackHighWaterMark(stats.handle) : 0UL);
+            json.add("cpu", stats.busyUs * 100.0f / uptimeUs, 2);
+            json.add("maxBusyUs", (unsigned long)stats.maxBusyUs);
+            json.add("passes", (unsigned long)stats.passes);
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    // As Prometheus metric families labelled by task
+    void report(MetricsWriter& metrics) const {
+        metrics.family("henny_task_busy_seconds_total", "counter", "Time each task spent working since boot");
+        for (uint8_t i = 0; i < count; i++) {
+            metrics.gauge("henny_task_busy_seconds_total", tasks[i].busyUs / 1e6f, "task", tasks[i].name);
+        }
+        metrics.family("henny_task_max_busy_seconds", "gauge", "Longest single pass of each task");
+        for (uint8_t i = 0; i < count; i++) {
+            metrics.gauge("henny_task_max_busy_seconds", tasks[i].maxBusyUs / 1e6f, "task", tasks[i].name);
+        }
+        metrics.family("henny_task_stack_free_bytes", "gauge", "Stack each task has never used");
+        for (uint8_t i = 0; i < count; i++) {
+            unsigned long free = tasks[i].handle ? uxTaskGetStackHighWaterMark(tasks[i].handle) : 0;
+            metrics.gauge("henny_task_stack_free_bytes", free, "task", tasks[i].name);
+        }
+    }
+};
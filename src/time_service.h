@@ -0,0 +1,225 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <sys/time.h>
+
+#include "scheduler.h"
+
+#define TIME_STATE_MAGIC 0x54494D45     // "TIME"
+#define TIME_SAVE_INTERVAL_S 3600       // last known time to NVS, for after a power loss
+#define TIME_CORRECTION_INTERVAL_S 3600 // drift correction while NTP is out of reach
+#define TIME_NTP_FRESH_S 7200           // SNTP polls hourly, so this means it got through
+#define TIME_MIN_DRIFT_INTERVAL_S 600   // NTP syncs closer than this say little about drift
+#define TIME_MAX_DRIFT_PPM 500
+#define TIME_NTP_ERROR_MS 50
+#define TIME_BROWSER_ERROR_MS 1000
+#define TIME_ASSUMED_DRIFT_PPM 100      // for the error estimate until a drift is measured
+
+enum TimeSource : uint8_t {
+    TIME_NONE,
+    TIME_RESTORED, // last known time from before a power loss, behind by the outage
+    TIME_BROWSER,
+    TIME_NTP
+};
+
+// Kept in RTC memory across resets and deep sleep, during which the ESP32
+// keeps its clock; NVS holds a copy from the last hour for power losses
+struct TimeState {
+    uint32_t magic;
+    uint32_t savedEpoch;
+    uint32_t lastSync;       // last NTP or browser time
+    uint32_t lastNtp;        // last NTP sync, where drift is measured from
+    uint32_t lastCorrection;
+    int32_t correctedMs;     // drift corrections applied since lastNtp
+    float driftPpm;          // positive: the local clock runs fast
+    uint8_t source;          // TimeSource
+    uint8_t driftKnown;
+    uint16_t reserved;
+    uint32_t check;
+};
+
+// Gives the scheduler a usable clock from the first loop(): the clock the
+// ESP32 kept through a reset, else the last known time from NVS, and
+// later NTP or, without internet, the time of the first browser to open
+// the dashboard. The rate error measured between NTP syncs is corrected
+// for while NTP is out of reach and goes into the error estimate.
+class TimeService {
+private:
+    TimeState* state = nullptr;
+    Preferences* store = nullptr;
+
+    // Written by the SNTP task, consumed by update()
+    volatile bool ntpPending = false;
+    int64_t ntpOffsetUs = 0; // NTP minus the local clock
+    uint32_t ntpEpoch = 0;
+
+    static uint32_t checksum(const TimeState& state) {
+        const uint32_t* words = (const uint32_t*)&state;
+        uint32_t sum = TIME_STATE_MAGIC;
+        for (size_t i = 0; i < offsetof(TimeState, check) / sizeof(uint32_t); i++) {
+            sum = (sum << 5 | sum >> 27) ^ words[i];
+        }
+        return sum;
+    }
+
+    static bool valid(const TimeState& state) {
+        return state.magic == TIME_STATE_MAGIC && state.check == checksum(state) && state.source <= TIME_NTP;
+    }
+
+    void seal() {
+        state->magic = TIME_STATE_MAGIC;
+        state->check = checksum(*state);
+    }
+
+    void save(time_t now) {
+        state->savedEpoch = (uint32_t)now;
+        seal();
+        store->putBytes("clock", state, sizeof(TimeState));
+    }
+
+    static void setClock(int64_t epochUs) {
+        struct timeval tv;
+        tv.tv_sec = epochUs / 1000000;
+        tv.tv_usec = epochUs % 1000000;
+        settimeofday(&tv, nullptr);
+    }
+
+    static int64_t clockUs() {
+        struct timeval tv;
+        gettimeofday(&tv, nullptr);
+        return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+
+    void applyNtp() {
+        ntpPending = false;
+        uint32_t interval = ntpEpoch - state->lastNtp;
+        if (state->source == TIME_NTP && state->lastNtp != 0 && interval >= TIME_MIN_DRIFT_INTERVAL_S) {
+            // What the clock would have been off by without our corrections
+            float rawErrorUs = -ntpOffsetUs - (int64_t)state->correctedMs * 1000;
+            float drift = constrain(rawErrorUs / interval, -TIME_MAX_DRIFT_PPM, TIME_MAX_DRIFT_PPM);
+            state->driftPpm = state->driftKnown ? (state->driftPpm + drift) / 2 : drift;
+            state->driftKnown = true;
+        }
+        Serial.printf("NTP sync: clock was %+lldms off, drift %.1fppm\n",
+                      (long long)(-ntpOffsetUs / 1000), state->driftPpm);
+        state->source = TIME_NTP;
+        state->lastNtp = ntpEpoch;
+        state->lastSync = ntpEpoch;
+        state->lastCorrection = ntpEpoch;
+        state->correctedMs = 0;
+        save(ntpEpoch);
+    }
+
+public:
+    void begin(Preferences& preferences, TimeState& rtcState) {
+        store = &preferences;
+        state = &rtcState;
+        time_t now = time(nullptr);
+
+        if (now >= MIN_VALID_EPOCH && valid(*state)) {
+            Serial.printf("Clock kept through reset (%s)\n", sourceName());
+            return;
+        }
+
+        TimeState saved;
+        bool haveSaved = preferences.getBytes("clock", &saved, sizeof(saved)) == sizeof(saved) && valid(saved);
+        if (haveSaved) {
+            *state = saved;
+        } else {
+            memset(state, 0, sizeof(TimeState));
+        }
+
+        if (now >= MIN_VALID_EPOCH) {
+            state->source = TIME_RESTORED; // set, but nothing says how well
+        } else if (haveSaved && saved.savedEpoch >= MIN_VALID_EPOCH) {
+            setClock((int64_t)saved.savedEpoch * 1000000);
+            state->source = TIME_RESTORED;
+            Serial.println("Clock restored to the last known time, behind by the power outage");
+        } else {
+            state->source = TIME_NONE;
+        }
+        state->lastCorrection = (uint32_t)time(nullptr);
+        seal();
+    }
+
+    // From the SNTP task: sets the clock at once, the rest waits for update()
+    void ntpSynced(const struct timeval& ntp) {
+        int64_t ntpUs = (int64_t)ntp.tv_sec * 1000000 + ntp.tv_usec;
+        ntpOffsetUs = ntpUs - clockUs();
+        ntpEpoch = ntp.tv_sec;
+        settimeofday(&ntp, nullptr);
+        ntpPending = true;
+    }
+
+    // Time from a browser, taken only while there is nothing better
+    bool setFromBrowser(int64_t epochMs) {
+        if (epochMs / 1000 < MIN_VALID_EPOCH) return false;
+        time_t now = time(nullptr);
+        if (state->source == TIME_NTP && now - (time_t)state->lastNtp < TIME_NTP_FRESH_S) return false;
+        if (state->source == TIME_BROWSER && now - (time_t)state->lastSync < TIME_SAVE_INTERVAL_S) return false;
+
+        setClock(epochMs * 1000);
+        Serial.printf("Clock set from browser, was %+llds off\n", (long long)(epochMs / 1000 - now));
+        state->source = TIME_BROWSER;
+        state->lastSync = (uint32_t)(epochMs / 1000);
+        state->lastCorrection = state->lastSync;
+        state->lastNtp = 0; // a drift measurement across this would be meaningless
+        state->correctedMs = 0;
+        save(state->lastSync);
+        return true;
+    }
+
+    // Call from loop(); true when the clock was just synced
+    bool update() {
+        bool synced = false;
+        if (ntpPending) {
+            applyNtp();
+            synced = true;
+        }
+
+        time_t now = time(nullptr);
+        if (now < MIN_VALID_EPOCH) return synced;
+
+        if (state->driftKnown && now - (time_t)state->lastNtp >= TIME_NTP_FRESH_S &&
+            now - (time_t)state->lastCorrection >= TIME_CORRECTION_INTERVAL_S) {
+            int32_t correctionMs = -(int32_t)lroundf(state->driftPpm * (now - (time_t)state->lastCorrection) / 1000);
+            setClock(clockUs() + (int64_t)correctionMs * 1000);
+            state->correctedMs += correctionMs;
+            state->lastCorrection = (uint32_t)time(nullptr);
+            seal();
+        }
+
+        if (now - (time_t)state->savedEpoch >= TIME_SAVE_INTERVAL_S || now < (time_t)state->savedEpoch) {
+            save(now);
+        }
+        return synced;
+    }
+
+    TimeSource getSource() const { return (TimeSource)state->source; }
+
+    const char* sourceName() const {
+        static const char* const names[] = {"none", "restored", "browser", "ntp"};
+        return names[state->source];
+    }
+
+    // Seconds since the last NTP or browser time, -1 if never
+    long getSyncAge() const {
+        if (state->source < TIME_BROWSER) return -1;
+        return time(nullptr) - (time_t)state->lastSync;
+    }
+
+    // Likely error of the clock, -1 when unknown
+    long getErrorMs() const {
+        long age = getSyncAge();
+        if (age < 0) return -1;
+        // A measured drift is corrected for; count a tenth of it as what
+        // the measurement may have missed
+        float drift = state->driftKnown ? max(fabsf(state->driftPpm) / 10, 1.0f) : TIME_ASSUMED_DRIFT_PPM;
+        long base = state->source == TIME_NTP ? TIME_NTP_ERROR_MS : TIME_BROWSER_ERROR_MS;
+        return base + (long)(drift * age / 1000);
+    }
+
+    float getDriftPpm() const { return state->driftKnown ? state->driftPpm : 0; }
+    bool isDriftKnown() const { return state->driftKnown; }
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "http_server.h"
+
+// A gzip-compressed static file in flash, generated into
+// src/generated/web_assets.h by scripts/build_web.py.
+struct WebAsset {
+    const uint8_t* data;
+    uint32_t length;
+    const char* etag;
+};
+
+// Serves a precompressed asset. Browsers revalidate with If-None-Match and
+// get an empty 304 unless the firmware ships a different build of it.
+// Requires "If-None-Match" in server.collectHeaders().
+inline void sendWebAsset(HttpServer& server, const WebAsset& asset, const char* contentType, const char* cacheControl) {
+    server.sendHeader("ETag", asset.etag);
+    server.sendHeader("Cache-Control", cacheControl);
+    if (strcmp(server.header("If-None-Match"), asset.etag) == 0) {
+        server.send(304);
+        return;
+    }
+    server.sendHeader("Content-Encoding", "gzip");
+    server.sendStatic(200, contentType, asset.data, asset.length);
+}
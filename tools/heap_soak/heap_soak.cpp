@@ -0,0 +1,189 @@
+// Serves the dashboard's traffic for days of virtual time on the native
+// HAL and follows the firmware's heap in the HAL's model of the device
+// heap: free space, the largest free block and allocations per request.
+//
+//   heap_soak [--hours 72] [--max-shrink-bytes 0]
+//
+// Like the dashboard, a browser on a keep-alive connection polls the
+// status every 30 virtual seconds, revalidating with its ETag, and every
+// minute also calibration and its last job, while a scraper reads
+// /metrics. Every hour settings are saved, a feeding is queued, the last
+// hour of history is read, the dashboard page is loaded and an event
+// stream is opened and dropped. The first hour is warm-up;
+// after it, free heap and the largest free block are sampled hourly once
+// the connections are idle. It exits with 1 when either ends up more than
+// --max-shrink-bytes below its first sample or a request fails.
+
+#include <Arduino.h>
+#include <string>
+
+#define SOAK_PORT 80
+#define SOAK_REPORT_HOURS 6
+#define SOAK_REQUEST_PASSES 1000 // loop() passes a request may take
+
+void setup();
+void loop();
+
+struct SoakClient {
+    int connection = -1;
+    std::string etag;
+};
+
+static uint32_t requests = 0;
+static uint32_t failures = 0;
+static uint32_t notModified = 0; // revalidated statuses
+
+// End of the chunked body that starts at from, 0 while it is incomplete
+static size_t chunkedEnd(const std::string& received, size_t from) {
+    for (;;) {
+        size_t lineEnd = received.find("\r\n", from);
+        if (lineEnd == std::string::npos) return 0;
+        size_t size = strtoul(received.c_str() + from, nullptr, 16);
+        from = lineEnd + 2 + size + 2;
+        if (from > received.size()) return 0;
+        if (size == 0) return from;
+    }
+}
+
+// Length of the complete response at the start of received, 0 if none yet
+static size_t completeResponse(const std::string& received) {
+    size_t headEnd = received.find("\r\n\r\n");
+    if (headEnd == std::string::npos) return 0;
+    const char* chunked = strcasestr(received.c_str(), "\r\nTransfer-Encoding: chunked");
+    if (chunked && chunked < received.c_str() + headEnd) return chunkedEnd(received, headEnd + 4);
+    const char* length = strcasestr(received.c_str(), "\r\nContent-Length:");
+    if (!length || length > received.c_str() + headEnd) return headEnd + 4;
+    size_t total = headEnd + 4 + strtoul(length + 17, nullptr, 10);
+    return received.size() >= total ? total : 0;
+}
+
+static std::string headerValue(const std::string& response, const char* name) {
+    size_t at = response.find(name);
+    if (at == std::string::npos) return "";
+    at += strlen(name);
+    return response.substr(at, response.find("\r\n", at) - at);
+}
+
+// Hangs up, so the connection's number can be reused
+static void disconnect(SoakClient& client) {
+    if (client.connection >= 0) sim::hangUp(client.connection);
+    client.connection = -1;
+}
+
+// Sends one request on the client's connection, reconnecting if the
+// server closed it, and runs loop() until the response is in
+static std::string fetch(SoakClient& client, const char* method, const char* path, const char* extraHeaders = "") {
+    if (client.connection >= 0 && !sim::clientConnected(client.connection)) disconnect(client);
+    if (client.connection < 0) client.connection = sim::connect(SOAK_PORT);
+    char request[384];
+    snprintf(request, sizeof(request), "%s %s HTTP/1.1\r\nHost: henny.local\r\n%s\r\n", method, path, extraHeaders);
+    sim::clientWrite(client.connection, request);
+    requests++;
+    std::string received;
+    for (int i = 0; i < SOAK_REQUEST_PASSES; i++) {
+        loop();
+        received += sim::clientRead(client.connection);
+        size_t length = completeResponse(received);
+        if (length > 0) {
+            if (received.compare(0, 10, "HTTP/1.1 5") == 0) failures++;
+            if (received.compare(0, 12, "HTTP/1.1 304") == 0) notModified++;
+            if (!headerValue(received, "\r\nConnection: ").compare(0, 5, "close")) disconnect(client);
+            return received.substr(0, length);
+        }
+        if (!sim::clientConnected(client.connection)) break;
+    }
+    failures++;
+    disconnect(client);
+    return "";
+}
+
+static void pollStatus(SoakClient& browser) {
+    std::string conditional = browser.etag.empty() ? "" : "If-None-Match: " + browser.etag + "\r\n";
+    std::string status = fetch(browser, "GET", "/api/status", conditional.c_str());
+    std::string etag = headerValue(status, "\r\nETag: ");
+    if (!etag.empty()) browser.etag = etag;
+}
+
+static void pollDashboard(SoakClient& browser, long job) {
+    pollStatus(browser);
+    fetch(browser, "GET", "/api/calibration");
+    char path[48];
+    snprintf(path, sizeof(path), "/api/job?id=%ld", job);
+    fetch(browser, "GET", path);
+}
+
+static long hourlyChores(SoakClient& browser, int hour) {
+    char path[96];
+    snprintf(path, sizeof(path), "/config?sunriseOffset=%d&hopperCapacity=%d", hour % 2 ? 2 : 1, 5000 + hour % 7);
+    fetch(browser, "POST", path);
+    std::string feed = fetch(browser, "GET", "/feed?amount=10");
+    size_t at = feed.find("\"job\":");
+    long job = at == std::string::npos ? 0 : atol(feed.c_str() + at + 6);
+    snprintf(path, sizeof(path), "/api/history?from=%lu", (unsigned long)(time(nullptr) - 3600));
+    fetch(browser, "GET", path);
+    fetch(browser, "GET", "/");
+    fetch(browser, "GET", "/manifest.json");
+
+    // A tab that subscribes to events and goes away again
+    int stream = sim::connect(SOAK_PORT);
+    sim::clientWrite(stream, "GET /events HTTP/1.1\r\nHost: henny.local\r\n\r\n");
+    for (int i = 0; i < 10; i++) loop();
+    sim::clientRead(stream);
+    sim::hangUp(stream);
+    return job;
+}
+
+int main(int argc, char** argv) {
+    int hours = 72;
+    long maxShrink = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--hours") == 0) hours = max(atoi(argv[i + 1]), 2);
+        else if (strcmp(argv[i], "--max-shrink-bytes") == 0) maxShrink = atol(argv[i + 1]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    sim::setSerialEnabled(false);
+    setup();
+
+    SoakClient browser;
+    SoakClient scraper;
+    long job = 0;
+    sim::HeapStats first = {};
+    sim::HeapStats last = {};
+    uint64_t allocationsBefore = 0;
+    uint32_t requestsBefore = 0;
+    printf("hour    free  min free  largest  blocks  allocs/request\n");
+    for (int hour = 0; hour < hours; hour++) {
+        job = max(job, hourlyChores(browser, hour));
+        for (int minute = 0; minute < 60; minute++) {
+            uint64_t minuteStartUs = sim::nowUs();
+            pollDashboard(browser, job);
+            fetch(scraper, "GET", "/metrics");
+            while (sim::nowUs() < minuteStartUs + 30000000ULL) loop();
+            pollStatus(browser);
+            while (sim::nowUs() < minuteStartUs + 60000000ULL) loop();
+        }
+
+        last = sim::heapStats();
+        if (hour == 0) {
+            first = last;
+            allocationsBefore = last.allocations;
+            requestsBefore = requests;
+        }
+        if (hour == 0 || (hour + 1) % SOAK_REPORT_HOURS == 0 || hour + 1 == hours) {
+            double perRequest = hour == 0 ? 0 : (double)(last.allocations - allocationsBefore) / max(requests - requestsBefore, 1u);
+            printf("%4d  %6lu  %8lu  %7lu  %6lu  %14.2f\n", hour + 1, (unsigned long)last.freeBytes,
+                   (unsigned long)last.minFreeBytes, (unsigned long)last.largestFreeBlock, (unsigned long)last.blocks,
+                   perRequest);
+        }
+    }
+
+    long freeShrink = (long)first.freeBytes - (long)last.freeBytes;
+    long largestShrink = (long)first.largestFreeBlock - (long)last.largestFreeBlock;
+    printf("%lu requests, %lu failed, %lu not modified; since hour 1 free heap %+ld bytes, largest free block %+ld bytes\n",
+           (unsigned long)requests, (unsigned long)failures, (unsigned long)notModified, -freeShrink, -largestShrink);
+    if (failures || freeShrink > maxShrink || largestShrink > maxShrink) return 1;
+    return 0;
+}
@@ -0,0 +1,278 @@
+// Loads the firmware's HTTP server on the native HAL's simulated network:
+// keep-alive browsers requesting dashboard routes back to back, next to a
+// client that reads its response a few hundred bytes at a time and one
+// that never finishes its request headers. A motor test runs through the
+// load, and its relay on-time must come out at the requested 3 s. Last, a
+// firmware image far larger than the request buffer is uploaded to
+// /update, which the server streams through without keeping it.
+//
+//   http_bench [--clients 6] [--requests 200] [--max-p99-us N]
+//
+// Latencies are in host time, from the request going out until its
+// response is read in full: the server's and loop()'s code, including
+// the wait behind the other clients' requests. The virtual clock only
+// moves in loop()'s delay, which the server's work never spends, so it
+// would only show that delay. A slow or stalled client must not move them.
+// With --max-p99-us it exits with 1 when the 99th percentile got slower;
+// it always does when a request fails, the stalled client is not dropped
+// or the motor test ran long, or the upload is not accepted.
+
+#include <Arduino.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#define BENCH_PORT 80
+#define BENCH_MAX_CLIENTS 6      // leaves room for the slow and the stalled client
+#define BENCH_SLOW_WINDOW 256    // bytes the slow client takes per read
+#define BENCH_SLOW_READ_MS 200
+#define BENCH_TIMEOUT_S 600
+#define BENCH_MOTOR_TEST_US 3000000
+#define BENCH_MOTOR_TOLERANCE_US 20000 // dispatch of the dose timer
+#define BENCH_UPLOAD_BYTES 1500000     // a firmware image, far past HTTP_MAX_REQUEST
+#define BENCH_UPLOAD_PASSES 10000      // loop() passes the upload may take
+
+void setup();
+void loop();
+
+static const char* const ROUTES[] = {"/api/status", "/api/calibration", "/manifest.json", "/", "/api/history"};
+
+struct BenchClient {
+    int connection = -1;
+    int sent = 0;
+    int done = 0;
+    uint64_t sentUs = 0;
+    std::chrono::steady_clock::time_point sentAt;
+    std::string received;
+};
+
+static std::chrono::steady_clock::time_point hostNow() {
+    return std::chrono::steady_clock::now();
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::nano>(hostNow() - since).count();
+}
+
+static void sendRequest(BenchClient& client, const char* path) {
+    char request[256];
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: henny.local\r\nConnection: keep-alive\r\n\r\n", path);
+    client.sentUs = sim::nowUs();
+    client.sentAt = hostNow();
+    client.sent++;
+    sim::clientWrite(client.connection, request);
+}
+
+// End of the chunked body that starts at from, 0 while it is incomplete
+static size_t chunkedEnd(const std::string& received, size_t from) {
+    for (;;) {
+        size_t lineEnd = received.find("\r\n", from);
+        if (lineEnd == std::string::npos) return 0;
+        size_t size = strtoul(received.c_str() + from, nullptr, 16);
+        from = lineEnd + 2 + size + 2;
+        if (from > received.size()) return 0;
+        if (size == 0) return from;
+    }
+}
+
+// Length of the complete response at the start of received, 0 if there
+// is none yet, -1 if it is not a success
+static long completeResponse(const std::string& received) {
+    size_t headEnd = received.find("\r\n\r\n");
+    if (headEnd == std::string::npos) return 0;
+    if (received.compare(0, 10, "HTTP/1.1 2") != 0) return -1;
+    const char* length = strcasestr(received.c_str(), "\r\nContent-Length:");
+    if (!length || length > received.c_str() + headEnd) {
+        const char* chunked = strcasestr(received.c_str(), "\r\nTransfer-Encoding: chunked");
+        if (!chunked || chunked > received.c_str() + headEnd) return -1;
+        return (long)chunkedEnd(received, headEnd + 4);
+    }
+    size_t total = headEnd + 4 + strtoul(length + 17, nullptr, 10);
+    return received.size() >= total ? (long)total : 0;
+}
+
+static bool closing(const std::string& response) {
+    const char* close = strcasestr(response.c_str(), "\r\nConnection: close\r\n");
+    return close && close < response.c_str() + response.find("\r\n\r\n");
+}
+
+// One request on a connection of its own, run to completion; the
+// response body, or empty on failure
+static std::string fetch(const char* path) {
+    BenchClient client;
+    client.connection = sim::connect(BENCH_PORT);
+    sendRequest(client, path);
+    for (int i = 0; i < 1000; i++) {
+        loop();
+        client.received += sim::clientRead(client.connection);
+        long length = completeResponse(client.received);
+        if (length < 0) break;
+        if (length > 0) return client.received.substr(client.received.find("\r\n\r\n") + 4, length);
+    }
+    return "";
+}
+
+// Posts a firmware image the way the update page's form does; whether
+// the server took it. A successful update restarts after a delay, so this
+// comes last.
+static bool uploadFirmware(size_t size) {
+    static const char boundary[] = "----HennyBenchBoundary";
+    std::string start = std::string("--") + boundary +
+                        "\r\nContent-Disposition: form-data; name=\"update\"; filename=\"firmware.bin\"\r\n"
+                        "Content-Type: application/octet-stream\r\n\r\n";
+    std::string finish = std::string("\r\n--") + boundary + "--\r\n";
+    char head[256];
+    snprintf(head, sizeof(head),
+             "POST /update HTTP/1.1\r\nHost: henny.local\r\n"
+             "Content-Type: multipart/form-data; boundary=%s\r\nContent-Length: %u\r\n\r\n",
+             boundary, (unsigned)(start.size() + size + finish.size()));
+    BenchClient client;
+    client.connection = sim::connect(BENCH_PORT);
+    sim::clientWrite(client.connection, head + start + std::string(size, '\xE9') + finish);
+    for (int i = 0; i < BENCH_UPLOAD_PASSES; i++) {
+        loop();
+        client.received += sim::clientRead(client.connection);
+        long length = completeResponse(client.received);
+        if (length != 0) return length > 0;
+        if (!sim::clientConnected(client.connection)) break;
+    }
+    return false;
+}
+
+static long jsonNumber(const std::string& json, const char* key) {
+    size_t at = json.find(key);
+    return at == std::string::npos ? -1 : strtol(json.c_str() + at + strlen(key), nullptr, 10);
+}
+
+static double percentile(std::vector<double>& values, double fraction) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(fraction * values.size()))];
+}
+
+int main(int argc, char** argv) {
+    int clientCount = 6;
+    int requests = 200;
+    double maxP99Us = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--clients") == 0) clientCount = constrain(atoi(argv[i + 1]), 1, BENCH_MAX_CLIENTS);
+        else if (strcmp(argv[i], "--requests") == 0) requests = max(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "--max-p99-us") == 0) maxP99Us = atof(argv[i + 1]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    sim::setSerialEnabled(false);
+    setup();
+    long motorJob = jsonNumber(fetch("/test-motor"), "\"job\":");
+
+    // Opens the connection and sends half a request line, then nothing
+    int stalled = sim::connect(BENCH_PORT);
+    sim::clientWrite(stalled, "GET /api/sta");
+
+    // Takes the dashboard page a little at a time
+    BenchClient slow;
+    slow.connection = sim::connect(BENCH_PORT);
+    sim::setReceiveWindow(slow.connection, BENCH_SLOW_WINDOW);
+    sendRequest(slow, "/");
+    uint64_t nextSlowReadUs = 0;
+
+    std::vector<BenchClient> clients(clientCount);
+    for (int i = 0; i < clientCount; i++) {
+        clients[i].connection = sim::connect(BENCH_PORT);
+        sendRequest(clients[i], ROUTES[i % (sizeof(ROUTES) / sizeof(ROUTES[0]))]);
+    }
+
+    std::vector<double> latencies;
+    uint32_t failures = 0;
+    uint64_t bytes = 0;
+    uint64_t startUs = sim::nowUs();
+    uint64_t endUs = startUs + BENCH_TIMEOUT_S * 1000000ULL;
+    auto began = hostNow();
+    int finished = 0;
+    while (finished < clientCount && sim::nowUs() < endUs) {
+        loop();
+        finished = 0;
+        for (int i = 0; i < clientCount; i++) {
+            BenchClient& client = clients[i];
+            if (client.done == requests) {
+                finished++;
+                continue;
+            }
+            client.received += sim::clientRead(client.connection);
+            long length = completeResponse(client.received);
+            if (length == 0 && sim::clientConnected(client.connection)) continue;
+            if (length > 0) {
+                latencies.push_back(elapsedNs(client.sentAt) / 1000);
+                bytes += length;
+                // The server closes after HTTP_KEEPALIVE_REQUESTS; a browser reconnects
+                if (!closing(client.received)) client.received.erase(0, length);
+                else {
+                    client.received.clear();
+                    client.connection = sim::connect(BENCH_PORT);
+                }
+            } else {
+                failures++;
+                client.received.clear();
+                if (!sim::clientConnected(client.connection)) client.connection = sim::connect(BENCH_PORT);
+            }
+            client.done++;
+            if (client.done < requests) {
+                sendRequest(client, ROUTES[(i + client.done) % (sizeof(ROUTES) / sizeof(ROUTES[0]))]);
+            }
+        }
+        if (sim::nowUs() >= nextSlowReadUs && completeResponse(slow.received) == 0) {
+            slow.received += sim::clientRead(slow.connection);
+            nextSlowReadUs = sim::nowUs() + BENCH_SLOW_READ_MS * 1000;
+        }
+    }
+    double hostNs = elapsedNs(began);
+    double virtualS = (sim::nowUs() - startUs) / 1e6;
+
+    // Let the slow client finish and the stalled one time out
+    for (int i = 0; i < 1000 && (completeResponse(slow.received) == 0 || sim::clientConnected(stalled)); i++) {
+        loop();
+        if (sim::nowUs() >= nextSlowReadUs) {
+            slow.received += sim::clientRead(slow.connection);
+            nextSlowReadUs = sim::nowUs() + BENCH_SLOW_READ_MS * 1000;
+        }
+    }
+    bool slowDone = completeResponse(slow.received) > 0;
+    uint64_t slowMs = (sim::nowUs() - slow.sentUs) / 1000;
+    std::string stalledAnswer = sim::clientRead(stalled);
+    bool stalledDropped = !sim::clientConnected(stalled) && stalledAnswer.compare(0, 12, "HTTP/1.1 408") == 0;
+
+    char jobPath[48];
+    snprintf(jobPath, sizeof(jobPath), "/api/job?id=%ld", motorJob);
+    std::string job;
+    for (int i = 0; i < 1000 && motorJob > 0; i++) {
+        job = fetch(jobPath);
+        if (job.find("\"state\":\"queued\"") == std::string::npos && job.find("\"state\":\"running\"") == std::string::npos) break;
+    }
+    long onTimeUs = jsonNumber(job, "\"onTimeUs\":");
+    bool motorOnTime = job.find("\"state\":\"done\"") != std::string::npos &&
+                       labs(onTimeUs - BENCH_MOTOR_TEST_US) <= BENCH_MOTOR_TOLERANCE_US;
+    bool uploaded = uploadFirmware(BENCH_UPLOAD_BYTES);
+
+    size_t count = latencies.size();
+    double p50 = percentile(latencies, 0.5);
+    double p99 = percentile(latencies, 0.99);
+    double worst = count ? latencies.back() : 0;
+    printf("%lu requests on %d keep-alive connections, %lu failed, %.0f KB in %.1f s virtual\n",
+           (unsigned long)count, clientCount, (unsigned long)failures, bytes / 1024.0, virtualS);
+    printf("latency p50 %.1f us, p99 %.1f us, max %.1f us host; %.0f requests/s virtual, %.1f us host per request\n",
+           p50, p99, worst, count / max(virtualS, 0.001), hostNs / max(count, (size_t)1) / 1000);
+    printf("slow client (%d byte window every %d ms): %s after %lu ms\n", BENCH_SLOW_WINDOW, BENCH_SLOW_READ_MS,
+           slowDone ? "page complete" : "page incomplete", (unsigned long)slowMs);
+    printf("stalled client: %s\n", stalledDropped ? "dropped with 408" : "still connected");
+    printf("motor test under load: relay on for %ld us of %d us\n", onTimeUs, BENCH_MOTOR_TEST_US);
+    printf("firmware upload of %d bytes: %s\n", BENCH_UPLOAD_BYTES, uploaded ? "accepted" : "failed");
+
+    if (failures || count < (size_t)clientCount * requests || !slowDone || !stalledDropped || !motorOnTime || !uploaded) return 1;
+    if (maxP99Us > 0 && p99 > maxP99Us) {
+        printf("p99 %.1f us exceeds %.1f us\n", p99, maxP99Us);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,315 @@
+// Fast-forwards the Scheduler through a whole year on the native HAL's
+// virtual clock, for every timezone offered by the dashboard and every
+// feeding frequency (1-8) and sunrise/sunset offset (1-4 h) combination.
+//
+//   schedule_sim [--year 2025] [--out sim_output] [--max-tick-ns 100]
+//                [--golden FILE] [--update-golden FILE]
+//
+// Writes one file per timezone with a line per day and combination:
+//   f3 sr2 ss2 2025-03-30 09:58 14:12 18:26 228.0
+// so two runs can be compared with `diff -r`. Prints days whose feeding
+// count differs from the frequency, and the cost of a scheduler tick.
+// It exits with 1 when a day is off count or the idle tick is slower
+// than --max-tick-ns (0 turns the check off).
+//
+// --golden checks each file's line count and FNV-1a digest against those
+// recorded in FILE, tools/schedule_sim/golden.txt for the default year,
+// and exits with 1 on any difference. --update-golden records them after
+// a change that is meant to move feedings.
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <chrono>
+#include <sys/stat.h>
+
+#include "scheduler.h"
+
+#define SIM_ADULTS 6
+#define SIM_GRAMS 120
+#define BENCH_POLLS 2000000
+#define MAX_IDLE_TICK_NS 100 // about 20 times the tick on a desktop host
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct SimTimezone {
+    const char* name;
+    const char* posix;
+    float latitude;
+    float longitude;
+};
+
+// Same TZ strings as the <select> in web/dashboard.html, each at its city
+static const SimTimezone TIMEZONES[] = {
+    {"berlin", "CET-1CEST,M3.5.0,M10.5.0/3", 52.5200, 13.4050},
+    {"london", "GMT0BST,M3.5.0/1,M10.5.0", 51.5072, -0.1276},
+    {"paris", "CET-1CEST,M3.5.0/2,M10.5.0/3", 48.8566, 2.3522},
+    {"helsinki", "EET-2EEST,M3.5.0/3,M10.5.0/4", 60.1699, 24.9384},
+    {"new_york", "EST5EDT,M3.2.0,M11.1.0", 40.7128, -74.0060},
+    {"los_angeles", "PST8PDT,M3.2.0,M11.1.0", 34.0522, -118.2437},
+    {"tokyo", "JST-9", 35.6762, 139.6503},
+};
+
+// What --golden compares of one timezone's file
+struct Digest {
+    uint32_t lines = 0;
+    uint64_t hash = FNV_OFFSET;
+};
+
+struct SimStats {
+    uint32_t feedings = 0;
+    uint32_t ticks = 0;
+    uint32_t badDays = 0;
+    double simulateNs = 0;
+};
+
+static std::chrono::steady_clock::time_point hostNow() {
+    return std::chrono::steady_clock::now();
+}
+
+static double elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::nano>(hostNow() - since).count();
+}
+
+static time_t localMidnight(int year, int month, int day) {
+    struct tm date = {};
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day;
+    date.tm_isdst = -1;
+    return mktime(&date);
+}
+
+// One day's line: the feeding times collected for a local date
+struct DayLine {
+    int yday = -1;
+    char date[11] = "";
+    int count = 0;
+    float grams = 0;
+    char times[MAX_FEEDINGS_PER_DAY * 6 + 8] = "";
+};
+
+static void flushDay(FILE* out, DayLine& day, int frequency, int sunriseOff, int sunsetOff, SimStats& stats) {
+    if (day.yday < 0) return;
+    fprintf(out, "f%d sr%d ss%d %s%s %.1f\n", frequency, sunriseOff, sunsetOff, day.date, day.times, day.grams);
+    if (day.count != frequency) {
+        stats.badDays++;
+        printf("  %s f%d sr%d ss%d: %d feedings\n", day.date, frequency, sunriseOff, sunsetOff, day.count);
+    }
+    day = DayLine();
+}
+
+static void simulate(FILE* out, const SimTimezone& zone, int year, int frequency, int sunriseOff, int sunsetOff, SimStats& stats) {
+    time_t start = localMidnight(year, 1, 1);
+    time_t end = localMidnight(year + 1, 1, 1);
+    sim::setEpoch(start - 1);
+
+    Preferences preferences;
+    preferences.begin(zone.name, false);
+    preferences.remove("fedUntil");
+    FeedingCursor cursor = {};
+    Scheduler scheduler;
+    scheduler.begin(preferences, cursor);
+    scheduler.setLocation(preferences, zone.latitude, zone.longitude);
+    scheduler.configure(SIM_ADULTS, SIM_GRAMS, frequency, sunriseOff, sunsetOff);
+
+    DayLine day;
+    float amount;
+    auto began = hostNow();
+    scheduler.poll(amount); // no history yet: starts counting from here
+    for (;;) {
+        uint64_t wait = sim::nextTimerUs();
+        if (wait == UINT64_MAX) break;
+        sim::advance(wait);
+        time_t now = time(nullptr);
+        if (now >= end) break;
+
+        stats.ticks++;
+        if (!scheduler.poll(amount)) continue;
+
+        struct tm local;
+        localtime_r(&now, &local);
+        if (local.tm_yday != day.yday) {
+            flushDay(out, day, frequency, sunriseOff, sunsetOff, stats);
+            day.yday = local.tm_yday;
+            strftime(day.date, sizeof(day.date), "%Y-%m-%d", &local);
+        }
+        size_t used = strlen(day.times);
+        snprintf(day.times + used, sizeof(day.times) - used, " %02d:%02d", local.tm_hour, local.tm_min);
+        day.count++;
+        day.grams = amount;
+        stats.feedings++;
+    }
+    flushDay(out, day, frequency, sunriseOff, sunsetOff, stats);
+    stats.simulateNs += elapsedNs(began);
+}
+
+static bool digestFile(const char* path, Digest& digest) {
+    FILE* in = fopen(path, "r");
+    if (!in) return false;
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        digest.hash = (digest.hash ^ (uint8_t)c) * FNV_PRIME;
+        if (c == '\n') digest.lines++;
+    }
+    fclose(in);
+    return true;
+}
+
+// Compares each timezone's digest with its line "name lines hash" in the
+// golden file, whose "year" line must match the simulated year
+static bool checkGolden(const char* path, int year, const Digest* digests, size_t count) {
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return false;
+    }
+    bool matched[sizeof(TIMEZONES) / sizeof(TIMEZONES[0])] = {};
+    bool ok = true;
+    int goldenYear = 0;
+    char line[128];
+    while (fgets(line, sizeof(line), in)) {
+        char name[32];
+        unsigned long lines;
+        unsigned long long hash;
+        if (line[0] == '#' || sscanf(line, "year %d", &goldenYear) == 1) continue;
+        if (sscanf(line, "%31s %lu %llx", name, &lines, &hash) != 3) continue;
+        for (size_t z = 0; z < count; z++) {
+            if (strcmp(name, TIMEZONES[z].name) != 0) continue;
+            matched[z] = true;
+            if (digests[z].lines == lines && digests[z].hash == hash) break;
+            printf("%s: %lu lines, digest %016llx; golden %lu lines, digest %016llx\n", name,
+                   (unsigned long)digests[z].lines, (unsigned long long)digests[z].hash, lines, hash);
+            ok = false;
+        }
+    }
+    fclose(in);
+    if (goldenYear != year) {
+        printf("%s is for %d, not %d\n", path, goldenYear, year);
+        return false;
+    }
+    for (size_t z = 0; z < count; z++) {
+        if (matched[z]) continue;
+        printf("%s: not in %s\n", TIMEZONES[z].name, path);
+        ok = false;
+    }
+    return ok;
+}
+
+static bool writeGolden(const char* path, int year, const Digest* digests, size_t count) {
+    FILE* out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return false;
+    }
+    fprintf(out, "# schedule_sim output per timezone: lines and FNV-1a 64 digest\n");
+    fprintf(out, "year %d\n", year);
+    for (size_t z = 0; z < count; z++) {
+        fprintf(out, "%s %lu %016llx\n", TIMEZONES[z].name, (unsigned long)digests[z].lines,
+                (unsigned long long)digests[z].hash);
+    }
+    fclose(out);
+    return true;
+}
+
+// Cost of the poll() every loop() pass makes when nothing is due
+static double benchmarkIdleTick() {
+    Preferences preferences;
+    preferences.begin("bench", false);
+    FeedingCursor cursor = {};
+    Scheduler scheduler;
+    scheduler.begin(preferences, cursor);
+    scheduler.setLocation(preferences, DEFAULT_LATITUDE, DEFAULT_LONGITUDE);
+    scheduler.configure(SIM_ADULTS, SIM_GRAMS, 3, 2, 2);
+    float amount;
+    scheduler.poll(amount);
+
+    auto began = hostNow();
+    uint32_t fed = 0;
+    for (uint32_t i = 0; i < BENCH_POLLS; i++) {
+        fed += scheduler.poll(amount);
+    }
+    double ns = elapsedNs(began) / BENCH_POLLS;
+    return fed ? -1 : ns;
+}
+
+int main(int argc, char** argv) {
+    int year = 2025;
+    const char* outDir = "sim_output";
+    double maxTickNs = MAX_IDLE_TICK_NS;
+    const char* golden = nullptr;
+    const char* updateGolden = nullptr;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--year") == 0) year = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--out") == 0) outDir = argv[i + 1];
+        else if (strcmp(argv[i], "--max-tick-ns") == 0) maxTickNs = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--golden") == 0) golden = argv[i + 1];
+        else if (strcmp(argv[i], "--update-golden") == 0) updateGolden = argv[i + 1];
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    mkdir(outDir, 0755);
+    sim::setSerialEnabled(false);
+
+    const size_t zoneCount = sizeof(TIMEZONES) / sizeof(TIMEZONES[0]);
+    Digest digests[zoneCount];
+    SimStats total;
+    for (size_t z = 0; z < zoneCount; z++) {
+        const SimTimezone& zone = TIMEZONES[z];
+        setenv("TZ", zone.posix, 1);
+        tzset();
+
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s.txt", outDir, zone.name);
+        FILE* out = fopen(path, "w");
+        if (!out) {
+            perror(path);
+            return 2;
+        }
+        fprintf(out, "# %s %s %.4f,%.4f %d\n", zone.name, zone.posix, zone.latitude, zone.longitude, year);
+
+        SimStats stats;
+        printf("%s (%s)\n", zone.name, zone.posix);
+        for (int frequency = 1; frequency <= MAX_FEEDINGS_PER_DAY; frequency++) {
+            for (int sunriseOff = 1; sunriseOff <= 4; sunriseOff++) {
+                for (int sunsetOff = 1; sunsetOff <= 4; sunsetOff++) {
+                    simulate(out, zone, year, frequency, sunriseOff, sunsetOff, stats);
+                }
+            }
+        }
+        fclose(out);
+        if (!digestFile(path, digests[z])) {
+            perror(path);
+            return 2;
+        }
+        printf("  %lu feedings, %lu days off count, %.0f ms\n",
+               (unsigned long)stats.feedings, (unsigned long)stats.badDays, stats.simulateNs / 1e6);
+
+        total.feedings += stats.feedings;
+        total.ticks += stats.ticks;
+        total.badDays += stats.badDays;
+        total.simulateNs += stats.simulateNs;
+    }
+
+    double idleNs = benchmarkIdleTick();
+    printf("%lu feedings in %.0f ms, %.0f ns per event tick, %.1f ns per idle tick\n",
+           (unsigned long)total.feedings, total.simulateNs / 1e6, total.simulateNs / max(total.ticks, (uint32_t)1), idleNs);
+    if (idleNs < 0) {
+        printf("Idle tick fed unexpectedly\n");
+        return 1;
+    }
+    if (maxTickNs > 0 && idleNs > maxTickNs) {
+        printf("Idle tick %.1f ns exceeds %.1f ns\n", idleNs, maxTickNs);
+        return 1;
+    }
+    if (updateGolden && !writeGolden(updateGolden, year, digests, zoneCount)) return 2;
+    if (golden) {
+        if (!checkGolden(golden, year, digests, zoneCount)) {
+            printf("Output differs from %s; diff -r against a run of the last good commit\n", golden);
+            return 1;
+        }
+        printf("Output matches %s\n", golden);
+    }
+    return total.badDays ? 1 : 0;
+}